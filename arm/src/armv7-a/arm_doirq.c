@@ -49,6 +49,7 @@
 
 #include "up_arch.h"
 #include "up_internal.h"
+#include "up_irqstat.h"
 
 #include "group/group.h"
 
@@ -87,10 +88,12 @@ uint32_t *arm_doirq(int irq, uint32_t *regs)
    */
 
   CURRENT_REGS = regs;
+  up_irqstat_enter(irq);
 
   /* Deliver the IRQ */
 
   irq_dispatch(irq, regs);
+  up_irqstat_leave(irq);
 
 #if defined(CONFIG_ARCH_FPU) || defined(CONFIG_ARCH_ADDRENV)
   /* Check for a context switch.  If a context switch occurred, then
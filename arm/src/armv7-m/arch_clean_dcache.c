@@ -80,35 +80,28 @@
 void arch_clean_dcache(uintptr_t start, uintptr_t end)
 {
   uint32_t ccsidr;
-  uint32_t smask;
   uint32_t sshift;
-  uint32_t ways;
-  uint32_t wshift;
   uint32_t ssize;
-  uint32_t set;
-  uint32_t sw;
 
   /* Get the characteristics of the D-Cache */
 
   ccsidr = getreg32(NVIC_CCSIDR);
-  smask  = CCSIDR_SETS(ccsidr);          /* (Number of sets) - 1 */
   sshift = CCSIDR_LSSHIFT(ccsidr) + 4;   /* log2(cache-line-size-in-bytes) */
-  ways   = CCSIDR_WAYS(ccsidr);          /* (Number of ways) - 1 */
-
-  /* Calculate the bit offset for the way field in the DCCSW register by
-   * counting the number of leading zeroes.  For example:
-   *
-   *   Number of  Value of ways  Field
-   *   Ways       'ways'         Offset
-   *     2         1             31
-   *     4         3             30
-   *     8         7             29
-   *   ...
+
+  /* A by-address operation costs one register write per cache line, a
+   * whole-cache operation costs one per set and way.  If the region is at
+   * least as large as the D-Cache, clean the whole D-Cache instead.
    */
 
-  wshift = arm_clz(ways) & 0x1f;
+  if (end - start >= CCSIDR_CACHESIZE(ccsidr))
+    {
+      arch_clean_dcache_all();
+      return;
+    }
 
-  /* Clean the D-Cache over the range of addresses */
+  /* Clean the D-Cache over the range of addresses.  Operating by address
+   * only touches the lines that hold the region, in whichever way they are.
+   */
 
   ssize  = (1 << sshift);
   start &= ~(ssize - 1);
@@ -116,25 +109,7 @@ void arch_clean_dcache(uintptr_t start, uintptr_t end)
 
   do
     {
-      int32_t tmpways = ways;
-
-      /* Isolate the cache line associated with this address.  For example
-       * if the cache line size is 32 bytes and the cache size is 16KB, then 
-       *
-       *   sshift = 5      : Offset to the beginning of the set field
-       *   smask  = 0x007f : Mask of the set field
-       */
-
-      set = ((uint32_t)start >> sshift) & smask;
-
-      /* Clean and invalidate each way for this cacheline */
-
-      do
-        {
-          sw = ((tmpways << wshift) | (set << sshift));
-          putreg32(sw, NVIC_DCCSW);
-        }
-      while (tmpways--);
+      putreg32(start, NVIC_DCCMVAC);
 
       /* Increment the address by the size of one cache line. */
 
@@ -0,0 +1,212 @@
+/****************************************************************************
+ * arch/arm/src/armv7-m/arch_dcache_benchmark.c
+ *
+ *   Copyright (C) 2016 Gregory Nutt. All rights reserved.
+ *   Author: Gregory Nutt <gnutt@nuttx.org>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name NuttX nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************/
+
+/****************************************************************************
+ * Included Files
+ ****************************************************************************/
+
+#include <nuttx/config.h>
+
+#include <stdint.h>
+#include <string.h>
+#include <syslog.h>
+
+#include <nuttx/irq.h>
+#include <nuttx/kmalloc.h>
+
+#include "cache.h"
+#include "dwt.h"
+
+#ifdef CONFIG_ARMV7M_DCACHE_BENCHMARK
+
+/****************************************************************************
+ * Pre-processor Definitions
+ ****************************************************************************/
+
+/* Region sizes are doubled from this up to twice the D-Cache size */
+
+#define BENCH_MINSIZE 32
+
+/****************************************************************************
+ * Private Types
+ ****************************************************************************/
+
+typedef void (*bench_range_t)(uintptr_t start, uintptr_t end);
+
+/****************************************************************************
+ * Private Functions
+ ****************************************************************************/
+
+/****************************************************************************
+ * Name: bench_clean
+ * Name: bench_flush
+ * Name: bench_invalidate
+ *
+ * Description:
+ *   Wrappers so that the maintenance operations can be called through a
+ *   pointer even when they are defined as macros.
+ *
+ ****************************************************************************/
+
+static void bench_clean(uintptr_t start, uintptr_t end)
+{
+  arch_clean_dcache(start, end);
+}
+
+static void bench_flush(uintptr_t start, uintptr_t end)
+{
+  arch_flush_dcache(start, end);
+}
+
+static void bench_invalidate(uintptr_t start, uintptr_t end)
+{
+  arch_invalidate_dcache(start, end);
+}
+
+/****************************************************************************
+ * Name: bench_range
+ *
+ * Description:
+ *   Dirty the region and return the number of cycles that 'op' takes on it.
+ *
+ ****************************************************************************/
+
+static uint32_t bench_range(bench_range_t op, FAR uint8_t *buffer,
+                            size_t size)
+{
+  irqstate_t flags;
+  uint32_t start;
+  uint32_t cycles;
+
+  memset(buffer, 0x5a, size);
+
+  flags  = enter_critical_section();
+  start  = getreg32(DWT_CYCCNT);
+  op((uintptr_t)buffer, (uintptr_t)buffer + size);
+  cycles = getreg32(DWT_CYCCNT) - start;
+  leave_critical_section(flags);
+
+  return cycles;
+}
+
+/****************************************************************************
+ * Public Functions
+ ****************************************************************************/
+
+/****************************************************************************
+ * Name: arch_dcache_benchmark
+ *
+ * Description:
+ *   Measure the cost of the D-Cache maintenance operations with the DWT
+ *   cycle counter and report it in cycles per KB of the region maintained.
+ *   Regions from one cache line up to twice the D-Cache size are used, so
+ *   the switch to whole-cache operations can be seen in the results.
+ *
+ * Input Parameters:
+ *   None
+ *
+ * Returned Value:
+ *   None
+ *
+ ****************************************************************************/
+
+void arch_dcache_benchmark(void)
+{
+  FAR uint8_t *buffer;
+  irqstate_t flags;
+  uint32_t ccsidr;
+  uint32_t cachesize;
+  uint32_t linesize;
+  uint32_t clean;
+  uint32_t flush;
+  uint32_t inval;
+  uint32_t start;
+  size_t size;
+
+  ccsidr    = getreg32(NVIC_CCSIDR);
+  cachesize = CCSIDR_CACHESIZE(ccsidr);
+  linesize  = 1 << (CCSIDR_LSSHIFT(ccsidr) + 4);
+
+  buffer = (FAR uint8_t *)kmm_memalign(linesize, 2 * cachesize);
+  if (buffer == NULL)
+    {
+      syslog(LOG_ERR, "D-Cache benchmark: Failed to allocate %u bytes\n",
+             (unsigned int)(2 * cachesize));
+      return;
+    }
+
+  /* Enable the DWT cycle counter */
+
+  modifyreg32(NVIC_DEMCR, 0, NVIC_DEMCR_TRCENA);
+  modifyreg32(DWT_CTRL, 0, DWT_CTRL_CYCCNTENA_Msk);
+
+  syslog(LOG_INFO, "D-Cache: %u bytes, %u ways, %u byte lines\n",
+         (unsigned int)cachesize, (unsigned int)(CCSIDR_WAYS(ccsidr) + 1),
+         (unsigned int)linesize);
+  syslog(LOG_INFO, "%8s %10s %10s %10s  (cycles per KB)\n",
+         "Size", "Clean", "Invalidate", "Flush");
+
+  for (size = BENCH_MINSIZE; size <= 2 * cachesize; size <<= 1)
+    {
+      clean = bench_range(bench_clean, buffer, size);
+      inval = bench_range(bench_invalidate, buffer, size);
+      flush = bench_range(bench_flush, buffer, size);
+
+      syslog(LOG_INFO, "%8u %10lu %10lu %10lu\n", (unsigned int)size,
+             (unsigned long)((uint64_t)clean * 1024 / size),
+             (unsigned long)((uint64_t)inval * 1024 / size),
+             (unsigned long)((uint64_t)flush * 1024 / size));
+    }
+
+  /* And the whole-cache operations for reference */
+
+  memset(buffer, 0x5a, cachesize);
+
+  flags = enter_critical_section();
+  start = getreg32(DWT_CYCCNT);
+  arch_clean_dcache_all();
+  clean = getreg32(DWT_CYCCNT) - start;
+  start = getreg32(DWT_CYCCNT);
+  arch_flush_dcache_all();
+  flush = getreg32(DWT_CYCCNT) - start;
+  leave_critical_section(flags);
+
+  syslog(LOG_INFO, "Whole D-Cache: clean %lu, flush %lu cycles\n",
+         (unsigned long)clean, (unsigned long)flush);
+
+  kmm_free(buffer);
+}
+
+#endif /* CONFIG_ARMV7M_DCACHE_BENCHMARK */
@@ -72,6 +72,11 @@
 #define CCSIDR_LSSHIFT(n) \
   (((n) & NVIC_CCSIDR_LINESIZE_MASK) >> NVIC_CCSIDR_LINESIZE_SHIFT)
 
+/* CCSIDR_CACHESIZE - Returns the cache size in bytes */
+
+#define CCSIDR_CACHESIZE(n) \
+  ((CCSIDR_SETS(n) + 1) * (CCSIDR_WAYS(n) + 1) << (CCSIDR_LSSHIFT(n) + 4))
+
 /* intrinsics are used in these inline functions */
 
 #define arm_isb(n) __asm__ __volatile__ ("isb " #n : : : "memory")
@@ -467,6 +472,27 @@ void arch_flush_dcache_all(void);
 #  define arch_flush_dcache_all()
 #endif
 
+/****************************************************************************
+ * Name: arch_dcache_benchmark
+ *
+ * Description:
+ *   Report the cost of the D-Cache maintenance operations in cycles per KB
+ *   maintained.
+ *
+ * Input Parameters:
+ *   None
+ *
+ * Returned Value:
+ *   None
+ *
+ ****************************************************************************/
+
+#ifdef CONFIG_ARMV7M_DCACHE_BENCHMARK
+void arch_dcache_benchmark(void);
+#else
+#  define arch_dcache_benchmark()
+#endif
+
 #undef EXTERN
 #ifdef __cplusplus
 }
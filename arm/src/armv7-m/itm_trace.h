@@ -0,0 +1,152 @@
+/****************************************************************************
+ * arch/arm/src/armv7-m/itm_trace.h
+ *
+ *   Copyright (C) 2016 Gregory Nutt. All rights reserved.
+ *   Author: Gregory Nutt <gnutt@nuttx.org>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name NuttX nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************/
+
+#ifndef __ARCH_ARM_SRC_ARMV7_M_ITM_TRACE_H
+#define __ARCH_ARM_SRC_ARMV7_M_ITM_TRACE_H
+
+/****************************************************************************
+ * Included Files
+ ****************************************************************************/
+
+#include <nuttx/config.h>
+
+#ifndef __ASSEMBLY__
+#  include <stdint.h>
+#endif
+
+/****************************************************************************
+ * Pre-processor Definitions
+ ****************************************************************************/
+
+/* Trace records are sent as 32-bit words on two ITM stimulus ports.  Each
+ * record starts with one header word on ITM_TRACE_HDRPORT, followed by its
+ * data words on ITM_TRACE_DATAPORT.  The first data word is always the
+ * DWT_CYCCNT value when the record was made.  Because the headers have a
+ * port of their own, a decoder can always find the start of the next
+ * record, even if part of a record was dropped.
+ *
+ *   Header word:  bits 31-24: record type (ITM_TRACE_*)
+ *                 bits 23-0:  argument (PID, IRQ number, marker ID, ...)
+ */
+
+#define ITM_TRACE_HDRPORT   CONFIG_ARMV7M_ITMTRACE_PORT
+#define ITM_TRACE_DATAPORT  (CONFIG_ARMV7M_ITMTRACE_PORT + 1)
+
+#define ITM_TRACE_TYPE_SHIFT 24
+#define ITM_TRACE_ARG_MASK   0x00ffffff
+
+#define ITM_TRACE_HEADER(t,a) \
+  (((uint32_t)(t) << ITM_TRACE_TYPE_SHIFT) | \
+   ((uint32_t)(a) & ITM_TRACE_ARG_MASK))
+
+/* Record types.  The data words that follow the timestamp are given in
+ * brackets.
+ */
+
+#define ITM_TRACE_START     1  /* Task PID started [name, 4 bytes per word] */
+#define ITM_TRACE_STOP      2  /* Task PID stopped */
+#define ITM_TRACE_SUSPEND   3  /* Task PID switched out */
+#define ITM_TRACE_RESUME    4  /* Task PID switched in */
+#define ITM_TRACE_IRQENTER  5  /* Entry to the handler of IRQ */
+#define ITM_TRACE_IRQLEAVE  6  /* Exit from the handler of IRQ */
+#define ITM_TRACE_MARK      7  /* User marker ID [value] */
+#define ITM_TRACE_DROPPED   8  /* Number of records dropped just before */
+#define ITM_TRACE_PREEMPT   9  /* Task PID pre-emption [1=locked] */
+#define ITM_TRACE_CSECTION 10  /* Task PID critical section [1=enter] */
+
+/****************************************************************************
+ * Public Data
+ ****************************************************************************/
+
+#if defined(CONFIG_ARMV7M_ITMTRACE) && !defined(__ASSEMBLY__)
+/* The number of records that could not be sent, in whole or in part,
+ * because the stimulus port FIFO was full.
+ */
+
+extern uint32_t g_itm_trace_dropped;
+#endif
+
+/****************************************************************************
+ * Public Function Prototypes
+ ****************************************************************************/
+
+#ifdef CONFIG_ARMV7M_ITMTRACE
+
+/****************************************************************************
+ * Name: itm_trace_initialize
+ *
+ * Description:
+ *   Enable the ITM trace ports and the DWT cycle counter.  Unless ITM
+ *   SYSLOG support has already done so, also configure the ITM and the SWO
+ *   output.  As for itm_syslog_initialize(), MCU-specific logic must first
+ *   enable the serial wire output pin and debug clocking.
+ *
+ ****************************************************************************/
+
+void itm_trace_initialize(void);
+
+/****************************************************************************
+ * Name: itm_trace_mark
+ *
+ * Description:
+ *   Send a user marker record with an ID and a value.  May be called from
+ *   any context.
+ *
+ ****************************************************************************/
+
+void itm_trace_mark(uint32_t id, uint32_t value);
+
+#else
+#  define itm_trace_initialize()
+#  define itm_trace_mark(id,value)
+#endif
+
+/****************************************************************************
+ * Name: itm_trace_irqenter and itm_trace_irqleave
+ *
+ * Description:
+ *   Trace the entry to and the exit from the handler of 'irq'.
+ *
+ ****************************************************************************/
+
+#ifdef CONFIG_ARMV7M_ITMTRACE_IRQ
+void itm_trace_irqenter(int irq);
+void itm_trace_irqleave(int irq);
+#else
+#  define itm_trace_irqenter(irq)
+#  define itm_trace_irqleave(irq)
+#endif
+
+#endif /* __ARCH_ARM_SRC_ARMV7_M_ITM_TRACE_H */
@@ -113,5 +113,19 @@ void exception_common(void);
 
 int up_ramvec_attach(int irq, up_vector_t vector);
 
+/****************************************************************************
+ * Name: up_zerolatency_attach
+ *
+ * Description:
+ *   Attach 'vector' directly to the vector of IRQ number 'irq' and run it
+ *   at NVIC_SYSH_HIGH_PRIORITY, above the reach of critical sections.  The
+ *   handler must not use any OS services.  A NULL vector detaches it.
+ *
+ ****************************************************************************/
+
+#ifdef CONFIG_ARMV7M_ZEROLATENCY_IRQ
+int up_zerolatency_attach(int irq, up_vector_t vector);
+#endif
+
 #endif /* CONFIG_ARCH_RAMVECTORS */
 #endif  /* __ARCH_ARM_SRC_COMMON_ARMV7_M_RAM_VECTORS_H */
@@ -0,0 +1,470 @@
+/****************************************************************************
+ * arch/arm/src/armv7-m/tools/itmdecode.c
+ *
+ *   Copyright (C) 2016 Gregory Nutt. All rights reserved.
+ *   Author: Gregory Nutt <gnutt@nuttx.org>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name NuttX nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************/
+
+/****************************************************************************
+ * Host-side decoder for the ARMv7-M ITM binary trace (CONFIG_ARMV7M_ITMTRACE)
+ *
+ * Reads a raw SWO capture (the ITM packet stream, as produced with the
+ * TPIU formatter bypassed) and writes the trace records as a Chrome/Perfetto
+ * JSON timeline.  Build it with the host compiler:
+ *
+ *   cc -o itmdecode itmdecode.c
+ *
+ * Usage:
+ *
+ *   itmdecode [-p port] [-f hz] [capture [output.json]]
+ *
+ *   -p port  The trace header port, CONFIG_ARMV7M_ITMTRACE_PORT (default 8)
+ *   -f hz    The CPU clock.  Without it, timestamps are in CPU cycles.
+ *
+ * See arch/arm/src/armv7-m/itm_trace.h for the record format.
+ *
+ ****************************************************************************/
+
+/****************************************************************************
+ * Included Files
+ ****************************************************************************/
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+/****************************************************************************
+ * Pre-processor Definitions
+ ****************************************************************************/
+
+/* These must agree with arch/arm/src/armv7-m/itm_trace.h */
+
+#define ITM_TRACE_TYPE_SHIFT 24
+#define ITM_TRACE_ARG_MASK   0x00ffffff
+
+#define ITM_TRACE_START      1
+#define ITM_TRACE_STOP       2
+#define ITM_TRACE_SUSPEND    3
+#define ITM_TRACE_RESUME     4
+#define ITM_TRACE_IRQENTER   5
+#define ITM_TRACE_IRQLEAVE   6
+#define ITM_TRACE_MARK       7
+#define ITM_TRACE_DROPPED    8
+#define ITM_TRACE_PREEMPT    9
+#define ITM_TRACE_CSECTION   10
+
+#define MAX_DATA             8   /* Data words kept per record */
+
+/* Timeline processes (rows groups) */
+
+#define ROW_TASKS            0
+#define ROW_IRQS             1
+#define ROW_PREEMPT          2
+#define ROW_CSECTION         3
+
+/****************************************************************************
+ * Private Types
+ ****************************************************************************/
+
+struct record_s
+{
+  bool     valid;                /* A header has been seen */
+  uint32_t header;               /* Header word */
+  uint32_t data[MAX_DATA];       /* Timestamp and data words */
+  int      ndata;                /* Number of data words received */
+};
+
+struct decoder_s
+{
+  FILE    *out;                  /* JSON output */
+  int      hdrport;              /* Port of the header words */
+  double   hz;                   /* CPU clock, zero for cycles */
+  bool     first;                /* No event written yet */
+  bool     havetime;             /* 'last' is valid */
+  uint32_t last;                 /* Last raw timestamp */
+  uint64_t now;                  /* Unwrapped time in cycles */
+  struct record_s rec;           /* The record being assembled */
+
+  /* Statistics */
+
+  unsigned long records;         /* Complete records decoded */
+  unsigned long dropped;         /* Records that the target dropped */
+  unsigned long torn;            /* Records without a timestamp */
+  unsigned long orphans;         /* Data words without a header */
+  unsigned long overflows;       /* ITM overflow packets */
+};
+
+/****************************************************************************
+ * Private Functions
+ ****************************************************************************/
+
+static void show_usage(const char *progname)
+{
+  fprintf(stderr, "USAGE: %s [-p port] [-f hz] [capture [output.json]]\n",
+          progname);
+  exit(EXIT_FAILURE);
+}
+
+/* Emit the start of one JSON trace event */
+
+static void event_begin(struct decoder_s *dec, const char *name,
+                        const char *ph, int pid, int tid)
+{
+  double ts = dec->hz > 0 ? (double)dec->now * 1e6 / dec->hz :
+                            (double)dec->now;
+
+  fprintf(dec->out, "%s\n{\"name\":\"%s\",\"ph\":\"%s\",\"pid\":%d,"
+          "\"tid\":%d,\"ts\":%.3f", dec->first ? "" : ",", name, ph, pid,
+          tid, ts);
+  dec->first = false;
+}
+
+static void event(struct decoder_s *dec, const char *name, const char *ph,
+                  int pid, int tid)
+{
+  event_begin(dec, name, ph, pid, tid);
+  fprintf(dec->out, "}");
+}
+
+static void metadata(struct decoder_s *dec, const char *what, int pid,
+                     int tid, const char *name)
+{
+  const char *s;
+
+  fprintf(dec->out, "%s\n{\"name\":\"%s\",\"ph\":\"M\",\"pid\":%d,"
+          "\"tid\":%d,\"args\":{\"name\":\"", dec->first ? "" : ",", what,
+          pid, tid);
+
+  for (s = name; *s != '\0'; s++)
+    {
+      if (*s == '"' || *s == '\\')
+        {
+          fputc('\\', dec->out);
+        }
+
+      if ((unsigned char)*s >= 0x20)
+        {
+          fputc(*s, dec->out);
+        }
+    }
+
+  fprintf(dec->out, "\"}}");
+  dec->first = false;
+}
+
+/* Turn one complete record into timeline events */
+
+static void record_emit(struct decoder_s *dec)
+{
+  struct record_s *rec = &dec->rec;
+  unsigned int type;
+  unsigned long arg;
+  char name[4 * MAX_DATA + 1];
+  char label[64];
+
+  if (!rec->valid)
+    {
+      return;
+    }
+
+  rec->valid = false;
+  if (rec->ndata < 1)
+    {
+      dec->torn++;
+      return;
+    }
+
+  /* Unwrap the 32-bit cycle counter */
+
+  if (dec->havetime)
+    {
+      dec->now += (uint32_t)(rec->data[0] - dec->last);
+    }
+
+  dec->last     = rec->data[0];
+  dec->havetime = true;
+  dec->records++;
+
+  type = rec->header >> ITM_TRACE_TYPE_SHIFT;
+  arg  = rec->header & ITM_TRACE_ARG_MASK;
+
+  switch (type)
+    {
+      case ITM_TRACE_START:
+        memset(name, 0, sizeof(name));
+        if (rec->ndata > 1)
+          {
+            memcpy(name, &rec->data[1], 4 * (rec->ndata - 1));
+          }
+
+        snprintf(label, sizeof(label), "%s%s%lu", name,
+                 name[0] != '\0' ? " " : "pid ", arg);
+        metadata(dec, "thread_name", ROW_TASKS, (int)arg, label);
+        event(dec, "start", "i", ROW_TASKS, (int)arg);
+        break;
+
+      case ITM_TRACE_STOP:
+        event(dec, "stop", "i", ROW_TASKS, (int)arg);
+        break;
+
+      case ITM_TRACE_RESUME:
+        event(dec, "running", "B", ROW_TASKS, (int)arg);
+        break;
+
+      case ITM_TRACE_SUSPEND:
+        event(dec, "running", "E", ROW_TASKS, (int)arg);
+        break;
+
+      case ITM_TRACE_IRQENTER:
+      case ITM_TRACE_IRQLEAVE:
+        snprintf(label, sizeof(label), "IRQ %lu", arg);
+        event(dec, label, type == ITM_TRACE_IRQENTER ? "B" : "E",
+              ROW_IRQS, (int)arg);
+        break;
+
+      case ITM_TRACE_MARK:
+        snprintf(label, sizeof(label), "mark %lu", arg);
+        event_begin(dec, label, "i", ROW_TASKS, 0);
+        fprintf(dec->out, ",\"s\":\"g\",\"args\":{\"value\":%lu}}",
+                rec->ndata > 1 ? (unsigned long)rec->data[1] : 0ul);
+        break;
+
+      case ITM_TRACE_DROPPED:
+        dec->dropped += arg;
+        event_begin(dec, "dropped", "i", ROW_TASKS, 0);
+        fprintf(dec->out, ",\"s\":\"g\",\"args\":{\"records\":%lu}}", arg);
+        break;
+
+      case ITM_TRACE_PREEMPT:
+      case ITM_TRACE_CSECTION:
+        if (rec->ndata > 1)
+          {
+            event(dec, type == ITM_TRACE_PREEMPT ? "locked" : "csection",
+                  rec->data[1] ? "B" : "E",
+                  type == ITM_TRACE_PREEMPT ? ROW_PREEMPT : ROW_CSECTION,
+                  (int)arg);
+          }
+        break;
+
+      default:
+        fprintf(stderr, "Unknown record type %u\n", type);
+        break;
+    }
+}
+
+/* Handle one software source (instrumentation) packet */
+
+static void swit(struct decoder_s *dec, int port, uint32_t value, int size)
+{
+  struct record_s *rec = &dec->rec;
+
+  if (port == dec->hdrport && size == 4)
+    {
+      /* A new header completes the previous record */
+
+      record_emit(dec);
+      rec->valid  = true;
+      rec->header = value;
+      rec->ndata  = 0;
+    }
+  else if (port == dec->hdrport + 1 && size == 4)
+    {
+      if (!rec->valid)
+        {
+          dec->orphans++;
+        }
+      else if (rec->ndata < MAX_DATA)
+        {
+          rec->data[rec->ndata++] = value;
+        }
+    }
+}
+
+/* Parse the ITM packet stream */
+
+static void decode(struct decoder_s *dec, FILE *in)
+{
+  uint32_t value;
+  int port;
+  int size;
+  int ch;
+  int i;
+
+  while ((ch = getc(in)) != EOF)
+    {
+      if ((ch & 0x03) != 0)
+        {
+          /* Source packet: 1, 2 or 4 payload bytes */
+
+          size  = (ch & 0x03) == 3 ? 4 : (ch & 0x03);
+          port  = ch >> 3;
+          value = 0;
+
+          for (i = 0; i < size; i++)
+            {
+              int byte = getc(in);
+              if (byte == EOF)
+                {
+                  return;
+                }
+
+              value |= (uint32_t)byte << (8 * i);
+            }
+
+          /* Bit 2 distinguishes hardware (DWT) packets */
+
+          if ((ch & 0x04) == 0)
+            {
+              swit(dec, port, value, size);
+            }
+        }
+      else if (ch == 0x70)
+        {
+          dec->overflows++;
+        }
+      else if (ch != 0x00 && (ch & 0x80) != 0)
+        {
+          /* Time stamp or extension packet with continuation bytes.  This
+           * also skips the 0x80 that ends a synchronization packet.
+           */
+
+          if (ch == 0x80)
+            {
+              continue;
+            }
+
+          do
+            {
+              ch = getc(in);
+            }
+          while (ch != EOF && (ch & 0x80) != 0);
+        }
+
+      /* Otherwise synchronization zeroes or a one-byte time stamp */
+    }
+}
+
+/****************************************************************************
+ * Public Functions
+ ****************************************************************************/
+
+int main(int argc, char **argv)
+{
+  struct decoder_s dec;
+  FILE *in = stdin;
+  int opt;
+
+  memset(&dec, 0, sizeof(dec));
+  dec.out     = stdout;
+  dec.hdrport = 8;
+  dec.first   = true;
+
+  while ((opt = getopt(argc, argv, "p:f:h")) != -1)
+    {
+      switch (opt)
+        {
+          case 'p':
+            dec.hdrport = atoi(optarg);
+            if (dec.hdrport < 0 || dec.hdrport > 30)
+              {
+                fprintf(stderr, "Port must be 0-30\n");
+                show_usage(argv[0]);
+              }
+            break;
+
+          case 'f':
+            dec.hz = atof(optarg);
+            break;
+
+          default:
+            show_usage(argv[0]);
+        }
+    }
+
+  if (optind < argc)
+    {
+      in = fopen(argv[optind], "rb");
+      if (in == NULL)
+        {
+          perror(argv[optind]);
+          return EXIT_FAILURE;
+        }
+
+      optind++;
+    }
+
+  if (optind < argc)
+    {
+      dec.out = fopen(argv[optind], "w");
+      if (dec.out == NULL)
+        {
+          perror(argv[optind]);
+          return EXIT_FAILURE;
+        }
+
+      optind++;
+    }
+
+  if (optind < argc)
+    {
+      show_usage(argv[0]);
+    }
+
+  fprintf(dec.out, "{\"traceEvents\":[");
+  metadata(&dec, "process_name", ROW_TASKS, 0, "Tasks");
+  metadata(&dec, "process_name", ROW_IRQS, 0, "Interrupts");
+  metadata(&dec, "process_name", ROW_PREEMPT, 0, "Pre-emption locked");
+  metadata(&dec, "process_name", ROW_CSECTION, 0, "Critical sections");
+
+  decode(&dec, in);
+  record_emit(&dec);
+
+  fprintf(dec.out, "\n]}\n");
+
+  fprintf(stderr, "%lu records, %lu dropped on target, %lu incomplete, "
+          "%lu stray words, %lu ITM overflows\n", dec.records, dec.dropped,
+          dec.torn, dec.orphans, dec.overflows);
+
+  if (in != stdin)
+    {
+      fclose(in);
+    }
+
+  if (dec.out != stdout)
+    {
+      fclose(dec.out);
+    }
+
+  return EXIT_SUCCESS;
+}
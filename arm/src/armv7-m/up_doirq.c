@@ -49,27 +49,190 @@
 
 #include "up_arch.h"
 #include "up_internal.h"
+#include "up_irqstat.h"
+#include "itm_trace.h"
+
+#ifdef CONFIG_ARMV7M_NESTED_IRQ
+#  include "nvic.h"
+#  include "exc_return.h"
+#endif
 
 /****************************************************************************
  * Pre-processor Definitions
  ****************************************************************************/
 
+#ifdef CONFIG_ARMV7M_NESTED_IRQ
+/* Exception numbers that are the same on all ARMv7-M parts */
+
+#  define ARMV7M_IRQ_PENDSV  14 /* Completes deferred interrupts */
+#  define ARMV7M_IRQ_SYSTICK 15
+#  define ARMV7M_IRQ_FIRST   16 /* First peripheral interrupt */
+
+#  define NDEFERRED_WORDS    ((NR_IRQS + 31) >> 5)
+#endif
+
 /****************************************************************************
  * Public Data
  ****************************************************************************/
 
+#ifdef CONFIG_ARMV7M_NESTED_IRQ
+/* Nesting statistics:  The number of times that each IRQ preempted another
+ * interrupt handler and the deepest nesting seen so far.
+ */
+
+uint32_t g_irqnested[NR_IRQS];
+uint8_t  g_irqmaxnesting;
+#endif
+
 /****************************************************************************
  * Private Data
  ****************************************************************************/
 
+#ifdef CONFIG_ARMV7M_NESTED_IRQ
+/* The number of interrupt handlers that are currently running */
+
+static uint8_t g_irqnesting;
+
+/* Interrupts that were taken at a point where they could not be handled.
+ * They are disabled (if they are peripheral interrupts) and completed from
+ * PendSV.
+ */
+
+static uint32_t g_irqdeferred[NDEFERRED_WORDS];
+#endif
+
 /****************************************************************************
  * Private Functions
  ****************************************************************************/
 
+/****************************************************************************
+ * Name: up_irqdefer
+ *
+ * Description:
+ *   Defer an interrupt that preempted another interrupt handler before it
+ *   had set CURRENT_REGS, or after it had cleared it.  There is no valid
+ *   task context to switch from at that point.  The interrupt is disabled
+ *   and PendSV is pended.  PendSV has the lowest priority, so it runs only
+ *   after the other handler has returned.
+ *
+ ****************************************************************************/
+
+#ifdef CONFIG_ARMV7M_NESTED_IRQ
+static void up_irqdefer(int irq)
+{
+  irqstate_t flags;
+  int n = irq - ARMV7M_IRQ_FIRST;
+
+  if (n >= 0)
+    {
+      putreg32(1 << (n & 0x1f), NVIC_IRQ_CLEAR(n));
+    }
+
+  flags = up_irq_save();
+  g_irqdeferred[irq >> 5] |= 1 << (irq & 0x1f);
+  up_irq_restore(flags);
+
+  putreg32(NVIC_INTCTRL_PENDSVSET, NVIC_INTCTRL);
+}
+
+/****************************************************************************
+ * Name: up_irqresume
+ *
+ * Description:
+ *   Called from PendSV with interrupts enabled.  Re-enable and re-pend each
+ *   deferred interrupt.  Each one is then taken as a properly nested
+ *   interrupt as soon as interrupts are restored.
+ *
+ ****************************************************************************/
+
+static void up_irqresume(void)
+{
+  irqstate_t flags;
+  uint32_t pending;
+  int word;
+  int irq;
+  int n;
+
+  for (word = 0; word < NDEFERRED_WORDS; word++)
+    {
+      /* up_irqdefer_cancel() must not run between reading the deferred
+       * bits and enabling the interrupts.
+       */
+
+      flags   = up_irq_save();
+      pending = g_irqdeferred[word];
+      g_irqdeferred[word] = 0;
+
+      for (irq = word << 5; pending != 0; irq++, pending >>= 1)
+        {
+          if ((pending & 1) == 0)
+            {
+              continue;
+            }
+
+          n = irq - ARMV7M_IRQ_FIRST;
+          if (n >= 0)
+            {
+              putreg32(1 << (n & 0x1f), NVIC_IRQ_PEND(n));
+              putreg32(1 << (n & 0x1f), NVIC_IRQ_ENABLE(n));
+            }
+          else if (irq == ARMV7M_IRQ_SYSTICK)
+            {
+              putreg32(NVIC_INTCTRL_PENDSTSET, NVIC_INTCTRL);
+            }
+        }
+
+      up_irq_restore(flags);
+    }
+}
+#endif
+
 /****************************************************************************
  * Public Functions
  ****************************************************************************/
 
+/****************************************************************************
+ * Name: up_nestedirq_initialize
+ *
+ * Description:
+ *   Give PendSV the lowest priority.  Called after up_irqinitialize().
+ *
+ ****************************************************************************/
+
+#ifdef CONFIG_ARMV7M_NESTED_IRQ
+void up_nestedirq_initialize(void)
+{
+  uint32_t regval;
+
+  regval  = getreg32(NVIC_SYSH12_15_PRIORITY);
+  regval &= ~NVIC_SYSH_PRIORITY_PR14_MASK;
+  regval |= (NVIC_SYSH_PRIORITY_MIN << NVIC_SYSH_PRIORITY_PR14_SHIFT);
+  putreg32(regval, NVIC_SYSH12_15_PRIORITY);
+}
+
+/****************************************************************************
+ * Name: up_irqdefer_cancel
+ *
+ * Description:
+ *   Forget that 'irq' was deferred.  Called from up_disable_irq() so that
+ *   PendSV does not enable again an interrupt that was disabled while it
+ *   was deferred.
+ *
+ ****************************************************************************/
+
+void up_irqdefer_cancel(int irq)
+{
+  irqstate_t flags;
+
+  if ((unsigned)irq < NR_IRQS)
+    {
+      flags = up_irq_save();
+      g_irqdeferred[irq >> 5] &= ~(1 << (irq & 0x1f));
+      up_irq_restore(flags);
+    }
+}
+#endif
+
 uint32_t *up_doirq(int irq, uint32_t *regs)
 {
   board_autoled_on(LED_INIRQ);
@@ -78,43 +241,110 @@ uint32_t *up_doirq(int irq, uint32_t *regs)
 #else
   uint32_t *savestate;
 
-  /* Nested interrupts are not supported in this implementation.  If you want
-   * to implement nested interrupts, you would have to (1) change the way that
-   * CURRENT_REGS is handled and (2) the design associated with
-   * CONFIG_ARCH_INTERRUPTSTACK.  The savestate variable will not work for
-   * that purpose as implemented here because only the outermost nested
-   * interrupt can result in a context switch (it can probably be deleted).
-   */
-
   /* Current regs non-zero indicates that we are processing an interrupt;
    * CURRENT_REGS is also used to manage interrupt level context switches.
    */
 
-  savestate    = (uint32_t *)CURRENT_REGS;
-  CURRENT_REGS = regs;
+  savestate = (uint32_t *)CURRENT_REGS;
+
+#ifdef CONFIG_ARMV7M_NESTED_IRQ
+  if (savestate == NULL &&
+      (regs[REG_EXC_RETURN] & EXC_RETURN_THREAD_MODE) == 0 &&
+      (irq >= ARMV7M_IRQ_FIRST || irq == ARMV7M_IRQ_SYSTICK))
+    {
+      /* We preempted another handler on its way in or out.  Only
+       * asynchronous interrupts can be deferred.  Faults and SVCall are
+       * synchronous and would just be taken again, so they are dispatched
+       * below.
+       */
+
+      up_irqdefer(irq);
+      board_autoled_off(LED_INIRQ);
+      return regs;
+    }
+#endif
+
+  itm_trace_irqenter(irq);
+  up_irqstat_enter(irq);
+
+#ifdef CONFIG_ARMV7M_NESTED_IRQ
+  /* CURRENT_REGS must keep pointing to the context of the interrupted task.
+   * Only the outermost interrupt saved that context and only it returns to
+   * a task.  A nested interrupt that causes a context switch saves the task
+   * state from there and the switch itself happens when the outermost
+   * interrupt returns.
+   */
+
+  if (savestate == NULL)
+#endif
+    {
+      CURRENT_REGS = regs;
+    }
+
+#ifdef CONFIG_ARMV7M_NESTED_IRQ
+  if (++g_irqnesting > 1)
+    {
+      g_irqnested[irq]++;
+    }
+
+  if (g_irqnesting > g_irqmaxnesting)
+    {
+      g_irqmaxnesting = g_irqnesting;
+    }
+#endif
 
   /* Acknowledge the interrupt */
 
   up_ack_irq(irq);
 
-  /* Deliver the IRQ */
+#ifdef CONFIG_ARMV7M_NESTED_IRQ
+  /* Unmask interrupts while the IRQ is handled.  The NVIC only lets
+   * interrupts of a strictly higher priority preempt this one.
+   */
 
-  irq_dispatch(irq, regs);
+  up_irq_enable();
 
-  /* If a context switch occurred while processing the interrupt then
-   * CURRENT_REGS may have change value.  If we return any value different
-   * from the input regs, then the lower level will know that a context
-   * switch occurred during interrupt processing.
-   */
+  if (irq == ARMV7M_IRQ_PENDSV)
+    {
+      up_irqresume();
+    }
+  else
+#endif
+    {
+      /* Deliver the IRQ */
 
-  regs = (uint32_t *)CURRENT_REGS;
+      irq_dispatch(irq, regs);
+    }
 
-  /* Restore the previous value of CURRENT_REGS.  NULL would indicate that
-   * we are no longer in an interrupt handler.  It will be non-NULL if we
-   * are returning from a nested interrupt.
-   */
+#ifdef CONFIG_ARMV7M_NESTED_IRQ
+  up_irq_disable();
+#endif
+
+  up_irqstat_leave(irq);
+  itm_trace_irqleave(irq);
+
+#ifdef CONFIG_ARMV7M_NESTED_IRQ
+  g_irqnesting--;
+
+  /* Return to the interrupted handler, there can be no context switch */
+
+  if (savestate == NULL)
+#endif
+    {
+      /* If a context switch occurred while processing the interrupt then
+       * CURRENT_REGS may have change value.  If we return any value
+       * different from the input regs, then the lower level will know that
+       * a context switch occurred during interrupt processing.
+       */
+
+      regs = (uint32_t *)CURRENT_REGS;
+
+      /* Restore the previous value of CURRENT_REGS.  NULL would indicate
+       * that we are no longer in an interrupt handler.
+       */
 
-  CURRENT_REGS = savestate;
+      CURRENT_REGS = savestate;
+    }
 #endif
   board_autoled_off(LED_INIRQ);
   return regs;
@@ -0,0 +1,378 @@
+/****************************************************************************
+ * arch/arm/src/armv7-m/up_itm_trace.c
+ *
+ *   Copyright (C) 2016 Gregory Nutt. All rights reserved.
+ *   Author: Gregory Nutt <gnutt@nuttx.org>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name NuttX nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************/
+
+/****************************************************************************
+ * Included Files
+ ****************************************************************************/
+
+#include <nuttx/config.h>
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include <nuttx/arch.h>
+#include <nuttx/sched.h>
+#include <nuttx/sched_note.h>
+#include <arch/irq.h>
+
+#include "nvic.h"
+#include "itm.h"
+#include "tpi.h"
+#include "dwt.h"
+#include "up_arch.h"
+#include "itm_trace.h"
+
+#ifdef CONFIG_ARMV7M_ITMTRACE
+
+/****************************************************************************
+ * Pre-processor Definitions
+ ****************************************************************************/
+
+#if CONFIG_ARMV7M_ITMTRACE_PORT > 30
+#  error CONFIG_ARMV7M_ITMTRACE_PORT must leave room for the data port
+#endif
+
+#if defined(CONFIG_ARMV7M_ITMSYSLOG) && \
+    (CONFIG_ARMV7M_ITMSYSLOG_PORT == ITM_TRACE_HDRPORT || \
+     CONFIG_ARMV7M_ITMSYSLOG_PORT == ITM_TRACE_DATAPORT)
+#  error The ITM SYSLOG port must not be one of the ITM trace ports
+#endif
+
+#ifndef CONFIG_ARMV7M_ITMTRACE_SWODIV
+#  define CONFIG_ARMV7M_ITMTRACE_SWODIV 15
+#endif
+
+#define ITM_TRACE_PORTS \
+  ((1ul << ITM_TRACE_HDRPORT) | (1ul << ITM_TRACE_DATAPORT))
+
+/* Stimulus port reads return 1 when the FIFO can accept another write */
+
+#define ITM_PORT_FIFOREADY 1
+
+#define ITM_TRACE_MAXDATA  4
+
+/****************************************************************************
+ * Public Data
+ ****************************************************************************/
+
+uint32_t g_itm_trace_dropped;
+
+/****************************************************************************
+ * Private Data
+ ****************************************************************************/
+
+/* Dropped records that have not yet been reported in the trace itself */
+
+static uint32_t g_itm_trace_unreported;
+
+/****************************************************************************
+ * Private Functions
+ ****************************************************************************/
+
+/****************************************************************************
+ * Name: itm_trace_put
+ *
+ * Description:
+ *   Write one word to a stimulus port unless its FIFO is full
+ *
+ ****************************************************************************/
+
+static inline bool itm_trace_put(int port, uint32_t word)
+{
+  if ((getreg32(ITM_PORT(port)) & ITM_PORT_FIFOREADY) == 0)
+    {
+      return false;
+    }
+
+  putreg32(word, ITM_PORT(port));
+  return true;
+}
+
+/****************************************************************************
+ * Name: itm_trace_send
+ *
+ * Description:
+ *   Send one record:  The header word, the timestamp and 'ndata' data
+ *   words.  Nothing ever waits for the FIFO.  A record that does not fit is
+ *   dropped, or cut short, and counted.  A DROPPED record is sent ahead of
+ *   the next record that fits.
+ *
+ ****************************************************************************/
+
+static void itm_trace_send(uint32_t header, FAR const uint32_t *data,
+                           int ndata)
+{
+  irqstate_t flags;
+  uint32_t cycles;
+  int i;
+
+  /* Do nothing while the ITM or the trace ports are disabled (such as
+   * before initialization).
+   */
+
+  if ((getreg32(ITM_TCR) & ITM_TCR_ITMENA_Msk) == 0 ||
+      (getreg32(ITM_TER) & ITM_TRACE_PORTS) != ITM_TRACE_PORTS)
+    {
+      return;
+    }
+
+  /* Records must not be interleaved */
+
+  flags  = up_irq_save();
+  cycles = getreg32(DWT_CYCCNT);
+
+  if (g_itm_trace_unreported > 0)
+    {
+      uint32_t count = g_itm_trace_unreported;
+
+      if (count > ITM_TRACE_ARG_MASK)
+        {
+          count = ITM_TRACE_ARG_MASK;
+        }
+
+      if (!itm_trace_put(ITM_TRACE_HDRPORT,
+                         ITM_TRACE_HEADER(ITM_TRACE_DROPPED, count)))
+        {
+          goto dropped;
+        }
+
+      g_itm_trace_unreported = 0;
+      if (!itm_trace_put(ITM_TRACE_DATAPORT, cycles))
+        {
+          goto dropped;
+        }
+    }
+
+  if (!itm_trace_put(ITM_TRACE_HDRPORT, header) ||
+      !itm_trace_put(ITM_TRACE_DATAPORT, cycles))
+    {
+      goto dropped;
+    }
+
+  for (i = 0; i < ndata; i++)
+    {
+      if (!itm_trace_put(ITM_TRACE_DATAPORT, data[i]))
+        {
+          goto dropped;
+        }
+    }
+
+  up_irq_restore(flags);
+  return;
+
+dropped:
+  g_itm_trace_dropped++;
+  g_itm_trace_unreported++;
+  up_irq_restore(flags);
+}
+
+/****************************************************************************
+ * Name: itm_trace_task
+ *
+ * Description:
+ *   Send a scheduler record for 'tcb'
+ *
+ ****************************************************************************/
+
+#ifdef CONFIG_ARMV7M_ITMTRACE_SCHED
+static inline void itm_trace_task(int type, FAR struct tcb_s *tcb)
+{
+  itm_trace_send(ITM_TRACE_HEADER(type, tcb->pid), NULL, 0);
+}
+#endif
+
+/****************************************************************************
+ * Public Functions
+ ****************************************************************************/
+
+/****************************************************************************
+ * Name: itm_trace_initialize
+ *
+ * Description:
+ *   Enable the ITM trace ports and the DWT cycle counter.  Unless ITM
+ *   SYSLOG support has already done so, also configure the ITM and the SWO
+ *   output.  As for itm_syslog_initialize(), MCU-specific logic must first
+ *   enable the serial wire output pin and debug clocking.
+ *
+ ****************************************************************************/
+
+void itm_trace_initialize(void)
+{
+  uint32_t regval;
+
+  /* Enable trace in core debug */
+
+  regval  = getreg32(NVIC_DEMCR);
+  regval |= NVIC_DEMCR_TRCENA;
+  putreg32(regval, NVIC_DEMCR);
+
+#ifndef CONFIG_ARMV7M_ITMSYSLOG
+  /* Same set up as itm_syslog_initialize() */
+
+  putreg32(0xc5acce55, ITM_LAR);
+  putreg32(0,          ITM_TER);
+  putreg32(0,          ITM_TCR);
+  putreg32(2,          TPI_SPPR); /* Pin protocol: 2=> Manchester (USART) */
+
+  regval = CONFIG_ARMV7M_ITMTRACE_SWODIV - 1;
+  putreg32(regval,     TPI_ACPR); /* TRACECLKIN/(ACPR+1) SWO speed */
+
+  putreg32(0,          ITM_TPR);
+  putreg32(0x400003fe, DWT_CTRL);
+  putreg32(0x0001000d, ITM_TCR);
+  putreg32(0x00000100, TPI_FFCR);
+#endif
+
+  /* Start the cycle counter used for the timestamps.  This must come after
+   * the DWT_CTRL set up above, or in itm_syslog_initialize().
+   */
+
+  modifyreg32(DWT_CTRL, 0, DWT_CTRL_CYCCNTENA_Msk);
+
+  /* Enable the two trace ports */
+
+  modifyreg32(ITM_TER, 0, ITM_TRACE_PORTS);
+}
+
+/****************************************************************************
+ * Name: itm_trace_mark
+ *
+ * Description:
+ *   Send a user marker record with an ID and a value.  May be called from
+ *   any context.
+ *
+ ****************************************************************************/
+
+void itm_trace_mark(uint32_t id, uint32_t value)
+{
+  itm_trace_send(ITM_TRACE_HEADER(ITM_TRACE_MARK, id), &value, 1);
+}
+
+/****************************************************************************
+ * Name: itm_trace_irqenter and itm_trace_irqleave
+ *
+ * Description:
+ *   Trace the entry to and the exit from the handler of 'irq'.
+ *
+ ****************************************************************************/
+
+#ifdef CONFIG_ARMV7M_ITMTRACE_IRQ
+void itm_trace_irqenter(int irq)
+{
+  itm_trace_send(ITM_TRACE_HEADER(ITM_TRACE_IRQENTER, irq), NULL, 0);
+}
+
+void itm_trace_irqleave(int irq)
+{
+  itm_trace_send(ITM_TRACE_HEADER(ITM_TRACE_IRQLEAVE, irq), NULL, 0);
+}
+#endif
+
+/****************************************************************************
+ * Name: sched_note_start, sched_note_stop, sched_note_suspend,
+ *       sched_note_resume, sched_note_premption, sched_note_csection
+ *
+ * Description:
+ *   Hooks to scheduler monitor.  Each note is sent as a trace record.  A
+ *   context switch is a SUSPEND record followed by a RESUME record.
+ *
+ * Input Parameters:
+ *   Varies
+ *
+ * Returned Value:
+ *   None
+ *
+ ****************************************************************************/
+
+#ifdef CONFIG_ARMV7M_ITMTRACE_SCHED
+void sched_note_start(FAR struct tcb_s *tcb)
+{
+#if CONFIG_TASK_NAME_SIZE > 0
+  uint32_t name[ITM_TRACE_MAXDATA];
+  int len;
+
+  /* Send up to 16 bytes of the task name, NUL padded */
+
+  memset(name, 0, sizeof(name));
+  len = strlen(tcb->name);
+  if (len > (int)sizeof(name))
+    {
+      len = sizeof(name);
+    }
+
+  memcpy(name, tcb->name, len);
+  itm_trace_send(ITM_TRACE_HEADER(ITM_TRACE_START, tcb->pid), name,
+                 (len + 3) >> 2);
+#else
+  itm_trace_task(ITM_TRACE_START, tcb);
+#endif
+}
+
+void sched_note_stop(FAR struct tcb_s *tcb)
+{
+  itm_trace_task(ITM_TRACE_STOP, tcb);
+}
+
+void sched_note_suspend(FAR struct tcb_s *tcb)
+{
+  itm_trace_task(ITM_TRACE_SUSPEND, tcb);
+}
+
+void sched_note_resume(FAR struct tcb_s *tcb)
+{
+  itm_trace_task(ITM_TRACE_RESUME, tcb);
+}
+
+#ifdef CONFIG_SCHED_INSTRUMENTATION_PREEMPTION
+void sched_note_premption(FAR struct tcb_s *tcb, bool locked)
+{
+  uint32_t value = locked;
+
+  itm_trace_send(ITM_TRACE_HEADER(ITM_TRACE_PREEMPT, tcb->pid), &value, 1);
+}
+#endif
+
+#ifdef CONFIG_SCHED_INSTRUMENTATION_CSECTION
+void sched_note_csection(FAR struct tcb_s *tcb, bool enter)
+{
+  uint32_t value = enter;
+
+  itm_trace_send(ITM_TRACE_HEADER(ITM_TRACE_CSECTION, tcb->pid), &value, 1);
+}
+#endif
+#endif /* CONFIG_ARMV7M_ITMTRACE_SCHED */
+
+#endif /* CONFIG_ARMV7M_ITMTRACE */
@@ -0,0 +1,147 @@
+/****************************************************************************
+ * arch/arm/src/armv7-m/up_zerolatency.c
+ *
+ *   Copyright (C) 2016 Gregory Nutt. All rights reserved.
+ *   Author: Gregory Nutt <gnutt@nuttx.org>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name NuttX nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************/
+
+/****************************************************************************
+ * Included Files
+ ****************************************************************************/
+
+#include <nuttx/config.h>
+
+#include <errno.h>
+#include <debug.h>
+
+#include <nuttx/irq.h>
+#include <nuttx/arch.h>
+
+#include "chip.h"
+#include "ram_vectors.h"
+
+#ifdef CONFIG_ARMV7M_ZEROLATENCY_IRQ
+
+/****************************************************************************
+ * Pre-processor Definitions
+ ****************************************************************************/
+
+/* Only peripheral interrupts may be zero-latency interrupts.  The Cortex-M
+ * exceptions below this number are owned by the OS.
+ */
+
+#define ARMV7M_IRQ_FIRST 16
+
+/* Debug ********************************************************************/
+/* Non-standard debug that may be enabled just for testing the interrupt
+ * config.  NOTE: that only lldbg types are used so that the output is
+ * immediately available.
+ */
+
+#ifdef CONFIG_DEBUG_IRQ
+#  define intdbg    lldbg
+#  define intvdbg   llvdbg
+#else
+#  define intdbg(x...)
+#  define intvdbg(x...)
+#endif
+
+/****************************************************************************
+ * Public Functions
+ ****************************************************************************/
+
+/****************************************************************************
+ * Name: up_zerolatency_attach
+ *
+ * Description:
+ *   Attach 'vector' directly to the RAM vector table entry of IRQ number
+ *   'irq', raise the interrupt to NVIC_SYSH_HIGH_PRIORITY, and enable it.
+ *   The interrupt then bypasses exception_common(), up_doirq() and
+ *   irq_dispatch() altogether and, since it has a higher priority than
+ *   NVIC_SYSH_DISABLE_PRIORITY, it is never masked by critical sections.
+ *
+ *   'vector' may be an ordinary C function:  The hardware stacks all of
+ *   the registers that the ARM procedure call standard does not preserve.
+ *   It must not call any OS service, must not use any data that is
+ *   protected only by critical sections, and must clear the interrupt
+ *   source before returning.  It may pend PendSV or a normal interrupt in
+ *   order to hand work back to the OS.
+ *
+ *   If 'vector' is NULL, the interrupt is disabled, returned to the common
+ *   exception handler, and given the default priority again.
+ *
+ ****************************************************************************/
+
+int up_zerolatency_attach(int irq, up_vector_t vector)
+{
+  int ret;
+
+  if (irq < ARMV7M_IRQ_FIRST || irq >= NR_VECTORS)
+    {
+      intdbg("ERROR: IRQ%d cannot be a zero-latency interrupt\n", irq);
+      return -EINVAL;
+    }
+
+  if (vector == NULL)
+    {
+      ret = up_ramvec_attach(irq, NULL);
+      if (ret == OK)
+        {
+          ret = up_prioritize_irq(irq, NVIC_SYSH_PRIORITY_DEFAULT);
+        }
+
+      return ret;
+    }
+
+  /* Make sure that the interrupt cannot be taken while the vector and the
+   * priority do not agree.
+   */
+
+  up_disable_irq(irq);
+
+  ret = up_ramvec_attach(irq, vector);
+  if (ret == OK)
+    {
+      ret = up_prioritize_irq(irq, NVIC_SYSH_HIGH_PRIORITY);
+      if (ret == OK)
+        {
+          up_enable_irq(irq);
+        }
+      else
+        {
+          (void)up_ramvec_attach(irq, NULL);
+        }
+    }
+
+  return ret;
+}
+
+#endif /* CONFIG_ARMV7M_ZEROLATENCY_IRQ */
@@ -57,6 +57,11 @@
 
 #include "up_arch.h"
 #include "up_internal.h"
+#include "up_irqstat.h"
+
+#ifdef CONFIG_ARMV7M_DCACHE_BENCHMARK
+#  include "cache.h"
+#endif
 
 /****************************************************************************
  * Private Functions
@@ -158,6 +163,16 @@ void up_initialize(void)
 
   up_irqinitialize();
 
+#ifdef CONFIG_ARMV7M_NESTED_IRQ
+  /* PendSV completes deferred nested interrupts at the lowest priority */
+
+  up_nestedirq_initialize();
+#endif
+
+  /* Start timing interrupt handlers */
+
+  up_irqstat_initialize();
+
   /* Initialize the power management subsystem.  This MCU-specific function
    * must be called *very* early in the initialization sequence *before* any
    * other device drivers are initialized (since they may attempt to register
@@ -286,5 +301,12 @@ void up_initialize(void)
   /* Initialize the L2 cache if present and selected */
 
   up_l2ccinitialize();
+
+#ifdef CONFIG_ARMV7M_DCACHE_BENCHMARK
+  /* Report the cost of D-Cache maintenance */
+
+  arch_dcache_benchmark();
+#endif
+
   board_autoled_on(LED_IRQSENABLED);
 }
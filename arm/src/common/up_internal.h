@@ -262,6 +262,13 @@ EXTERN uint32_t g_intstackalloc; /* Allocated stack base */
 EXTERN uint32_t g_intstackbase;  /* Initial top of interrupt stack */
 #endif
 
+#ifdef CONFIG_ARMV7M_NESTED_IRQ
+/* Nested interrupt statistics (see up_doirq.c) */
+
+EXTERN uint32_t g_irqnested[];     /* Times each IRQ preempted a handler */
+EXTERN uint8_t  g_irqmaxnesting;   /* Deepest interrupt nesting seen */
+#endif
+
 /* These 'addresses' of these values are setup by the linker script.  They are
  * not actual uint32_t storage locations! They are only used meaningfully in the
  * following way:
@@ -375,6 +382,11 @@ void up_irqinitialize(void);
 void up_ack_irq(int irq);
 uint32_t *up_doirq(int irq, uint32_t *regs);
 
+#  ifdef CONFIG_ARMV7M_NESTED_IRQ
+void up_nestedirq_initialize(void);
+void up_irqdefer_cancel(int irq);
+#  endif
+
 /* Exception Handlers */
 
 int  up_svcall(int irq, FAR void *context);
@@ -0,0 +1,298 @@
+/****************************************************************************
+ * arch/arm/src/common/up_irqstat.c
+ *
+ *   Copyright (C) 2016 Gregory Nutt. All rights reserved.
+ *   Author: Gregory Nutt <gnutt@nuttx.org>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name NuttX nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************/
+
+/****************************************************************************
+ * Included Files
+ ****************************************************************************/
+
+#include <nuttx/config.h>
+
+#include <stdint.h>
+#include <debug.h>
+
+#include <nuttx/arch.h>
+#include <arch/irq.h>
+
+#include "up_arch.h"
+#include "up_irqstat.h"
+
+#if defined(CONFIG_ARCH_CORTEXM3) || defined(CONFIG_ARCH_CORTEXM4) || \
+    defined(CONFIG_ARCH_CORTEXM7)
+#  include "nvic.h"
+#  include "dwt.h"
+#endif
+
+#ifdef CONFIG_ARM_IRQSTAT
+
+/****************************************************************************
+ * Pre-processor Definitions
+ ****************************************************************************/
+
+#if defined(CONFIG_ARCH_CORTEXM3) || defined(CONFIG_ARCH_CORTEXM4) || \
+    defined(CONFIG_ARCH_CORTEXM7)
+#  define IRQSTAT_DWT 1
+#elif defined(CONFIG_ARCH_CORTEXA5) || defined(CONFIG_ARCH_CORTEXA8) || \
+      defined(CONFIG_ARCH_CORTEXA9)
+#  define IRQSTAT_PMU 1
+
+/* PMCR and PMCNTENSET bits used to run the PMU cycle counter */
+
+#  define PMCR_E     (1 << 0)  /* Bit 0:  Enable all counters */
+#  define PMCR_C     (1 << 2)  /* Bit 2:  Reset the cycle counter */
+#  define PMCR_D     (1 << 3)  /* Bit 3:  Count every 64th cycle */
+#  define PMCNTEN_C  (1 << 31) /* Bit 31: Enable the cycle counter */
+#else
+#  error No cycle counter for CONFIG_ARM_IRQSTAT
+#endif
+
+#if CONFIG_ARM_IRQSTAT_NSLOTS > 255
+#  error CONFIG_ARM_IRQSTAT_NSLOTS must not be larger than 255
+#endif
+
+/****************************************************************************
+ * Public Data
+ ****************************************************************************/
+
+struct irqstat_s g_irqstat[CONFIG_ARM_IRQSTAT_NSLOTS];
+uint8_t g_irqstat_nslots;
+uint32_t g_irqstat_untracked;
+
+/****************************************************************************
+ * Private Data
+ ****************************************************************************/
+
+/* Maps each IRQ number to its slot in g_irqstat[] plus one.  Zero means
+ * that the IRQ has not occurred yet (or that there was no free slot).
+ */
+
+static uint8_t g_irqstat_map[NR_IRQS];
+
+/****************************************************************************
+ * Private Functions
+ ****************************************************************************/
+
+/****************************************************************************
+ * Name: irqstat_cycles
+ *
+ * Description:
+ *   Return the free running CPU cycle counter
+ *
+ ****************************************************************************/
+
+static inline uint32_t irqstat_cycles(void)
+{
+#ifdef IRQSTAT_DWT
+  return getreg32(DWT_CYCCNT);
+#else
+  uint32_t cycles;
+
+  __asm__ __volatile__ ("mrc p15, 0, %0, c9, c13, 0" : "=r"(cycles));
+  return cycles;
+#endif
+}
+
+/****************************************************************************
+ * Name: irqstat_bucket
+ *
+ * Description:
+ *   Return the log2 histogram bucket for an interval of 'cycles'
+ *
+ ****************************************************************************/
+
+static inline unsigned int irqstat_bucket(uint32_t cycles)
+{
+  uint32_t lz;
+
+  __asm__ __volatile__ ("clz %0, %1" : "=r"(lz) : "r"(cycles));
+
+  /* CLZ of zero is 32, which also lands in bucket 0 */
+
+  lz = lz < 32 ? 31 - lz : 0;
+  return lz < IRQSTAT_NBUCKETS ? lz : IRQSTAT_NBUCKETS - 1;
+}
+
+/****************************************************************************
+ * Name: irqstat_slot
+ *
+ * Description:
+ *   Return the statistics of 'irq', allocating a slot for it the first
+ *   time that it occurs.  Returns NULL if there is no free slot.
+ *
+ ****************************************************************************/
+
+static FAR struct irqstat_s *irqstat_slot(int irq)
+{
+  FAR struct irqstat_s *stat;
+  unsigned int slot;
+
+  slot = g_irqstat_map[irq];
+  if (slot != 0)
+    {
+      return &g_irqstat[slot - 1];
+    }
+
+  if (g_irqstat_nslots >= CONFIG_ARM_IRQSTAT_NSLOTS)
+    {
+      return NULL;
+    }
+
+  stat         = &g_irqstat[g_irqstat_nslots++];
+  stat->irq    = irq;
+  stat->durmin = UINT32_MAX;
+  stat->arrmin = UINT32_MAX;
+
+  g_irqstat_map[irq] = g_irqstat_nslots;
+  return stat;
+}
+
+/****************************************************************************
+ * Public Functions
+ ****************************************************************************/
+
+/****************************************************************************
+ * Name: up_irqstat_initialize
+ *
+ * Description:
+ *   Start the cycle counter and register /proc/irqstat if so configured.
+ *
+ ****************************************************************************/
+
+void up_irqstat_initialize(void)
+{
+#ifdef IRQSTAT_DWT
+  /* Enable the DWT cycle counter */
+
+  modifyreg32(NVIC_DEMCR, 0, NVIC_DEMCR_TRCENA);
+  modifyreg32(DWT_CTRL, 0, DWT_CTRL_CYCCNTENA_Msk);
+#else
+  uint32_t regval;
+
+  /* Enable the PMU cycle counter, counting every cycle */
+
+  __asm__ __volatile__ ("mrc p15, 0, %0, c9, c12, 0" : "=r"(regval));
+  regval &= ~PMCR_D;
+  regval |= PMCR_E | PMCR_C;
+  __asm__ __volatile__ ("mcr p15, 0, %0, c9, c12, 0" : : "r"(regval));
+
+  regval = PMCNTEN_C;
+  __asm__ __volatile__ ("mcr p15, 0, %0, c9, c12, 1" : : "r"(regval));
+#endif
+
+#ifdef CONFIG_ARM_IRQSTAT_PROCFS
+  (void)irqstat_procfs_register();
+#endif
+}
+
+/****************************************************************************
+ * Name: up_irqstat_enter
+ *
+ * Description:
+ *   Time stamp the entry to the handling of 'irq' and account for the time
+ *   since its previous entry.
+ *
+ ****************************************************************************/
+
+void up_irqstat_enter(int irq)
+{
+  FAR struct irqstat_s *stat;
+  uint32_t now = irqstat_cycles();
+  uint32_t elapsed;
+
+  stat = irqstat_slot(irq);
+  if (stat == NULL)
+    {
+      g_irqstat_untracked++;
+      return;
+    }
+
+  if (stat->count > 0)
+    {
+      elapsed = now - stat->entry;
+      if (elapsed < stat->arrmin)
+        {
+          stat->arrmin = elapsed;
+        }
+
+      if (elapsed > stat->arrmax)
+        {
+          stat->arrmax = elapsed;
+        }
+
+      stat->arrival[irqstat_bucket(elapsed)]++;
+    }
+
+  stat->entry = now;
+  stat->count++;
+}
+
+/****************************************************************************
+ * Name: up_irqstat_leave
+ *
+ * Description:
+ *   Account for the time spent handling 'irq'.
+ *
+ ****************************************************************************/
+
+void up_irqstat_leave(int irq)
+{
+  FAR struct irqstat_s *stat;
+  uint32_t elapsed;
+  unsigned int slot;
+
+  elapsed = irqstat_cycles();
+
+  slot = g_irqstat_map[irq];
+  if (slot == 0)
+    {
+      return;
+    }
+
+  stat    = &g_irqstat[slot - 1];
+  elapsed = elapsed - stat->entry;
+
+  if (elapsed < stat->durmin)
+    {
+      stat->durmin = elapsed;
+    }
+
+  if (elapsed > stat->durmax)
+    {
+      stat->durmax = elapsed;
+    }
+
+  stat->duration[irqstat_bucket(elapsed)]++;
+}
+
+#endif /* CONFIG_ARM_IRQSTAT */
@@ -0,0 +1,142 @@
+/****************************************************************************
+ * arch/arm/src/common/up_irqstat.h
+ *
+ *   Copyright (C) 2016 Gregory Nutt. All rights reserved.
+ *   Author: Gregory Nutt <gnutt@nuttx.org>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name NuttX nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************/
+
+#ifndef __ARCH_ARM_SRC_COMMON_UP_IRQSTAT_H
+#define __ARCH_ARM_SRC_COMMON_UP_IRQSTAT_H
+
+/****************************************************************************
+ * Included Files
+ ****************************************************************************/
+
+#include <nuttx/config.h>
+
+#ifndef __ASSEMBLY__
+#  include <stdint.h>
+#endif
+
+#ifdef CONFIG_ARM_IRQSTAT
+
+/****************************************************************************
+ * Pre-processor Definitions
+ ****************************************************************************/
+
+/* Histogram bucket n counts the intervals of 2^n up to 2^(n+1)-1 cycles.
+ * The last bucket also counts everything longer.  Bucket 0 also counts
+ * intervals of zero cycles.
+ */
+
+#define IRQSTAT_NBUCKETS CONFIG_ARM_IRQSTAT_NBUCKETS
+
+/****************************************************************************
+ * Public Types
+ ****************************************************************************/
+
+#ifndef __ASSEMBLY__
+
+/* Timing statistics for one IRQ.  All times are in CPU cycles. */
+
+struct irqstat_s
+{
+  uint32_t count;       /* Number of times that the IRQ was handled */
+  uint32_t entry;       /* Cycle counter at the most recent entry */
+  uint32_t durmin;      /* Shortest handler duration */
+  uint32_t durmax;      /* Longest handler duration */
+  uint32_t arrmin;      /* Shortest time between two entries */
+  uint32_t arrmax;      /* Longest time between two entries */
+  uint32_t duration[IRQSTAT_NBUCKETS]; /* Handler duration histogram */
+  uint32_t arrival[IRQSTAT_NBUCKETS];  /* Inter-arrival time histogram */
+  int16_t  irq;         /* The IRQ using this slot */
+};
+
+/****************************************************************************
+ * Public Data
+ ****************************************************************************/
+
+/* Statistics are kept for the first CONFIG_ARM_IRQSTAT_NSLOTS IRQs that
+ * occur.  Entries of later IRQs are only counted in g_irqstat_untracked.
+ */
+
+extern struct irqstat_s g_irqstat[CONFIG_ARM_IRQSTAT_NSLOTS];
+extern uint8_t g_irqstat_nslots;
+extern uint32_t g_irqstat_untracked;
+
+/****************************************************************************
+ * Public Function Prototypes
+ ****************************************************************************/
+
+/****************************************************************************
+ * Name: up_irqstat_initialize
+ *
+ * Description:
+ *   Start the cycle counter and register /proc/irqstat if so configured.
+ *
+ ****************************************************************************/
+
+void up_irqstat_initialize(void);
+
+/****************************************************************************
+ * Name: up_irqstat_enter and up_irqstat_leave
+ *
+ * Description:
+ *   Time stamp the entry to and the exit from the handling of 'irq'.
+ *   Called with interrupts disabled.
+ *
+ ****************************************************************************/
+
+void up_irqstat_enter(int irq);
+void up_irqstat_leave(int irq);
+
+/****************************************************************************
+ * Name: irqstat_procfs_register
+ *
+ * Description:
+ *   Register the /proc/irqstat procfs file system entry
+ *
+ ****************************************************************************/
+
+#ifdef CONFIG_ARM_IRQSTAT_PROCFS
+int irqstat_procfs_register(void);
+#endif
+
+#endif /* __ASSEMBLY__ */
+
+#else /* CONFIG_ARM_IRQSTAT */
+
+#  define up_irqstat_initialize()
+#  define up_irqstat_enter(irq)
+#  define up_irqstat_leave(irq)
+
+#endif /* CONFIG_ARM_IRQSTAT */
+#endif /* __ARCH_ARM_SRC_COMMON_UP_IRQSTAT_H */
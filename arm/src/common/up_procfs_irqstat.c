@@ -0,0 +1,439 @@
+/****************************************************************************
+ * arch/arm/src/common/up_procfs_irqstat.c
+ *
+ *   Copyright (C) 2016 Gregory Nutt. All rights reserved.
+ *   Author: Gregory Nutt <gnutt@nuttx.org>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name NuttX nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************/
+
+/****************************************************************************
+ * Included Files
+ ****************************************************************************/
+
+#include <nuttx/config.h>
+
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <assert.h>
+#include <errno.h>
+#include <debug.h>
+
+#include <nuttx/arch.h>
+#include <nuttx/kmalloc.h>
+#include <nuttx/fs/fs.h>
+#include <nuttx/fs/procfs.h>
+
+#include <arch/irq.h>
+
+#include "up_irqstat.h"
+
+#if !defined(CONFIG_DISABLE_MOUNTPOINT) && defined(CONFIG_FS_PROCFS) && \
+     defined(CONFIG_FS_PROCFS_REGISTER) && defined(CONFIG_ARM_IRQSTAT_PROCFS)
+
+/****************************************************************************
+ * Pre-processor Definitions
+ ****************************************************************************/
+
+#define IRQSTAT_LINELEN  80
+
+/****************************************************************************
+ * Private Types
+ ****************************************************************************/
+
+/* This structure describes one open "file" */
+
+struct irqstat_file_s
+{
+  struct procfs_file_s  base;    /* Base open file structure */
+  unsigned int linesize;         /* Number of valid characters in line[] */
+  char line[IRQSTAT_LINELEN];    /* Pre-allocated buffer for formatted lines */
+  struct irqstat_s stat;         /* Consistent copy of one IRQ's statistics */
+};
+
+/* The state of one read() */
+
+struct irqstat_read_s
+{
+  FAR struct irqstat_file_s *priv;
+  FAR char *buffer;              /* Where the next line goes */
+  size_t remaining;              /* Space left in the user buffer */
+  size_t totalsize;              /* Bytes returned so far */
+  off_t offset;                  /* Bytes of the file still to be skipped */
+};
+
+/****************************************************************************
+ * Private Function Prototypes
+ ****************************************************************************/
+/* File system methods */
+
+static int     irqstat_open(FAR struct file *filep, FAR const char *relpath,
+                            int oflags, mode_t mode);
+static int     irqstat_close(FAR struct file *filep);
+static ssize_t irqstat_read(FAR struct file *filep, FAR char *buffer,
+                            size_t buflen);
+static int     irqstat_dup(FAR const struct file *oldp,
+                           FAR struct file *newp);
+static int     irqstat_stat(FAR const char *relpath, FAR struct stat *buf);
+
+/****************************************************************************
+ * Private Data
+ ****************************************************************************/
+
+/* See include/nutts/fs/procfs.h
+ * We use the old-fashioned kind of initializers so that this will compile
+ * with any compiler.
+ */
+
+static const struct procfs_operations irqstat_procfsoperations =
+{
+  irqstat_open,       /* open */
+  irqstat_close,      /* close */
+  irqstat_read,       /* read */
+  NULL,               /* write */
+  irqstat_dup,        /* dup */
+  NULL,               /* opendir */
+  NULL,               /* closedir */
+  NULL,               /* readdir */
+  NULL,               /* rewinddir */
+  irqstat_stat        /* stat */
+};
+
+static const struct procfs_entry_s g_procfs_irqstat =
+{
+  "irqstat",
+  &irqstat_procfsoperations
+};
+
+/****************************************************************************
+ * Private Functions
+ ****************************************************************************/
+
+/****************************************************************************
+ * Name: irqstat_open
+ ****************************************************************************/
+
+static int irqstat_open(FAR struct file *filep, FAR const char *relpath,
+                        int oflags, mode_t mode)
+{
+  FAR struct irqstat_file_s *priv;
+
+  fvdbg("Open '%s'\n", relpath);
+
+  /* PROCFS is read-only.  Any attempt to open with any kind of write
+   * access is not permitted.
+   */
+
+  if ((oflags & O_WRONLY) != 0 || (oflags & O_RDONLY) == 0)
+    {
+      fdbg("ERROR: Only O_RDONLY supported\n");
+      return -EACCES;
+    }
+
+  /* "irqstat" is the only acceptable value for the relpath */
+
+  if (strcmp(relpath, "irqstat") != 0)
+    {
+      fdbg("ERROR: relpath is '%s'\n", relpath);
+      return -ENOENT;
+    }
+
+  /* Allocate a container to hold the file attributes */
+
+  priv = (FAR struct irqstat_file_s *)
+    kmm_zalloc(sizeof(struct irqstat_file_s));
+
+  if (!priv)
+    {
+      fdbg("ERROR: Failed to allocate file attributes\n");
+      return -ENOMEM;
+    }
+
+  /* Save the index as the open-specific state in filep->f_priv */
+
+  filep->f_priv = (FAR void *)priv;
+  return OK;
+}
+
+/****************************************************************************
+ * Name: irqstat_close
+ ****************************************************************************/
+
+static int irqstat_close(FAR struct file *filep)
+{
+  FAR struct irqstat_file_s *priv;
+
+  /* Recover our private data from the struct file instance */
+
+  priv = (FAR struct irqstat_file_s *)filep->f_priv;
+  DEBUGASSERT(priv);
+
+  /* Release the file attributes structure */
+
+  kmm_free(priv);
+  filep->f_priv = NULL;
+  return OK;
+}
+
+/****************************************************************************
+ * Name: irqstat_copyline
+ *
+ * Description:
+ *   Copy the line that was just formatted to the user buffer, skipping
+ *   whatever was already returned by earlier reads.  Returns true when the
+ *   user buffer is full.
+ *
+ ****************************************************************************/
+
+static bool irqstat_copyline(FAR struct irqstat_read_s *rd)
+{
+  FAR struct irqstat_file_s *priv = rd->priv;
+  size_t copysize;
+
+  copysize = procfs_memcpy(priv->line, priv->linesize, rd->buffer,
+                           rd->remaining, &rd->offset);
+
+  rd->totalsize += copysize;
+  rd->buffer    += copysize;
+  rd->remaining -= copysize;
+
+  return rd->remaining == 0;
+}
+
+/****************************************************************************
+ * Name: irqstat_histogram
+ *
+ * Description:
+ *   Emit the non-empty buckets of one histogram as "log2:count" pairs.
+ *
+ ****************************************************************************/
+
+static bool irqstat_histogram(FAR struct irqstat_read_s *rd,
+                              FAR const char *name,
+                              FAR const uint32_t *buckets)
+{
+  FAR struct irqstat_file_s *priv = rd->priv;
+  int i;
+
+  priv->linesize = snprintf(priv->line, IRQSTAT_LINELEN, "  %-8s", name);
+  if (irqstat_copyline(rd))
+    {
+      return true;
+    }
+
+  for (i = 0; i < IRQSTAT_NBUCKETS; i++)
+    {
+      if (buckets[i] != 0)
+        {
+          priv->linesize = snprintf(priv->line, IRQSTAT_LINELEN,
+                                    " %d:%lu", i,
+                                    (unsigned long)buckets[i]);
+          if (irqstat_copyline(rd))
+            {
+              return true;
+            }
+        }
+    }
+
+  priv->linesize = snprintf(priv->line, IRQSTAT_LINELEN, "\n");
+  return irqstat_copyline(rd);
+}
+
+/****************************************************************************
+ * Name: irqstat_read
+ ****************************************************************************/
+
+static ssize_t irqstat_read(FAR struct file *filep, FAR char *buffer,
+                            size_t buflen)
+{
+  FAR struct irqstat_file_s *priv;
+  FAR struct irqstat_s *stat;
+  struct irqstat_read_s rd;
+  irqstate_t flags;
+  int nslots;
+  int i;
+
+  fvdbg("buffer=%p buflen=%d\n", buffer, (int)buflen);
+
+  /* Recover our private data from the struct file instance */
+
+  priv = (FAR struct irqstat_file_s *)filep->f_priv;
+  DEBUGASSERT(priv);
+
+  rd.priv      = priv;
+  rd.buffer    = buffer;
+  rd.remaining = buflen;
+  rd.totalsize = 0;
+  rd.offset    = filep->f_pos;
+
+  priv->linesize = snprintf(priv->line, IRQSTAT_LINELEN,
+                            "IRQ      COUNT   DURMIN   DURMAX"
+                            "   ARRMIN     ARRMAX (cycles)\n");
+  if (irqstat_copyline(&rd))
+    {
+      goto done;
+    }
+
+  nslots = g_irqstat_nslots;
+  stat   = &priv->stat;
+
+  for (i = 0; i < nslots; i++)
+    {
+      /* Take a consistent snapshot of the statistics */
+
+      flags = up_irq_save();
+      memcpy(stat, &g_irqstat[i], sizeof(struct irqstat_s));
+      up_irq_restore(flags);
+
+      if (stat->count == 0)
+        {
+          continue;
+        }
+
+      priv->linesize = snprintf(priv->line, IRQSTAT_LINELEN,
+                                "%3d %10lu %8lu %8lu %8lu %10lu\n",
+                                stat->irq,
+                                (unsigned long)stat->count,
+                                (unsigned long)stat->durmin,
+                                (unsigned long)stat->durmax,
+                                stat->count > 1 ?
+                                  (unsigned long)stat->arrmin : 0ul,
+                                (unsigned long)stat->arrmax);
+
+      if (irqstat_copyline(&rd) ||
+          irqstat_histogram(&rd, "duration", stat->duration) ||
+          irqstat_histogram(&rd, "arrival", stat->arrival))
+        {
+          goto done;
+        }
+    }
+
+  priv->linesize = snprintf(priv->line, IRQSTAT_LINELEN,
+                            "Untracked: %lu\n",
+                            (unsigned long)g_irqstat_untracked);
+  (void)irqstat_copyline(&rd);
+
+done:
+
+  /* Update the file offset */
+
+  if (rd.totalsize > 0)
+    {
+      filep->f_pos += rd.totalsize;
+    }
+
+  return rd.totalsize;
+}
+
+/****************************************************************************
+ * Name: irqstat_dup
+ *
+ * Description:
+ *   Duplicate open file data in the new file structure.
+ *
+ ****************************************************************************/
+
+static int irqstat_dup(FAR const struct file *oldp, FAR struct file *newp)
+{
+  FAR struct irqstat_file_s *oldpriv;
+  FAR struct irqstat_file_s *newpriv;
+
+  fvdbg("Dup %p->%p\n", oldp, newp);
+
+  /* Recover our private data from the old struct file instance */
+
+  oldpriv = (FAR struct irqstat_file_s *)oldp->f_priv;
+  DEBUGASSERT(oldpriv);
+
+  /* Allocate a new container to hold the file attributes */
+
+  newpriv = (FAR struct irqstat_file_s *)
+    kmm_zalloc(sizeof(struct irqstat_file_s));
+
+  if (!newpriv)
+    {
+      fdbg("ERROR: Failed to allocate file attributes\n");
+      return -ENOMEM;
+    }
+
+  /* The copy the file attributes from the old attributes to the new */
+
+  memcpy(newpriv, oldpriv, sizeof(struct irqstat_file_s));
+
+  /* Save the new attributes in the new file structure */
+
+  newp->f_priv = (FAR void *)newpriv;
+  return OK;
+}
+
+/****************************************************************************
+ * Name: irqstat_stat
+ ****************************************************************************/
+
+static int irqstat_stat(const char *relpath, struct stat *buf)
+{
+  if (strcmp(relpath, "irqstat") != 0)
+    {
+      fdbg("ERROR: relpath is '%s'\n", relpath);
+      return -ENOENT;
+    }
+
+  buf->st_mode    = S_IFREG | S_IROTH | S_IRGRP | S_IRUSR;
+  buf->st_size    = 0;
+  buf->st_blksize = 0;
+  buf->st_blocks  = 0;
+
+  return OK;
+}
+
+/****************************************************************************
+ * Public Functions
+ ****************************************************************************/
+
+/****************************************************************************
+ * Name: irqstat_procfs_register
+ *
+ * Description:
+ *   Register the /proc/irqstat procfs file system entry
+ *
+ ****************************************************************************/
+
+int irqstat_procfs_register(void)
+{
+  return procfs_register(&g_procfs_irqstat);
+}
+
+#endif /* !CONFIG_DISABLE_MOUNTPOINT && CONFIG_FS_PROCFS &&
+        * CONFIG_FS_PROCFS_REGISTER && CONFIG_ARM_IRQSTAT_PROCFS */
@@ -49,6 +49,7 @@
 
 #include "chip.h"
 #include "itm_syslog.h"
+#include "itm_trace.h"
 #include "efm32_gpio.h"
 #include "chip/efm32_msc.h"
 #include "chip/efm32_cmu.h"
@@ -880,11 +881,12 @@ static inline void efm32_gpioclock(void)
  *
  * Description:
  *   Enable Serial wire output pin, configure debug clocking, and enable
- *   ITM syslog support.
+ *   ITM syslog and ITM trace support.
  *
  ****************************************************************************/
 
-#if defined(CONFIG_SYSLOG) || defined(CONFIG_ARMV7M_ITMSYSLOG)
+#if defined(CONFIG_SYSLOG) || defined(CONFIG_ARMV7M_ITMSYSLOG) || \
+    defined(CONFIG_ARMV7M_ITMTRACE)
 static inline void efm32_itm_syslog(void)
 {
   int regval;
@@ -909,9 +911,10 @@ static inline void efm32_itm_syslog(void)
 
   efm32_enable_auxhfrco();
 
-  /* Then perform ARMv7-M ITM SYSLOG initialization */
+  /* Then perform ARMv7-M ITM SYSLOG and ITM trace initialization */
 
   itm_syslog_initialize();
+  itm_trace_initialize();
 }
 #else
 #  define efm32_itm_syslog()
@@ -510,6 +510,12 @@ void up_disable_irq(int irq)
   uint32_t regval;
   uint32_t bit;
 
+#ifdef CONFIG_ARMV7M_NESTED_IRQ
+  /* Make sure that a deferred interrupt is not enabled again */
+
+  up_irqdefer_cancel(irq);
+#endif
+
   if (sam_irqinfo(irq, &regaddr, &bit, NVIC_CLRENA_OFFSET) == 0)
     {
       /* Modify the appropriate bit in the register to disable the interrupt.
@@ -44,6 +44,7 @@
 #include "chip.h"
 #include "stm32_pwr.h"
 #include "itm_syslog.h"
+#include "itm_trace.h"
 
 /****************************************************************************
  * Pre-processor Definitions
@@ -907,11 +908,12 @@ static void stm32_stdclockconfig(void)
  *
  * Description:
  *   Enable Serial wire output pin, configure debug clocking, and enable
- *   ITM syslog support.
+ *   ITM syslog and ITM trace support.
  *
  ****************************************************************************/
 
-#if defined(CONFIG_SYSLOG) && defined(CONFIG_ARMV7M_ITMSYSLOG)
+#if (defined(CONFIG_SYSLOG) && defined(CONFIG_ARMV7M_ITMSYSLOG)) || \
+    defined(CONFIG_ARMV7M_ITMTRACE)
 static inline void rcc_itm_syslog(void)
 {
   /* Enable SWO output */
@@ -919,7 +921,10 @@ static inline void rcc_itm_syslog(void)
   modifyreg32(STM32_DBGMCU_CR, DBGMCU_CR_TRACEMODE_MASK, DBGMCU_CR_ASYNCH |
               DBGMCU_CR_TRACEIOEN);
 
+#if defined(CONFIG_SYSLOG) && defined(CONFIG_ARMV7M_ITMSYSLOG)
   itm_syslog_initialize();
+#endif
+  itm_trace_initialize();
 }
 #else
 #  define rcc_itm_syslog()
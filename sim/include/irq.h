@@ -54,13 +54,25 @@
 /* Number of registers saved in context switch */
 
 #if defined(CONFIG_HOST_X86_64) && !defined(CONFIG_SIM_M32)
-   /* Storage order: %rbx, %rsp, %rbp, %r12, %r13, %r14, %r15, %rip */
-
-#  define XCPTCONTEXT_REGS    8
+   /* Storage order: %rbx, %rsp, %rbp, %r12, %r13, %r14, %r15, %rip, and
+    * optionally MXCSR and the x87 control word packed into one register.
+    */
+
+#  ifdef CONFIG_SIM_FASTSWITCH_FPCTRL
+#    define XCPTCONTEXT_REGS  9
+#  else
+#    define XCPTCONTEXT_REGS  8
+#  endif
 #else
-   /* Storage order: %ebx, %esi, %edi, %ebp, sp, and return PC */
-
-#  define XCPTCONTEXT_REGS    6
+   /* Storage order: %ebx, %esi, %edi, %ebp, sp, and return PC, and
+    * optionally MXCSR and the x87 control word.
+    */
+
+#  ifdef CONFIG_SIM_FASTSWITCH_FPCTRL
+#    define XCPTCONTEXT_REGS  8
+#  else
+#    define XCPTCONTEXT_REGS  6
+#  endif
 #endif
 
 /****************************************************************************
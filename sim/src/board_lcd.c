@@ -50,6 +50,8 @@
 #include <nuttx/board.h>
 #include <nuttx/lcd/lcd.h>
 
+#include "up_internal.h"
+
 /****************************************************************************
  * Pre-processor Definitions
  ****************************************************************************/
@@ -192,6 +194,14 @@ static int sim_setcontrast(struct lcd_dev_s *dev, unsigned int contrast);
 
 static uint8_t g_runbuffer[FB_STRIDE];
 
+/* Simulated display memory.  This is only needed when the display contents
+ * are captured.
+ */
+
+#ifdef CONFIG_SIM_FBCAPTURE
+static uint8_t g_lcdmem[FB_STRIDE * CONFIG_SIM_FBHEIGHT];
+#endif
+
 /* This structure describes the overall LCD video controller */
 
 static const struct fb_videoinfo_s g_videoinfo =
@@ -256,7 +266,50 @@ static struct sim_dev_s g_lcddev =
 static int sim_putrun(fb_coord_t row, fb_coord_t col, FAR const uint8_t *buffer,
                        size_t npixels)
 {
+#ifdef CONFIG_SIM_FBCAPTURE
+  FAR uint8_t *dest = &g_lcdmem[row * FB_STRIDE];
+#if CONFIG_SIM_FBBPP < 8
+  unsigned int srcbit;
+  unsigned int destbit;
+  unsigned int shift;
+  uint8_t pixel;
+  size_t i;
+#endif
+#endif
+
   lcddbg("row: %d col: %d npixels: %d\n", row, col, npixels);
+
+#ifdef CONFIG_SIM_FBCAPTURE
+#if CONFIG_SIM_FBBPP >= 8
+  memcpy(&dest[col * (CONFIG_SIM_FBBPP >> 3)], buffer,
+         npixels * (CONFIG_SIM_FBBPP >> 3));
+#else
+  /* The run starts at the beginning of the buffer, but the first pixel may
+   * not be aligned to a byte in display memory.
+   */
+
+  for (i = 0; i < npixels; i++)
+    {
+      srcbit  = i * CONFIG_SIM_FBBPP;
+      destbit = (col + i) * CONFIG_SIM_FBBPP;
+
+#ifdef CONFIG_NX_PACKEDMSFIRST
+      shift   = 8 - CONFIG_SIM_FBBPP - (srcbit & 7);
+      pixel   = (buffer[srcbit >> 3] >> shift) & ((1 << CONFIG_SIM_FBBPP) - 1);
+      shift   = 8 - CONFIG_SIM_FBBPP - (destbit & 7);
+#else
+      shift   = srcbit & 7;
+      pixel   = (buffer[srcbit >> 3] >> shift) & ((1 << CONFIG_SIM_FBBPP) - 1);
+      shift   = destbit & 7;
+#endif
+      dest[destbit >> 3] &= ~(((1 << CONFIG_SIM_FBBPP) - 1) << shift);
+      dest[destbit >> 3] |= pixel << shift;
+    }
+#endif
+
+  fbcapture_written((npixels * CONFIG_SIM_FBBPP + 7) >> 3);
+#endif
+
   return OK;
 }
 
@@ -278,7 +331,14 @@ static int sim_getrun(fb_coord_t row, fb_coord_t col, FAR uint8_t *buffer,
                        size_t npixels)
 {
   lcddbg("row: %d col: %d npixels: %d\n", row, col, npixels);
+
+#if defined(CONFIG_SIM_FBCAPTURE) && CONFIG_SIM_FBBPP >= 8
+  memcpy(buffer, &g_lcdmem[row * FB_STRIDE + col * (CONFIG_SIM_FBBPP >> 3)],
+         npixels * (CONFIG_SIM_FBBPP >> 3));
+  return OK;
+#else
   return -ENOSYS;
+#endif
 }
 
 /****************************************************************************
@@ -397,6 +457,15 @@ static int sim_setcontrast(struct lcd_dev_s *dev, unsigned int contrast)
 int board_lcd_initialize(void)
 {
   gvdbg("Initializing\n");
+
+#ifdef CONFIG_SIM_FBCAPTURE
+  if (fbcapture_initialize(g_lcdmem, CONFIG_SIM_FBWIDTH, CONFIG_SIM_FBHEIGHT,
+                           CONFIG_SIM_FBBPP, FB_STRIDE) < 0)
+    {
+      return -ENOMEM;
+    }
+#endif
+
   return OK;
 }
 
@@ -42,9 +42,11 @@
 #include <sys/types.h>
 #include <stdint.h>
 #include <sched.h>
+#include <assert.h>
 #include <debug.h>
 
 #include <nuttx/arch.h>
+#include <nuttx/mm/mm.h>
 
 #include "up_internal.h"
 
@@ -52,7 +54,9 @@
  * Private Data
  ****************************************************************************/
 
+#ifndef CONFIG_SIM_HEAP_MMAP
 static uint8_t sim_heap[SIM_HEAP_SIZE];
+#endif
 
 /****************************************************************************
  * Public Functions
@@ -71,6 +75,47 @@ static uint8_t sim_heap[SIM_HEAP_SIZE];
 
 void up_allocate_heap(void **heap_start, size_t *heap_size)
 {
+#ifdef CONFIG_SIM_HEAP_MMAP
+  /* Reserve the heap in the host address space.  Its size comes from the
+   * command line or from the configuration.
+   */
+
+  *heap_start = sim_heap_map(heap_size);
+  if (*heap_start == NULL)
+    {
+      PANIC();
+    }
+#else
   *heap_start = sim_heap;
   *heap_size  = SIM_HEAP_SIZE;
+#endif
+}
+
+/****************************************************************************
+ * Name: up_addregion
+ *
+ * Description:
+ *   Memory may be added in non-contiguous chunks.  Additional chunks are
+ *   added by calling this function.  Each additional region is reserved
+ *   separately in the host address space to model the memory banks of a
+ *   board.
+ *
+ ****************************************************************************/
+
+#if CONFIG_MM_REGIONS > 1 && defined(CONFIG_SIM_HEAP_MMAP)
+void up_addregion(void)
+{
+  FAR void *start;
+  size_t size;
+  int region;
+
+  for (region = 0; region < CONFIG_MM_REGIONS - 1; region++)
+    {
+      start = sim_heap_region(region, &size);
+      if (start != NULL)
+        {
+          umm_addregion(start, size);
+        }
+    }
 }
+#endif
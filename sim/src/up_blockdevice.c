@@ -39,12 +39,17 @@
 
 #include <nuttx/config.h>
 
+#include <sys/types.h>
 #include <stdint.h>
 #include <stdbool.h>
 #include <string.h>
 #include <errno.h>
 
-#include <nuttx/fs/ramdisk.h>
+#ifdef CONFIG_SIM_BLOCKFILE
+#  include <nuttx/fs/fs.h>
+#else
+#  include <nuttx/fs/ramdisk.h>
+#endif
 
 #include "up_internal.h"
 
@@ -52,8 +57,156 @@
  * Pre-processor Definitions
  ****************************************************************************/
 
-#define NSECTORS            2048
-#define LOGICAL_SECTOR_SIZE 512
+#ifdef CONFIG_SIM_BLOCKFILE
+#  define NSECTORS            CONFIG_SIM_BLOCKFILE_NSECTORS
+#  define LOGICAL_SECTOR_SIZE CONFIG_SIM_BLOCKFILE_SECTORSIZE
+#else
+#  define NSECTORS            2048
+#  define LOGICAL_SECTOR_SIZE 512
+#endif
+
+#ifdef CONFIG_SIM_BLOCKFILE
+
+/****************************************************************************
+ * Private Function Prototypes
+ ****************************************************************************/
+
+static int     simblk_open(FAR struct inode *inode);
+static int     simblk_close(FAR struct inode *inode);
+static ssize_t simblk_read(FAR struct inode *inode, FAR unsigned char *buffer,
+                           size_t start_sector, unsigned int nsectors);
+#ifdef CONFIG_FS_WRITABLE
+static ssize_t simblk_write(FAR struct inode *inode,
+                            FAR const unsigned char *buffer,
+                            size_t start_sector, unsigned int nsectors);
+#endif
+static int     simblk_geometry(FAR struct inode *inode,
+                               FAR struct geometry *geometry);
+static int     simblk_ioctl(FAR struct inode *inode, int cmd,
+                            unsigned long arg);
+
+/****************************************************************************
+ * Private Data
+ ****************************************************************************/
+
+static const struct block_operations g_simblk_bops =
+{
+  simblk_open,     /* open     */
+  simblk_close,    /* close    */
+  simblk_read,     /* read     */
+#ifdef CONFIG_FS_WRITABLE
+  simblk_write,    /* write    */
+#else
+  NULL,            /* write    */
+#endif
+  simblk_geometry, /* geometry */
+  simblk_ioctl     /* ioctl    */
+};
+
+/****************************************************************************
+ * Private Functions
+ ****************************************************************************/
+
+/****************************************************************************
+ * Name: simblk_open
+ ****************************************************************************/
+
+static int simblk_open(FAR struct inode *inode)
+{
+  return OK;
+}
+
+/****************************************************************************
+ * Name: simblk_close
+ *
+ * Description:
+ *   Write modified data back to the host image when the device is closed
+ *   (for example, on umount).
+ *
+ ****************************************************************************/
+
+static int simblk_close(FAR struct inode *inode)
+{
+  return blockfile_sync() < 0 ? -EIO : OK;
+}
+
+/****************************************************************************
+ * Name: simblk_read
+ ****************************************************************************/
+
+static ssize_t simblk_read(FAR struct inode *inode, FAR unsigned char *buffer,
+                           size_t start_sector, unsigned int nsectors)
+{
+  if (start_sector >= NSECTORS || nsectors > NSECTORS - start_sector)
+    {
+      return -EINVAL;
+    }
+
+  if (blockfile_read(buffer, start_sector, nsectors) < 0)
+    {
+      return -EIO;
+    }
+
+  return nsectors;
+}
+
+/****************************************************************************
+ * Name: simblk_write
+ ****************************************************************************/
+
+#ifdef CONFIG_FS_WRITABLE
+static ssize_t simblk_write(FAR struct inode *inode,
+                            FAR const unsigned char *buffer,
+                            size_t start_sector, unsigned int nsectors)
+{
+  if (start_sector >= NSECTORS || nsectors > NSECTORS - start_sector)
+    {
+      return -EINVAL;
+    }
+
+  if (blockfile_write(buffer, start_sector, nsectors) < 0)
+    {
+      return -EIO;
+    }
+
+  return nsectors;
+}
+#endif
+
+/****************************************************************************
+ * Name: simblk_geometry
+ ****************************************************************************/
+
+static int simblk_geometry(FAR struct inode *inode,
+                           FAR struct geometry *geometry)
+{
+  if (geometry == NULL)
+    {
+      return -EINVAL;
+    }
+
+  geometry->geo_available     = true;
+  geometry->geo_mediachanged  = false;
+#ifdef CONFIG_FS_WRITABLE
+  geometry->geo_writeenabled  = true;
+#else
+  geometry->geo_writeenabled  = false;
+#endif
+  geometry->geo_nsectors      = NSECTORS;
+  geometry->geo_sectorsize    = LOGICAL_SECTOR_SIZE;
+  return OK;
+}
+
+/****************************************************************************
+ * Name: simblk_ioctl
+ ****************************************************************************/
+
+static int simblk_ioctl(FAR struct inode *inode, int cmd, unsigned long arg)
+{
+  return -ENOTTY;
+}
+
+#endif /* CONFIG_SIM_BLOCKFILE */
 
 /****************************************************************************
  * Public Functions
@@ -62,12 +215,21 @@
 /****************************************************************************
  * Name: up_registerblockdevice
  *
- * Description: Register the FAT ramdisk
+ * Description: Register the FAT ramdisk or, with CONFIG_SIM_BLOCKFILE, the
+ *   block device backed by a host image file.
  *
  ****************************************************************************/
 
 void up_registerblockdevice(void)
 {
+#ifdef CONFIG_SIM_BLOCKFILE
+  if (blockfile_open(NSECTORS, LOGICAL_SECTOR_SIZE) == 0)
+    {
+      (void)register_blockdriver(CONFIG_SIM_BLOCKFILE_DEVNAME,
+                                 &g_simblk_bops, 0666, NULL);
+    }
+#else
   ramdisk_register(0, (FAR uint8_t *)up_deviceimage(), NSECTORS,
                    LOGICAL_SECTOR_SIZE, RDFLAG_WRENABLED | RDFLAG_FUNLINK);
+#endif
 }
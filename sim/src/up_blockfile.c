@@ -0,0 +1,411 @@
+/****************************************************************************
+ * arch/sim/src/up_blockfile.c
+ *
+ *   Copyright (C) 2016 Gregory Nutt. All rights reserved.
+ *   Author: Gregory Nutt <gnutt@nuttx.org>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name NuttX nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************/
+
+/****************************************************************************
+ * Included Files
+ ****************************************************************************/
+
+#define _GNU_SOURCE 1
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <unistd.h>
+#include <time.h>
+
+/****************************************************************************
+ * Pre-processor Definitions
+ ****************************************************************************/
+
+#ifndef CONFIG_SIM_BLOCKFILE_PATH
+#  define CONFIG_SIM_BLOCKFILE_PATH "nuttx-disk.img"
+#endif
+
+/* Size of the aligned bounce buffer used for O_DIRECT transfers */
+
+#define BLOCKFILE_BOUNCESIZE (64 * 1024)
+#define BLOCKFILE_ALIGN      4096
+
+#define BLOCKFILE_NHIST      32  /* log2(nsec) latency histogram buckets */
+
+/****************************************************************************
+ * Private Types
+ ****************************************************************************/
+
+#ifdef CONFIG_SIM_BLOCKFILE_STATS
+struct blockfile_stats_s
+{
+  unsigned long count;           /* Number of requests */
+  uint64_t      nsectors;        /* Sectors transferred */
+  uint64_t      nsec;            /* Total latency */
+  uint64_t      maxnsec;         /* Worst latency */
+  unsigned long hist[BLOCKFILE_NHIST];
+};
+#endif
+
+/****************************************************************************
+ * Private Data
+ ****************************************************************************/
+
+static int           g_blockfd = -1;
+static uint8_t      *g_blockmap;     /* Mapping of the image, if any */
+static uint8_t      *g_blockbounce;  /* O_DIRECT bounce buffer */
+static uint64_t      g_blocksize;    /* Size of the device in bytes */
+static unsigned int  g_sectorsize;
+
+#ifdef CONFIG_SIM_BLOCKFILE_STATS
+static struct blockfile_stats_s g_blockstats[2]; /* 0=read, 1=write */
+#endif
+
+/****************************************************************************
+ * Private Functions
+ ****************************************************************************/
+
+#ifdef CONFIG_SIM_BLOCKFILE_STATS
+/****************************************************************************
+ * Name: blockfile_gettime
+ ****************************************************************************/
+
+static uint64_t blockfile_gettime(void)
+{
+  struct timespec ts;
+
+  (void)clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+/****************************************************************************
+ * Name: blockfile_account
+ ****************************************************************************/
+
+static void blockfile_account(int write, uint64_t start,
+                              unsigned int nsectors)
+{
+  struct blockfile_stats_s *stats = &g_blockstats[write];
+  uint64_t nsec = blockfile_gettime() - start;
+  int bucket = 0;
+
+  while (bucket < BLOCKFILE_NHIST - 1 && (nsec >> (bucket + 1)) != 0)
+    {
+      bucket++;
+    }
+
+  stats->count++;
+  stats->nsectors += nsectors;
+  stats->nsec     += nsec;
+  stats->hist[bucket]++;
+
+  if (nsec > stats->maxnsec)
+    {
+      stats->maxnsec = nsec;
+    }
+}
+
+/****************************************************************************
+ * Name: blockfile_report
+ ****************************************************************************/
+
+static void blockfile_report(void)
+{
+  static const char *what[2] =
+  {
+    "read", "write"
+  };
+
+  struct blockfile_stats_s *stats;
+  int i;
+  int j;
+
+  for (i = 0; i < 2; i++)
+    {
+      stats = &g_blockstats[i];
+      if (stats->count == 0)
+        {
+          continue;
+        }
+
+      fprintf(stderr,
+              "blockfile: %-5s %lu requests, %llu sectors, "
+              "avg %llu ns, max %llu ns, %.1f MB/s\n",
+              what[i], stats->count,
+              (unsigned long long)stats->nsectors,
+              (unsigned long long)(stats->nsec / stats->count),
+              (unsigned long long)stats->maxnsec,
+              stats->nsec > 0 ? (double)stats->nsectors * g_sectorsize *
+              1000.0 / (double)stats->nsec : 0.0);
+
+      for (j = 0; j < BLOCKFILE_NHIST; j++)
+        {
+          if (stats->hist[j] > 0)
+            {
+              fprintf(stderr, "blockfile: %-5s  < %10llu ns: %lu\n",
+                      what[i], 1ull << (j + 1), stats->hist[j]);
+            }
+        }
+    }
+}
+#endif
+
+/****************************************************************************
+ * Name: blockfile_directio
+ *
+ * Description:
+ *   Transfer through the aligned bounce buffer with pread()/pwrite().
+ *   Used when the image is opened with O_DIRECT and when it cannot be
+ *   mapped.
+ *
+ ****************************************************************************/
+
+static int blockfile_directio(int write, uint8_t *buf, uint64_t offset,
+                              size_t nbytes)
+{
+  ssize_t ret;
+  size_t chunk;
+
+  while (nbytes > 0)
+    {
+      chunk = nbytes > BLOCKFILE_BOUNCESIZE ? BLOCKFILE_BOUNCESIZE : nbytes;
+
+      if (write)
+        {
+          memcpy(g_blockbounce, buf, chunk);
+          ret = pwrite(g_blockfd, g_blockbounce, chunk, offset);
+        }
+      else
+        {
+          ret = pread(g_blockfd, g_blockbounce, chunk, offset);
+          if (ret > 0)
+            {
+              memcpy(buf, g_blockbounce, ret);
+            }
+        }
+
+      if (ret < 0 && errno == EINTR)
+        {
+          continue;
+        }
+      else if (ret <= 0)
+        {
+          return -1;
+        }
+
+      buf    += ret;
+      offset += ret;
+      nbytes -= ret;
+    }
+
+  return 0;
+}
+
+/****************************************************************************
+ * Public Functions
+ ****************************************************************************/
+
+/****************************************************************************
+ * Name: blockfile_open
+ *
+ * Description:
+ *   Open the block device image (CONFIG_SIM_BLOCKFILE_PATH or the file named
+ *   by the SIM_BLOCKFILE environment variable), creating it or extending it
+ *   as a sparse file if it is smaller than the device.  Unless direct I/O
+ *   is selected, the image is mapped into memory; pages are only read from
+ *   the file when they are first accessed.  Nothing is allocated from the
+ *   simulated heap.
+ *
+ ****************************************************************************/
+
+int blockfile_open(unsigned long nsectors, unsigned int sectorsize)
+{
+  const char *path;
+  struct stat buf;
+  int flags = O_RDWR | O_CREAT;
+
+  path = getenv("SIM_BLOCKFILE");
+  if (path == NULL)
+    {
+      path = CONFIG_SIM_BLOCKFILE_PATH;
+    }
+
+  g_sectorsize = sectorsize;
+  g_blocksize  = (uint64_t)nsectors * sectorsize;
+
+#ifdef CONFIG_SIM_BLOCKFILE_DIRECT
+  flags |= O_DIRECT;
+#endif
+
+  g_blockfd = open(path, flags, 0644);
+#ifdef CONFIG_SIM_BLOCKFILE_DIRECT
+  if (g_blockfd < 0 && errno == EINVAL)
+    {
+      /* The host file system does not support O_DIRECT (tmpfs) */
+
+      fprintf(stderr, "blockfile: O_DIRECT not supported for %s\n", path);
+      g_blockfd = open(path, flags & ~O_DIRECT, 0644);
+    }
+#endif
+
+  if (g_blockfd < 0 || fstat(g_blockfd, &buf) < 0)
+    {
+      fprintf(stderr, "blockfile: cannot open %s\n", path);
+      return -1;
+    }
+
+  if ((uint64_t)buf.st_size < g_blocksize &&
+      ftruncate(g_blockfd, (off_t)g_blocksize) < 0)
+    {
+      fprintf(stderr, "blockfile: cannot extend %s\n", path);
+      close(g_blockfd);
+      g_blockfd = -1;
+      return -1;
+    }
+
+#ifndef CONFIG_SIM_BLOCKFILE_DIRECT
+  /* Map the whole image.  This can fail on a 32-bit host with a large
+   * image; fall back to pread()/pwrite() then.
+   */
+
+  if ((size_t)g_blocksize == g_blocksize)
+    {
+      g_blockmap = mmap(NULL, (size_t)g_blocksize, PROT_READ | PROT_WRITE,
+                        MAP_SHARED, g_blockfd, 0);
+      if (g_blockmap == MAP_FAILED)
+        {
+          g_blockmap = NULL;
+        }
+    }
+#endif
+
+  if (g_blockmap == NULL &&
+      posix_memalign((void **)&g_blockbounce, BLOCKFILE_ALIGN,
+                     BLOCKFILE_BOUNCESIZE) != 0)
+    {
+      close(g_blockfd);
+      g_blockfd = -1;
+      return -1;
+    }
+
+#ifdef CONFIG_SIM_BLOCKFILE_STATS
+  (void)atexit(blockfile_report);
+#endif
+
+  return 0;
+}
+
+/****************************************************************************
+ * Name: blockfile_read
+ ****************************************************************************/
+
+int blockfile_read(void *buffer, unsigned long start, unsigned int nsectors)
+{
+  uint64_t offset = (uint64_t)start * g_sectorsize;
+  size_t nbytes = (size_t)nsectors * g_sectorsize;
+  int ret = 0;
+#ifdef CONFIG_SIM_BLOCKFILE_STATS
+  uint64_t time = blockfile_gettime();
+#endif
+
+  if (g_blockmap != NULL)
+    {
+      memcpy(buffer, g_blockmap + offset, nbytes);
+    }
+  else
+    {
+      ret = blockfile_directio(0, buffer, offset, nbytes);
+    }
+
+#ifdef CONFIG_SIM_BLOCKFILE_STATS
+  blockfile_account(0, time, nsectors);
+#endif
+  return ret;
+}
+
+/****************************************************************************
+ * Name: blockfile_write
+ ****************************************************************************/
+
+int blockfile_write(const void *buffer, unsigned long start,
+                    unsigned int nsectors)
+{
+  uint64_t offset = (uint64_t)start * g_sectorsize;
+  size_t nbytes = (size_t)nsectors * g_sectorsize;
+  int ret = 0;
+#ifdef CONFIG_SIM_BLOCKFILE_STATS
+  uint64_t time = blockfile_gettime();
+#endif
+
+  if (g_blockmap != NULL)
+    {
+      memcpy(g_blockmap + offset, buffer, nbytes);
+    }
+  else
+    {
+      ret = blockfile_directio(1, (uint8_t *)buffer, offset, nbytes);
+    }
+
+#ifdef CONFIG_SIM_BLOCKFILE_STATS
+  blockfile_account(1, time, nsectors);
+#endif
+  return ret;
+}
+
+/****************************************************************************
+ * Name: blockfile_sync
+ *
+ * Description:
+ *   Write modified data back to the image file and wait until it is on
+ *   the host disk.  Returns a negative value on failure.
+ *
+ ****************************************************************************/
+
+int blockfile_sync(void)
+{
+  if (g_blockmap != NULL)
+    {
+      return msync(g_blockmap, (size_t)g_blocksize, MS_SYNC);
+    }
+  else if (g_blockfd >= 0)
+    {
+      return fdatasync(g_blockfd);
+    }
+
+  return 0;
+}
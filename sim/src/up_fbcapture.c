@@ -0,0 +1,670 @@
+/****************************************************************************
+ * arch/sim/src/up_fbcapture.c
+ *
+ *   Copyright (C) 2016 Gregory Nutt. All rights reserved.
+ *   Author: Gregory Nutt <gnutt@nuttx.org>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name NuttX nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************/
+
+/****************************************************************************
+ * Included Files
+ ****************************************************************************/
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <time.h>
+
+/****************************************************************************
+ * Pre-processor Definitions
+ ****************************************************************************/
+
+/* Rate at which the framebuffer is sampled */
+
+#ifndef CONFIG_SIM_FBCAPTURE_FPS
+#  define CONFIG_SIM_FBCAPTURE_FPS 10
+#endif
+
+/* Base name of the capture files */
+
+#ifndef CONFIG_SIM_FBCAPTURE_PATH
+#  define CONFIG_SIM_FBCAPTURE_PATH "nuttx-fb"
+#endif
+
+/* Write every Nth captured frame as a PNG snapshot */
+
+#ifndef CONFIG_SIM_FBCAPTURE_PNGINTERVAL
+#  define CONFIG_SIM_FBCAPTURE_PNGINTERVAL 10
+#endif
+
+#define FBCAPTURE_INTERVAL (1000000000ull / CONFIG_SIM_FBCAPTURE_FPS)
+
+/* FNV-1a 64-bit hash parameters */
+
+#define FNV_OFFSET 0xcbf29ce484222325ull
+#define FNV_PRIME  0x00000100000001b3ull
+
+/* Largest payload of a stored (uncompressed) deflate block */
+
+#define DEFLATE_MAXSTORED 65535
+
+/****************************************************************************
+ * Private Data
+ ****************************************************************************/
+
+static const uint8_t *g_fbmem;    /* Framebuffer or LCD memory */
+static unsigned int g_width;      /* Width in pixels */
+static unsigned int g_height;     /* Height in rows */
+static unsigned int g_bpp;        /* Bits per pixel */
+static unsigned int g_stride;     /* Length of a row in bytes */
+static unsigned int g_rowlen;     /* Visible bytes in a row */
+
+static uint8_t *g_shadow;         /* Frame as last captured */
+static uint8_t *g_rgb;            /* RGB888 conversion buffer */
+static FILE *g_hashfile;          /* Per-frame hashes */
+#ifndef CONFIG_SIM_FBCAPTURE_PNG
+static FILE *g_y4mfile;           /* Y4M stream */
+#endif
+
+/* Statistics */
+
+static uint64_t g_starttime;      /* Time of initialization */
+static uint64_t g_lastsample;     /* Time of the last sample */
+static uint64_t g_lasthash;       /* Hash of the last frame */
+static unsigned long g_nsamples;  /* Number of samples taken */
+static unsigned long g_nframes;   /* Number of distinct frames */
+static uint64_t g_changed;        /* Total bytes changed between frames */
+static uint64_t g_written;        /* Total bytes written by the LCD driver */
+
+static pthread_once_t g_fbcapture_once = PTHREAD_ONCE_INIT;
+
+/****************************************************************************
+ * Private Functions
+ ****************************************************************************/
+
+static uint64_t fbcapture_gettime(void)
+{
+  struct timespec ts;
+
+  (void)clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+/****************************************************************************
+ * Name: fbcapture_torgb
+ *
+ * Description:
+ *   Convert the captured frame to packed RGB888 in g_rgb.
+ *
+ ****************************************************************************/
+
+static void fbcapture_torgb(void)
+{
+  const uint8_t *src;
+  uint8_t *dest = g_rgb;
+  unsigned int row;
+  unsigned int col;
+  unsigned int shift;
+  uint32_t pixel;
+
+  for (row = 0; row < g_height; row++)
+    {
+      src = g_shadow + row * g_stride;
+      for (col = 0; col < g_width; col++)
+        {
+          switch (g_bpp)
+            {
+              case 32:
+                pixel   = src[4 * col] | (src[4 * col + 1] << 8) |
+                          (src[4 * col + 2] << 16);
+                dest[0] = pixel >> 16;
+                dest[1] = pixel >> 8;
+                dest[2] = pixel;
+                break;
+
+              case 24:
+                dest[0] = src[3 * col + 2];
+                dest[1] = src[3 * col + 1];
+                dest[2] = src[3 * col];
+                break;
+
+              case 16:
+                pixel   = src[2 * col] | (src[2 * col + 1] << 8);
+                dest[0] = ((pixel >> 11) & 0x1f) * 255 / 31;
+                dest[1] = ((pixel >> 5) & 0x3f) * 255 / 63;
+                dest[2] = (pixel & 0x1f) * 255 / 31;
+                break;
+
+              case 8:
+                pixel   = src[col];
+                dest[0] = ((pixel >> 5) & 7) * 255 / 7;
+                dest[1] = ((pixel >> 2) & 7) * 255 / 7;
+                dest[2] = (pixel & 3) * 255 / 3;
+                break;
+
+              default:
+
+                /* 1, 2 or 4 bits per pixel are shown as grey levels */
+
+                shift   = (col * g_bpp) & 7;
+#ifdef CONFIG_NX_PACKEDMSFIRST
+                shift   = 8 - g_bpp - shift;
+#endif
+                pixel   = (src[(col * g_bpp) >> 3] >> shift) &
+                          ((1 << g_bpp) - 1);
+                dest[0] = pixel * 255 / ((1 << g_bpp) - 1);
+                dest[1] = dest[0];
+                dest[2] = dest[0];
+                break;
+            }
+
+          dest += 3;
+        }
+    }
+}
+
+#ifdef CONFIG_SIM_FBCAPTURE_PNG
+/****************************************************************************
+ * Name: fbcapture_crc32 and fbcapture_adler32
+ *
+ * Description:
+ *   Incrementally update the CRC-32 of a PNG chunk and the Adler-32
+ *   checksum of the zlib stream.
+ *
+ ****************************************************************************/
+
+static uint32_t fbcapture_crc32(uint32_t crc, const uint8_t *buf, size_t len)
+{
+  int bit;
+
+  crc = ~crc;
+  while (len-- > 0)
+    {
+      crc ^= *buf++;
+      for (bit = 0; bit < 8; bit++)
+        {
+          crc = (crc >> 1) ^ (0xedb88320 & -(crc & 1));
+        }
+    }
+
+  return ~crc;
+}
+
+static uint32_t fbcapture_adler32(uint32_t adler, const uint8_t *buf,
+                                  size_t len)
+{
+  uint32_t a = adler & 0xffff;
+  uint32_t b = adler >> 16;
+
+  while (len-- > 0)
+    {
+      a = (a + *buf++) % 65521;
+      b = (b + a) % 65521;
+    }
+
+  return (b << 16) | a;
+}
+
+/****************************************************************************
+ * Name: fbcapture_chunkdata
+ *
+ * Description:
+ *   Write part of the payload of a PNG chunk, accumulating its CRC.
+ *
+ ****************************************************************************/
+
+static void fbcapture_chunkdata(FILE *stream, uint32_t *crc,
+                                const uint8_t *buf, size_t len)
+{
+  (void)fwrite(buf, 1, len, stream);
+  *crc = fbcapture_crc32(*crc, buf, len);
+}
+
+static void fbcapture_put32(uint8_t *buf, uint32_t value)
+{
+  buf[0] = value >> 24;
+  buf[1] = value >> 16;
+  buf[2] = value >> 8;
+  buf[3] = value;
+}
+
+/****************************************************************************
+ * Name: fbcapture_writepng
+ *
+ * Description:
+ *   Write the RGB888 frame in g_rgb as an 8-bit RGB PNG file.  The image
+ *   data is stored in uncompressed deflate blocks so that no compression
+ *   library is needed on the host.
+ *
+ ****************************************************************************/
+
+static void fbcapture_writepng(unsigned long frameno)
+{
+  static const uint8_t signature[8] =
+  {
+    0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n'
+  };
+
+  static const uint8_t zlibhdr[2] =
+  {
+    0x78, 0x01
+  };
+
+  char path[256];
+  FILE *stream;
+  uint8_t buf[17];
+  uint8_t filter = 0;
+  uint32_t crc;
+  uint32_t adler = 1;
+  size_t rgblen = 3 * g_width;
+  size_t rawlen = g_height * (rgblen + 1);
+  size_t nblocks = (rawlen + DEFLATE_MAXSTORED - 1) / DEFLATE_MAXSTORED;
+  size_t blocklen;
+  size_t remaining;
+  size_t offset;
+  size_t nbytes;
+  unsigned int row;
+
+  (void)snprintf(path, sizeof(path), "%s-%06lu.png",
+                 CONFIG_SIM_FBCAPTURE_PATH, frameno);
+
+  stream = fopen(path, "wb");
+  if (stream == NULL)
+    {
+      return;
+    }
+
+  (void)fwrite(signature, 1, sizeof(signature), stream);
+
+  /* IHDR: width, height, bit depth 8, color type 2 (RGB) */
+
+  fbcapture_put32(buf, 13);
+  memcpy(&buf[4], "IHDR", 4);
+  fbcapture_put32(&buf[8], g_width);
+  fbcapture_put32(&buf[12], g_height);
+  (void)fwrite(buf, 1, 16, stream);
+  crc = fbcapture_crc32(0, &buf[4], 12);
+
+  buf[0] = 8;
+  buf[1] = 2;
+  buf[2] = 0;
+  buf[3] = 0;
+  buf[4] = 0;
+  fbcapture_chunkdata(stream, &crc, buf, 5);
+  fbcapture_put32(buf, crc);
+  (void)fwrite(buf, 1, 4, stream);
+
+  /* IDAT: a zlib stream of stored blocks.  Each row of the raw image is
+   * preceded by a filter type byte of zero.
+   */
+
+  fbcapture_put32(buf, 2 + 5 * nblocks + rawlen + 4);
+  memcpy(&buf[4], "IDAT", 4);
+  (void)fwrite(buf, 1, 8, stream);
+  crc = fbcapture_crc32(0, &buf[4], 4);
+  fbcapture_chunkdata(stream, &crc, zlibhdr, 2);
+
+  row       = 0;
+  offset    = 0;
+  remaining = rawlen;
+
+  while (remaining > 0)
+    {
+      blocklen = remaining > DEFLATE_MAXSTORED ?
+                 DEFLATE_MAXSTORED : remaining;
+      remaining -= blocklen;
+
+      buf[0] = remaining == 0 ? 1 : 0;
+      buf[1] = blocklen & 0xff;
+      buf[2] = blocklen >> 8;
+      buf[3] = ~blocklen & 0xff;
+      buf[4] = (~blocklen >> 8) & 0xff;
+      fbcapture_chunkdata(stream, &crc, buf, 5);
+
+      /* Copy the block payload from the rows, inserting the filter bytes.
+       * 'offset' is the position within the current row, where offset 0
+       * is the filter byte.
+       */
+
+      while (blocklen > 0)
+        {
+          if (offset == 0)
+            {
+              fbcapture_chunkdata(stream, &crc, &filter, 1);
+              adler = fbcapture_adler32(adler, &filter, 1);
+              offset = 1;
+              blocklen--;
+              continue;
+            }
+
+          nbytes = rgblen + 1 - offset;
+          if (nbytes > blocklen)
+            {
+              nbytes = blocklen;
+            }
+
+          fbcapture_chunkdata(stream, &crc,
+                              &g_rgb[row * rgblen + offset - 1], nbytes);
+          adler = fbcapture_adler32(adler,
+                                    &g_rgb[row * rgblen + offset - 1],
+                                    nbytes);
+          offset   += nbytes;
+          blocklen -= nbytes;
+
+          if (offset > rgblen)
+            {
+              offset = 0;
+              row++;
+            }
+        }
+    }
+
+  fbcapture_put32(buf, adler);
+  fbcapture_chunkdata(stream, &crc, buf, 4);
+  fbcapture_put32(buf, crc);
+  (void)fwrite(buf, 1, 4, stream);
+
+  /* IEND */
+
+  fbcapture_put32(buf, 0);
+  memcpy(&buf[4], "IEND", 4);
+  fbcapture_put32(&buf[8], fbcapture_crc32(0, &buf[4], 4));
+  (void)fwrite(buf, 1, 12, stream);
+
+  (void)fclose(stream);
+}
+#else
+/****************************************************************************
+ * Name: fbcapture_writey4m
+ *
+ * Description:
+ *   Append the RGB888 frame in g_rgb to the Y4M stream as a 4:4:4 YCbCr
+ *   frame (BT.601, full range).
+ *
+ ****************************************************************************/
+
+static void fbcapture_writey4m(void)
+{
+  size_t npixels = (size_t)g_width * g_height;
+  uint8_t *plane;
+  uint8_t *rgb;
+  size_t i;
+  int r;
+  int g;
+  int b;
+  int p;
+
+  plane = (uint8_t *)malloc(npixels);
+  if (plane == NULL)
+    {
+      return;
+    }
+
+  (void)fputs("FRAME\n", g_y4mfile);
+
+  for (p = 0; p < 3; p++)
+    {
+      for (i = 0, rgb = g_rgb; i < npixels; i++, rgb += 3)
+        {
+          r = rgb[0];
+          g = rgb[1];
+          b = rgb[2];
+
+          switch (p)
+            {
+              case 0:
+                plane[i] = (77 * r + 150 * g + 29 * b + 128) >> 8;
+                break;
+
+              case 1:
+                plane[i] = (-43 * r - 85 * g + 128 * b + 32896) >> 8;
+                break;
+
+              default:
+                plane[i] = (128 * r - 107 * g - 21 * b + 32896) >> 8;
+                break;
+            }
+        }
+
+      (void)fwrite(plane, 1, npixels, g_y4mfile);
+    }
+
+  free(plane);
+  (void)fflush(g_y4mfile);
+}
+#endif
+
+/****************************************************************************
+ * Name: fbcapture_report
+ *
+ * Description:
+ *   Report the capture statistics when the simulation exits.
+ *
+ ****************************************************************************/
+
+static void fbcapture_report(void)
+{
+  uint64_t elapsed = fbcapture_gettime() - g_starttime;
+  double seconds = (double)elapsed / 1e9;
+
+  fprintf(stderr, "fbcapture: %ux%u %u bpp, %lu samples, %lu frames "
+          "in %.2f s (%.1f fps)\n",
+          g_width, g_height, g_bpp, g_nsamples, g_nframes, seconds,
+          seconds > 0 ? (double)g_nframes / seconds : 0.0);
+
+  if (g_nframes > 0)
+    {
+      fprintf(stderr, "fbcapture: %llu bytes changed/frame, "
+              "%llu bytes written/frame, last hash %016llx\n",
+              (unsigned long long)(g_changed / g_nframes),
+              (unsigned long long)(g_written / g_nframes),
+              (unsigned long long)g_lasthash);
+    }
+
+  if (g_hashfile != NULL)
+    {
+      (void)fclose(g_hashfile);
+    }
+
+#ifndef CONFIG_SIM_FBCAPTURE_PNG
+  if (g_y4mfile != NULL)
+    {
+      (void)fclose(g_y4mfile);
+    }
+#endif
+}
+
+static void fbcapture_atexit(void)
+{
+  (void)atexit(fbcapture_report);
+}
+
+/****************************************************************************
+ * Public Functions
+ ****************************************************************************/
+
+/****************************************************************************
+ * Name: fbcapture_initialize
+ *
+ * Description:
+ *   Start capturing the framebuffer at 'fbmem'.  Frame hashes are written
+ *   to <path>.hash and frames either to <path>.y4m or to periodic
+ *   <path>-NNNNNN.png snapshots.
+ *
+ ****************************************************************************/
+
+int fbcapture_initialize(const void *fbmem, unsigned int width,
+                         unsigned int height, unsigned int bpp,
+                         unsigned int stride)
+{
+  char path[256];
+
+  g_fbmem  = (const uint8_t *)fbmem;
+  g_width  = width;
+  g_height = height;
+  g_bpp    = bpp;
+  g_stride = stride;
+  g_rowlen = (width * bpp + 7) / 8;
+
+  g_shadow = (uint8_t *)calloc(height, stride);
+  g_rgb    = (uint8_t *)malloc((size_t)width * height * 3);
+  if (g_shadow == NULL || g_rgb == NULL)
+    {
+      return -1;
+    }
+
+  (void)snprintf(path, sizeof(path), "%s.hash", CONFIG_SIM_FBCAPTURE_PATH);
+  g_hashfile = fopen(path, "w");
+
+#ifndef CONFIG_SIM_FBCAPTURE_PNG
+  (void)snprintf(path, sizeof(path), "%s.y4m", CONFIG_SIM_FBCAPTURE_PATH);
+  g_y4mfile = fopen(path, "wb");
+  if (g_y4mfile != NULL)
+    {
+      fprintf(g_y4mfile, "YUV4MPEG2 W%u H%u F%u:1 Ip A1:1 C444\n",
+              width, height, CONFIG_SIM_FBCAPTURE_FPS);
+    }
+#endif
+
+  g_starttime = fbcapture_gettime();
+  (void)pthread_once(&g_fbcapture_once, fbcapture_atexit);
+  return 0;
+}
+
+/****************************************************************************
+ * Name: fbcapture_written
+ *
+ * Description:
+ *   Account for bytes written to the display by the LCD driver.
+ *
+ ****************************************************************************/
+
+void fbcapture_written(unsigned int nbytes)
+{
+  g_written += nbytes;
+}
+
+/****************************************************************************
+ * Name: fbcapture_update
+ *
+ * Description:
+ *   Called periodically from the IDLE loop.  At most
+ *   CONFIG_SIM_FBCAPTURE_FPS times per second, compare the framebuffer
+ *   with the last captured frame.  If it changed, hash and record it as a
+ *   new frame.
+ *
+ ****************************************************************************/
+
+void fbcapture_update(void)
+{
+  const uint8_t *fbrow;
+  uint8_t *shrow;
+  uint64_t changed = 0;
+  uint64_t hash = FNV_OFFSET;
+  uint64_t now;
+  unsigned int row;
+  unsigned int i;
+
+  if (g_shadow == NULL)
+    {
+      return;
+    }
+
+  now = fbcapture_gettime();
+  if (now - g_lastsample < FBCAPTURE_INTERVAL)
+    {
+      return;
+    }
+
+  g_lastsample = now;
+  g_nsamples++;
+
+  /* Count the bytes that changed since the last frame */
+
+  for (row = 0; row < g_height; row++)
+    {
+      fbrow = g_fbmem + row * g_stride;
+      shrow = g_shadow + row * g_stride;
+
+      if (memcmp(fbrow, shrow, g_rowlen) != 0)
+        {
+          for (i = 0; i < g_rowlen; i++)
+            {
+              changed += (fbrow[i] != shrow[i]);
+            }
+
+          memcpy(shrow, fbrow, g_rowlen);
+        }
+    }
+
+  if (changed == 0 && g_nframes > 0)
+    {
+      return;
+    }
+
+  /* Hash the visible part of the new frame */
+
+  for (row = 0; row < g_height; row++)
+    {
+      shrow = g_shadow + row * g_stride;
+      for (i = 0; i < g_rowlen; i++)
+        {
+          hash = (hash ^ shrow[i]) * FNV_PRIME;
+        }
+    }
+
+  g_changed += changed;
+  g_lasthash = hash;
+
+  if (g_hashfile != NULL)
+    {
+      fprintf(g_hashfile, "%lu %016llx\n", g_nframes,
+              (unsigned long long)hash);
+      (void)fflush(g_hashfile);
+    }
+
+#ifdef CONFIG_SIM_FBCAPTURE_PNG
+  if (g_nframes % CONFIG_SIM_FBCAPTURE_PNGINTERVAL == 0)
+    {
+      fbcapture_torgb();
+      fbcapture_writepng(g_nframes);
+    }
+#else
+  if (g_y4mfile != NULL)
+    {
+      fbcapture_torgb();
+      fbcapture_writey4m();
+    }
+#endif
+
+  g_nframes++;
+}
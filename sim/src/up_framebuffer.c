@@ -354,6 +354,9 @@ int up_fbinitialize(void)
   return up_x11initialize(CONFIG_SIM_FBWIDTH, CONFIG_SIM_FBHEIGHT,
                           &g_planeinfo.fbmem, &g_planeinfo.fblen,
                           &g_planeinfo.bpp, &g_planeinfo.stride);
+#elif defined(CONFIG_SIM_FBCAPTURE)
+  return fbcapture_initialize(g_fb, CONFIG_SIM_FBWIDTH, CONFIG_SIM_FBHEIGHT,
+                              CONFIG_SIM_FBBPP, FB_WIDTH) < 0 ? -ENOMEM : OK;
 #else
   return OK;
 #endif
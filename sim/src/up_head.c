@@ -73,6 +73,12 @@ static int g_exitcode = EXIT_SUCCESS;
 
 int main(int argc, char **argv, char **envp)
 {
+#ifdef CONFIG_SIM_HEAP_MMAP
+  /* Get the heap size from the command line */
+
+  sim_heap_args(argc, argv);
+#endif
+
 #ifdef CONFIG_SMP
   /* In the SMP case, configure the main thread as CPU 0 */
 
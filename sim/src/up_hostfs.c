@@ -52,6 +52,21 @@
 
 #include "hostfs.h"
 
+/****************************************************************************
+ * Host Domain Public Function Prototypes
+ ****************************************************************************/
+
+#ifdef CONFIG_SIM_HOSTFS_ASYNC
+int     hostfs_async_open(const char *pathname, int flags, int mode);
+int     hostfs_async_close(int fd);
+ssize_t hostfs_async_read(int fd, void *buf, size_t count);
+ssize_t hostfs_async_write(int fd, const void *buf, size_t count);
+off_t   hostfs_async_lseek(int fd, off_t offset, int whence);
+int     hostfs_async_dup(int fd);
+void    hostfs_async_sync(int fd);
+int     hostfs_async_stat(const char *path, struct stat *buf);
+#endif
+
 /****************************************************************************
  * Public Functions
  ****************************************************************************/
@@ -96,7 +111,11 @@ int host_open(const char *pathname, int flags, int mode)
       mapflags |= O_TRUNC;
     }
 
+#ifdef CONFIG_SIM_HOSTFS_ASYNC
+  return hostfs_async_open(pathname, mapflags, mode);
+#else
   return open(pathname, mapflags, mode);
+#endif
 }
 
 /****************************************************************************
@@ -105,9 +124,13 @@ int host_open(const char *pathname, int flags, int mode)
 
 int host_close(int fd)
 {
+#ifdef CONFIG_SIM_HOSTFS_ASYNC
+  return hostfs_async_close(fd);
+#else
   /* Just call the close routine */
 
   return close(fd);
+#endif
 }
 
 /****************************************************************************
@@ -116,9 +139,13 @@ int host_close(int fd)
 
 ssize_t host_read(int fd, void* buf, size_t count)
 {
+#ifdef CONFIG_SIM_HOSTFS_ASYNC
+  return hostfs_async_read(fd, buf, count);
+#else
   /* Just call the read routine */
 
   return read(fd, buf, count);
+#endif
 }
 
 /****************************************************************************
@@ -127,9 +154,13 @@ ssize_t host_read(int fd, void* buf, size_t count)
 
 ssize_t host_write(int fd, const void *buf, size_t count)
 {
+#ifdef CONFIG_SIM_HOSTFS_ASYNC
+  return hostfs_async_write(fd, buf, count);
+#else
   /* Just call the write routine */
 
   return write(fd, buf, count);
+#endif
 }
 
 /****************************************************************************
@@ -138,9 +169,13 @@ ssize_t host_write(int fd, const void *buf, size_t count)
 
 off_t host_lseek(int fd, off_t offset, int whence)
 {
+#ifdef CONFIG_SIM_HOSTFS_ASYNC
+  return hostfs_async_lseek(fd, offset, whence);
+#else
   /* Just call the lseek routine */
 
   return lseek(fd, offset, whence);
+#endif
 }
 
 /****************************************************************************
@@ -160,9 +195,13 @@ int host_ioctl(int fd, int request, unsigned long arg)
 
 void host_sync(int fd)
 {
+#ifdef CONFIG_SIM_HOSTFS_ASYNC
+  hostfs_async_sync(fd);
+#else
   /* Just call the sync routine */
 
   sync();
+#endif
 }
 
 /****************************************************************************
@@ -171,7 +210,11 @@ void host_sync(int fd)
 
 int host_dup(int fd)
 {
+#ifdef CONFIG_SIM_HOSTFS_ASYNC
+  return hostfs_async_dup(fd);
+#else
   return dup(fd);
+#endif
 }
 
 /****************************************************************************
@@ -328,7 +371,11 @@ int host_stat(const char *path, struct host_stat_s *buf)
 
   /* Call the host's stat routine */
 
+#ifdef CONFIG_SIM_HOSTFS_ASYNC
+  ret = hostfs_async_stat(path, &host_buf);
+#else
   ret = stat(path, &host_buf);
+#endif
 
   /* Now map the return values to the common struct */
 
@@ -0,0 +1,1348 @@
+/****************************************************************************
+ * arch/sim/src/up_hostfsasync.c
+ *
+ *   Copyright (C) 2016 Gregory Nutt. All rights reserved.
+ *   Author: Gregory Nutt <gnutt@nuttx.org>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name NuttX nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************/
+
+/****************************************************************************
+ * Included Files
+ ****************************************************************************/
+
+#define _GNU_SOURCE 1
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/uio.h>
+#include <sys/syscall.h>
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <pthread.h>
+#include <unistd.h>
+
+#ifdef CONFIG_SIM_HOSTFS_IOURING
+#  include <linux/io_uring.h>
+#endif
+
+/****************************************************************************
+ * Pre-processor Definitions
+ ****************************************************************************/
+
+#ifndef CONFIG_SIM_HOSTFS_NTHREADS
+#  define CONFIG_SIM_HOSTFS_NTHREADS 2
+#endif
+
+/* Size of the readahead and write coalescing buffers */
+
+#ifndef CONFIG_SIM_HOSTFS_BUFSIZE
+#  define CONFIG_SIM_HOSTFS_BUFSIZE 65536
+#endif
+
+#define HOSTFS_BUFSIZE  CONFIG_SIM_HOSTFS_BUFSIZE
+
+/* Only host file descriptors below this value are buffered */
+
+#define HOSTFS_MAXFD    256
+
+/* Number of io_uring submission queue entries */
+
+#define HOSTFS_NURING   64
+
+/* Request states.  A value >= 0 is the wait slot of the NuttX task that is
+ * waiting for the request to complete.
+ */
+
+#define HOSTFS_PENDING  -1
+#define HOSTFS_DONE     -2
+
+/****************************************************************************
+ * Private Types
+ ****************************************************************************/
+
+enum hostfs_op_e
+{
+  HOSTFS_OP_OPEN = 0,
+  HOSTFS_OP_CLOSE,
+  HOSTFS_OP_READ,
+  HOSTFS_OP_WRITE,
+  HOSTFS_OP_PREAD,
+  HOSTFS_OP_PWRITE,
+  HOSTFS_OP_STAT,
+  HOSTFS_OP_SYNC
+};
+
+/* One host I/O request.  Synchronous requests live on the stack of the
+ * calling NuttX task, which is blocked until the request completes.
+ */
+
+struct hostfs_req_s
+{
+  struct hostfs_req_s *flink;    /* Work queue link */
+  volatile int state;            /* HOSTFS_PENDING, HOSTFS_DONE or slot */
+  uint8_t op;                    /* See enum hostfs_op_e */
+  bool regular;                  /* OPEN: a regular file was opened */
+  int fd;                        /* File descriptor */
+  int flags;                     /* OPEN: Open flags */
+  int mode;                      /* OPEN: Creation mode */
+  const char *path;              /* OPEN, STAT: Path */
+  struct stat *st;               /* STAT: Returned status */
+  struct iovec iov;              /* READ, WRITE: Buffer */
+  off_t offset;                  /* PREAD, PWRITE: File offset */
+  ssize_t result;                /* Result of the system call */
+  int errcode;                   /* errno value if result < 0 */
+};
+
+/* A readahead buffer */
+
+struct hostfs_rabuf_s
+{
+  struct hostfs_req_s req;       /* Fill request */
+  uint8_t *data;                 /* Buffered data */
+  off_t offset;                  /* File offset of data[0], -1 if empty */
+  size_t len;                    /* Number of valid bytes */
+  bool pending;                  /* Fill request not yet collected */
+};
+
+/* Buffering state of one open regular file.  Because data is buffered,
+ * the file position is kept here and transfers use pread() and pwrite().
+ * Descriptors of the same host file are kept coherent with each other by
+ * way of the device and inode numbers.
+ */
+
+struct hostfs_file_s
+{
+  dev_t dev;                     /* Host device of the file */
+  ino_t ino;                     /* Host inode of the file */
+  int errcode;                   /* errno of a failed deferred write */
+  off_t pos;                     /* Current file position */
+  off_t lastend;                 /* End of the last read from the host */
+  struct hostfs_rabuf_s ra[2];   /* Current and prefetched readahead */
+  uint8_t *wbuf;                 /* Coalesced write data */
+  off_t woffset;                 /* File offset of wbuf[0] */
+  size_t wlen;                   /* Number of bytes in wbuf */
+};
+
+#ifdef CONFIG_SIM_HOSTFS_IOURING
+struct hostfs_uring_s
+{
+  int fd;                        /* io_uring file descriptor */
+  unsigned int entries;          /* Number of submission queue entries */
+  unsigned int *sqhead;          /* Submission queue ring */
+  unsigned int *sqtail;
+  unsigned int *sqmask;
+  unsigned int *sqarray;
+  struct io_uring_sqe *sqes;
+  unsigned int *cqhead;          /* Completion queue ring */
+  unsigned int *cqtail;
+  unsigned int *cqmask;
+  struct io_uring_cqe *cqes;
+  volatile unsigned int inflight; /* Requests submitted to the ring */
+  pthread_mutex_t lock;          /* Serializes submissions */
+};
+#endif
+
+/****************************************************************************
+ * NuttX Domain Public Function Prototypes
+ ****************************************************************************/
+
+void simhostfs_initialize(void);
+int  simhostfs_getslot(void);
+void simhostfs_putslot(int slot);
+void simhostfs_wait(int slot);
+
+/****************************************************************************
+ * Host Domain Public Function Prototypes
+ ****************************************************************************/
+
+#ifdef CONFIG_SIM_HOSTTIMER
+void host_idle_wakeup(void);
+#endif
+
+/****************************************************************************
+ * Public Data
+ ****************************************************************************/
+
+/* Bit set of wait slots whose requests have completed.  Polled from the
+ * IDLE loop.
+ */
+
+volatile uint32_t g_hostfs_completed;
+
+/****************************************************************************
+ * Private Data
+ ****************************************************************************/
+
+static pthread_once_t g_hostfs_once = PTHREAD_ONCE_INIT;
+
+/* Work queue served by the I/O threads */
+
+static pthread_mutex_t g_hostfs_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t g_hostfs_cond = PTHREAD_COND_INITIALIZER;
+static struct hostfs_req_s *g_hostfs_head;
+static struct hostfs_req_s *g_hostfs_tail;
+
+/* Buffering state, indexed by the host file descriptor */
+
+static struct hostfs_file_s *g_hostfs_files[HOSTFS_MAXFD];
+
+#ifdef CONFIG_SIM_HOSTFS_IOURING
+static struct hostfs_uring_s g_uring =
+{
+  .fd   = -1,
+  .lock = PTHREAD_MUTEX_INITIALIZER
+};
+#endif
+
+/****************************************************************************
+ * Private Functions
+ ****************************************************************************/
+
+/****************************************************************************
+ * Name: hostfs_complete
+ *
+ * Description:
+ *   Mark a request as complete and wake up the NuttX task waiting for it,
+ *   if any.  Called from the I/O threads.
+ *
+ ****************************************************************************/
+
+static void hostfs_complete(struct hostfs_req_s *req)
+{
+  int slot;
+
+  slot = __atomic_exchange_n(&req->state, HOSTFS_DONE, __ATOMIC_ACQ_REL);
+  if (slot >= 0)
+    {
+      __atomic_fetch_or(&g_hostfs_completed, 1u << slot, __ATOMIC_RELEASE);
+#ifdef CONFIG_SIM_HOSTTIMER
+      host_idle_wakeup();
+#endif
+    }
+}
+
+/****************************************************************************
+ * Name: hostfs_execute
+ *
+ * Description:
+ *   Perform one request with a blocking system call.
+ *
+ ****************************************************************************/
+
+static void hostfs_execute(struct hostfs_req_s *req)
+{
+  struct stat buf;
+  ssize_t ret;
+
+  switch (req->op)
+    {
+      case HOSTFS_OP_OPEN:
+        ret = open(req->path, req->flags, req->mode);
+        if (ret >= 0)
+          {
+            req->regular = fstat(ret, &buf) == 0 && S_ISREG(buf.st_mode);
+          }
+        break;
+
+      case HOSTFS_OP_CLOSE:
+        ret = close(req->fd);
+        break;
+
+      case HOSTFS_OP_READ:
+        ret = read(req->fd, req->iov.iov_base, req->iov.iov_len);
+        break;
+
+      case HOSTFS_OP_WRITE:
+        ret = write(req->fd, req->iov.iov_base, req->iov.iov_len);
+        break;
+
+      case HOSTFS_OP_PREAD:
+        ret = pread(req->fd, req->iov.iov_base, req->iov.iov_len,
+                    req->offset);
+        break;
+
+      case HOSTFS_OP_PWRITE:
+        ret = pwrite(req->fd, req->iov.iov_base, req->iov.iov_len,
+                     req->offset);
+        break;
+
+      case HOSTFS_OP_STAT:
+        ret = stat(req->path, req->st);
+        break;
+
+      case HOSTFS_OP_SYNC:
+        sync();
+        ret = 0;
+        break;
+
+      default:
+        ret   = -1;
+        errno = EINVAL;
+        break;
+    }
+
+  req->result  = ret;
+  req->errcode = ret < 0 ? errno : 0;
+}
+
+/****************************************************************************
+ * Name: hostfs_worker
+ *
+ * Description:
+ *   I/O thread.  Perform queued requests until the simulation exits.
+ *
+ ****************************************************************************/
+
+static void *hostfs_worker(void *arg)
+{
+  struct hostfs_req_s *req;
+
+  for (; ; )
+    {
+      pthread_mutex_lock(&g_hostfs_lock);
+      while (g_hostfs_head == NULL)
+        {
+          pthread_cond_wait(&g_hostfs_cond, &g_hostfs_lock);
+        }
+
+      req           = g_hostfs_head;
+      g_hostfs_head = req->flink;
+      if (g_hostfs_head == NULL)
+        {
+          g_hostfs_tail = NULL;
+        }
+
+      pthread_mutex_unlock(&g_hostfs_lock);
+
+      hostfs_execute(req);
+      hostfs_complete(req);
+    }
+
+  return NULL;
+}
+
+#ifdef CONFIG_SIM_HOSTFS_IOURING
+/****************************************************************************
+ * Name: hostfs_uring_setup
+ *
+ * Description:
+ *   Create the io_uring used for reads and writes of regular files.  This
+ *   fails harmlessly on hosts whose kernel does not support io_uring or
+ *   does not permit it; the I/O threads are used instead.
+ *
+ ****************************************************************************/
+
+static int hostfs_uring_setup(void)
+{
+  struct io_uring_params params;
+  size_t sqlen;
+  size_t cqlen;
+  uint8_t *sq;
+  uint8_t *cq;
+  int fd;
+
+  memset(&params, 0, sizeof(params));
+  fd = syscall(__NR_io_uring_setup, HOSTFS_NURING, &params);
+  if (fd < 0)
+    {
+      return -1;
+    }
+
+  sqlen = params.sq_off.array + params.sq_entries * sizeof(unsigned int);
+  cqlen = params.cq_off.cqes +
+          params.cq_entries * sizeof(struct io_uring_cqe);
+
+  if ((params.features & IORING_FEAT_SINGLE_MMAP) != 0)
+    {
+      sqlen = sqlen > cqlen ? sqlen : cqlen;
+    }
+
+  sq = mmap(NULL, sqlen, PROT_READ | PROT_WRITE,
+            MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+  if (sq == MAP_FAILED)
+    {
+      goto errout;
+    }
+
+  if ((params.features & IORING_FEAT_SINGLE_MMAP) != 0)
+    {
+      cq = sq;
+    }
+  else
+    {
+      cq = mmap(NULL, cqlen, PROT_READ | PROT_WRITE,
+                MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+      if (cq == MAP_FAILED)
+        {
+          goto errout;
+        }
+    }
+
+  g_uring.sqes = mmap(NULL, params.sq_entries * sizeof(struct io_uring_sqe),
+                      PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                      fd, IORING_OFF_SQES);
+  if (g_uring.sqes == MAP_FAILED)
+    {
+      goto errout;
+    }
+
+  g_uring.entries = params.sq_entries;
+  g_uring.sqhead  = (unsigned int *)(sq + params.sq_off.head);
+  g_uring.sqtail  = (unsigned int *)(sq + params.sq_off.tail);
+  g_uring.sqmask  = (unsigned int *)(sq + params.sq_off.ring_mask);
+  g_uring.sqarray = (unsigned int *)(sq + params.sq_off.array);
+  g_uring.cqhead  = (unsigned int *)(cq + params.cq_off.head);
+  g_uring.cqtail  = (unsigned int *)(cq + params.cq_off.tail);
+  g_uring.cqmask  = (unsigned int *)(cq + params.cq_off.ring_mask);
+  g_uring.cqes    = (struct io_uring_cqe *)(cq + params.cq_off.cqes);
+  g_uring.fd      = fd;
+  return 0;
+
+errout:
+  (void)close(fd);
+  return -1;
+}
+
+/****************************************************************************
+ * Name: hostfs_uring_reaper
+ *
+ * Description:
+ *   Wait for io_uring completions and complete the matching requests.
+ *
+ ****************************************************************************/
+
+static void *hostfs_uring_reaper(void *arg)
+{
+  struct hostfs_req_s *req;
+  struct io_uring_cqe *cqe;
+  unsigned int head;
+  unsigned int tail;
+
+  for (; ; )
+    {
+      (void)syscall(__NR_io_uring_enter, g_uring.fd, 0, 1,
+                    IORING_ENTER_GETEVENTS, NULL, 0);
+
+      head = *g_uring.cqhead;
+      tail = __atomic_load_n(g_uring.cqtail, __ATOMIC_ACQUIRE);
+
+      while (head != tail)
+        {
+          cqe = &g_uring.cqes[head & *g_uring.cqmask];
+          req = (struct hostfs_req_s *)(uintptr_t)cqe->user_data;
+
+          req->result  = cqe->res < 0 ? -1 : cqe->res;
+          req->errcode = cqe->res < 0 ? -cqe->res : 0;
+
+          head++;
+          __atomic_store_n(g_uring.cqhead, head, __ATOMIC_RELEASE);
+          __atomic_fetch_sub(&g_uring.inflight, 1, __ATOMIC_RELAXED);
+
+          hostfs_complete(req);
+        }
+    }
+
+  return NULL;
+}
+
+/****************************************************************************
+ * Name: hostfs_uring_submit
+ *
+ * Description:
+ *   Submit a PREAD or PWRITE request to the io_uring.  Returns -1 if the
+ *   ring is not available or is full.
+ *
+ ****************************************************************************/
+
+static int hostfs_uring_submit(struct hostfs_req_s *req)
+{
+  struct io_uring_sqe *sqe;
+  unsigned int head;
+  unsigned int tail;
+  unsigned int index;
+
+  /* Never have more requests in flight than the ring has entries, so that
+   * the completion queue cannot overflow.
+   */
+
+  if (g_uring.fd < 0 ||
+      __atomic_add_fetch(&g_uring.inflight, 1, __ATOMIC_RELAXED) >
+      g_uring.entries)
+    {
+      if (g_uring.fd >= 0)
+        {
+          __atomic_fetch_sub(&g_uring.inflight, 1, __ATOMIC_RELAXED);
+        }
+
+      return -1;
+    }
+
+  pthread_mutex_lock(&g_uring.lock);
+
+  tail  = *g_uring.sqtail;
+  index = tail & *g_uring.sqmask;
+  sqe   = &g_uring.sqes[index];
+
+  memset(sqe, 0, sizeof(*sqe));
+  sqe->opcode    = req->op == HOSTFS_OP_PREAD ?
+                   IORING_OP_READV : IORING_OP_WRITEV;
+  sqe->fd        = req->fd;
+  sqe->addr      = (uintptr_t)&req->iov;
+  sqe->len       = 1;
+  sqe->off       = req->offset;
+  sqe->user_data = (uintptr_t)req;
+
+  g_uring.sqarray[index] = index;
+  __atomic_store_n(g_uring.sqtail, tail + 1, __ATOMIC_RELEASE);
+
+  /* Submit everything that the kernel has not consumed yet */
+
+  head = __atomic_load_n(g_uring.sqhead, __ATOMIC_ACQUIRE);
+  (void)syscall(__NR_io_uring_enter, g_uring.fd, tail + 1 - head, 0, 0,
+                NULL, 0);
+
+  pthread_mutex_unlock(&g_uring.lock);
+  return 0;
+}
+#endif
+
+/****************************************************************************
+ * Name: hostfs_setup
+ *
+ * Description:
+ *   Start the I/O threads and the io_uring on first use.
+ *
+ ****************************************************************************/
+
+static void hostfs_setup(void)
+{
+  pthread_t thread;
+  int i;
+
+  simhostfs_initialize();
+
+#ifdef CONFIG_SIM_HOSTFS_IOURING
+  if (hostfs_uring_setup() == 0)
+    {
+      if (pthread_create(&thread, NULL, hostfs_uring_reaper, NULL) != 0)
+        {
+          (void)close(g_uring.fd);
+          g_uring.fd = -1;
+        }
+    }
+#endif
+
+  for (i = 0; i < CONFIG_SIM_HOSTFS_NTHREADS; i++)
+    {
+      (void)pthread_create(&thread, NULL, hostfs_worker, NULL);
+    }
+}
+
+/****************************************************************************
+ * Name: hostfs_submit
+ *
+ * Description:
+ *   Start a request without waiting for it to complete.
+ *
+ ****************************************************************************/
+
+static void hostfs_submit(struct hostfs_req_s *req)
+{
+  (void)pthread_once(&g_hostfs_once, hostfs_setup);
+
+  req->state = HOSTFS_PENDING;
+  req->flink = NULL;
+
+#ifdef CONFIG_SIM_HOSTFS_IOURING
+  if ((req->op == HOSTFS_OP_PREAD || req->op == HOSTFS_OP_PWRITE) &&
+      hostfs_uring_submit(req) == 0)
+    {
+      return;
+    }
+#endif
+
+  pthread_mutex_lock(&g_hostfs_lock);
+  if (g_hostfs_tail == NULL)
+    {
+      g_hostfs_head = req;
+    }
+  else
+    {
+      g_hostfs_tail->flink = req;
+    }
+
+  g_hostfs_tail = req;
+  pthread_cond_signal(&g_hostfs_cond);
+  pthread_mutex_unlock(&g_hostfs_lock);
+}
+
+/****************************************************************************
+ * Name: hostfs_wait
+ *
+ * Description:
+ *   Block the calling NuttX task until a request completes, letting other
+ *   NuttX tasks run in the meantime.  Returns the result of the request
+ *   with errno set on failure.
+ *
+ ****************************************************************************/
+
+static ssize_t hostfs_wait(struct hostfs_req_s *req)
+{
+  int expected = HOSTFS_PENDING;
+  int slot;
+
+  if (__atomic_load_n(&req->state, __ATOMIC_ACQUIRE) != HOSTFS_DONE)
+    {
+      /* Attach a wait slot to the request.  If the request completes
+       * first, there is nothing to wait for.
+       */
+
+      slot = simhostfs_getslot();
+      if (__atomic_compare_exchange_n(&req->state, &expected, slot, false,
+                                      __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+        {
+          simhostfs_wait(slot);
+        }
+
+      simhostfs_putslot(slot);
+      __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    }
+
+  if (req->result < 0)
+    {
+      errno = req->errcode;
+    }
+
+  return req->result;
+}
+
+/****************************************************************************
+ * Name: hostfs_transfer
+ *
+ * Description:
+ *   Perform a synchronous read or write request.
+ *
+ ****************************************************************************/
+
+static ssize_t hostfs_transfer(int op, int fd, void *buf, size_t count,
+                               off_t offset)
+{
+  struct hostfs_req_s req;
+
+  req.op           = op;
+  req.fd           = fd;
+  req.iov.iov_base = buf;
+  req.iov.iov_len  = count;
+  req.offset       = offset;
+
+  hostfs_submit(&req);
+  return hostfs_wait(&req);
+}
+
+/****************************************************************************
+ * Name: hostfs_collect
+ *
+ * Description:
+ *   Collect the result of the fill request of a readahead buffer.
+ *
+ ****************************************************************************/
+
+static void hostfs_collect(struct hostfs_rabuf_s *ra)
+{
+  ssize_t nread;
+
+  if (ra->pending)
+    {
+      ra->pending = false;
+      nread       = hostfs_wait(&ra->req);
+      if (nread < 0)
+        {
+          ra->offset = -1;
+          ra->len    = 0;
+        }
+      else
+        {
+          ra->len    = nread;
+        }
+    }
+}
+
+/****************************************************************************
+ * Name: hostfs_fill
+ *
+ * Description:
+ *   Start filling a readahead buffer from the given file offset.
+ *
+ ****************************************************************************/
+
+static void hostfs_fill(int fd, struct hostfs_rabuf_s *ra, off_t offset)
+{
+  hostfs_collect(ra);
+
+  ra->offset           = offset;
+  ra->len              = 0;
+  ra->pending          = true;
+  ra->req.op           = HOSTFS_OP_PREAD;
+  ra->req.fd           = fd;
+  ra->req.iov.iov_base = ra->data;
+  ra->req.iov.iov_len  = HOSTFS_BUFSIZE;
+  ra->req.offset       = offset;
+
+  hostfs_submit(&ra->req);
+}
+
+/****************************************************************************
+ * Name: hostfs_invalidate
+ *
+ * Description:
+ *   Discard all readahead data of a file.
+ *
+ ****************************************************************************/
+
+static void hostfs_invalidate(struct hostfs_file_s *file)
+{
+  int i;
+
+  for (i = 0; i < 2; i++)
+    {
+      hostfs_collect(&file->ra[i]);
+      file->ra[i].offset = -1;
+      file->ra[i].len    = 0;
+    }
+}
+
+/****************************************************************************
+ * Name: hostfs_invalidateothers
+ *
+ * Description:
+ *   Discard the readahead data of all other descriptors of the same host
+ *   file after it has been written.
+ *
+ ****************************************************************************/
+
+static void hostfs_invalidateothers(struct hostfs_file_s *file)
+{
+  struct hostfs_file_s *other;
+  int fd;
+
+  for (fd = 0; fd < HOSTFS_MAXFD; fd++)
+    {
+      other = g_hostfs_files[fd];
+      if (other != NULL && other != file && other->dev == file->dev &&
+          other->ino == file->ino)
+        {
+          hostfs_invalidate(other);
+        }
+    }
+}
+
+/****************************************************************************
+ * Name: hostfs_flush
+ *
+ * Description:
+ *   Write out coalesced write data.  If the host write fails, the data
+ *   that was not written is kept and the error is remembered so that the
+ *   next operation on the same descriptor retries the write and fails if
+ *   it fails again.
+ *
+ ****************************************************************************/
+
+static int hostfs_flush(int fd, struct hostfs_file_s *file)
+{
+  ssize_t nwritten;
+  size_t done = 0;
+
+  if (file->wlen == 0)
+    {
+      return 0;
+    }
+
+  hostfs_invalidate(file);
+
+  while (done < file->wlen)
+    {
+      nwritten = hostfs_transfer(HOSTFS_OP_PWRITE, fd, file->wbuf + done,
+                                 file->wlen - done, file->woffset + done);
+      if (nwritten <= 0)
+        {
+          if (nwritten == 0)
+            {
+              errno = EIO;
+            }
+
+          file->errcode = errno;
+          break;
+        }
+
+      done += nwritten;
+    }
+
+  if (done > 0)
+    {
+      hostfs_invalidateothers(file);
+    }
+
+  if (done < file->wlen)
+    {
+      memmove(file->wbuf, file->wbuf + done, file->wlen - done);
+      file->woffset += done;
+      file->wlen    -= done;
+      errno          = file->errcode;
+      return -1;
+    }
+
+  file->wlen    = 0;
+  file->errcode = 0;
+  return 0;
+}
+
+/****************************************************************************
+ * Name: hostfs_flushothers
+ *
+ * Description:
+ *   Write out the coalesced write data of all other descriptors of the
+ *   same host file before it is read or written through this one.  A
+ *   failure is reported by the descriptor that owns the data.
+ *
+ ****************************************************************************/
+
+static void hostfs_flushothers(struct hostfs_file_s *file)
+{
+  struct hostfs_file_s *other;
+  int fd;
+
+  for (fd = 0; fd < HOSTFS_MAXFD; fd++)
+    {
+      other = g_hostfs_files[fd];
+      if (other != NULL && other != file && other->dev == file->dev &&
+          other->ino == file->ino)
+        {
+          (void)hostfs_flush(fd, other);
+        }
+    }
+}
+
+/****************************************************************************
+ * Name: hostfs_flushall
+ *
+ * Description:
+ *   Write out coalesced write data of all files so that the host sees
+ *   their current sizes.
+ *
+ ****************************************************************************/
+
+static void hostfs_flushall(void)
+{
+  int fd;
+
+  for (fd = 0; fd < HOSTFS_MAXFD; fd++)
+    {
+      if (g_hostfs_files[fd] != NULL)
+        {
+          (void)hostfs_flush(fd, g_hostfs_files[fd]);
+        }
+    }
+}
+
+/****************************************************************************
+ * Name: hostfs_lookup
+ ****************************************************************************/
+
+static struct hostfs_file_s *hostfs_lookup(int fd)
+{
+  return fd >= 0 && fd < HOSTFS_MAXFD ? g_hostfs_files[fd] : NULL;
+}
+
+/****************************************************************************
+ * Name: hostfs_attach
+ *
+ * Description:
+ *   Allocate the buffering state for a newly opened regular file.  If
+ *   memory is not available, the file is simply not buffered.
+ *
+ ****************************************************************************/
+
+static void hostfs_attach(int fd, off_t pos)
+{
+  struct hostfs_file_s *file;
+  struct stat st;
+
+  if (fd < 0 || fd >= HOSTFS_MAXFD || fstat(fd, &st) < 0)
+    {
+      return;
+    }
+
+  file = (struct hostfs_file_s *)calloc(1, sizeof(struct hostfs_file_s));
+  if (file == NULL)
+    {
+      return;
+    }
+
+  file->wbuf       = (uint8_t *)malloc(HOSTFS_BUFSIZE);
+  file->ra[0].data = (uint8_t *)malloc(HOSTFS_BUFSIZE);
+  file->ra[1].data = (uint8_t *)malloc(HOSTFS_BUFSIZE);
+
+  if (file->wbuf == NULL || file->ra[0].data == NULL ||
+      file->ra[1].data == NULL)
+    {
+      free(file->wbuf);
+      free(file->ra[0].data);
+      free(file->ra[1].data);
+      free(file);
+      return;
+    }
+
+  file->dev          = st.st_dev;
+  file->ino          = st.st_ino;
+  file->pos          = pos;
+  file->lastend      = -1;
+  file->ra[0].offset = -1;
+  file->ra[1].offset = -1;
+  g_hostfs_files[fd] = file;
+}
+
+/****************************************************************************
+ * Name: hostfs_detach
+ ****************************************************************************/
+
+static void hostfs_detach(int fd, struct hostfs_file_s *file)
+{
+  hostfs_invalidate(file);
+
+  free(file->wbuf);
+  free(file->ra[0].data);
+  free(file->ra[1].data);
+  free(file);
+  g_hostfs_files[fd] = NULL;
+}
+
+/****************************************************************************
+ * Public Functions
+ ****************************************************************************/
+
+/****************************************************************************
+ * Name: hostfs_async_open
+ ****************************************************************************/
+
+int hostfs_async_open(const char *pathname, int flags, int mode)
+{
+  struct hostfs_req_s req;
+  int fd;
+
+  req.op    = HOSTFS_OP_OPEN;
+  req.path  = pathname;
+  req.flags = flags;
+  req.mode  = mode;
+
+  hostfs_submit(&req);
+  fd = hostfs_wait(&req);
+
+  /* Files opened for appending are not buffered because their file
+   * position is decided by the host.
+   */
+
+  if (fd >= 0 && req.regular && (flags & O_APPEND) == 0)
+    {
+      hostfs_attach(fd, 0);
+    }
+
+  return fd;
+}
+
+/****************************************************************************
+ * Name: hostfs_async_close
+ ****************************************************************************/
+
+int hostfs_async_close(int fd)
+{
+  struct hostfs_req_s req;
+  struct hostfs_file_s *file;
+  int ret = 0;
+
+  file = hostfs_lookup(fd);
+  if (file != NULL)
+    {
+      ret = hostfs_flush(fd, file);
+      hostfs_detach(fd, file);
+    }
+
+  req.op = HOSTFS_OP_CLOSE;
+  req.fd = fd;
+
+  hostfs_submit(&req);
+  if (hostfs_wait(&req) < 0)
+    {
+      ret = -1;
+    }
+
+  return ret;
+}
+
+/****************************************************************************
+ * Name: hostfs_async_read
+ *
+ * Description:
+ *   Read from a file.  Buffered files are read through a pair of readahead
+ *   buffers.  When a read continues where the previous read from the host
+ *   ended, the next buffer is prefetched while the data already read is
+ *   consumed.
+ *
+ ****************************************************************************/
+
+ssize_t hostfs_async_read(int fd, void *buf, size_t count)
+{
+  struct hostfs_file_s *file;
+  struct hostfs_rabuf_s *ra;
+  struct hostfs_rabuf_s tmp;
+  uint8_t *dest = (uint8_t *)buf;
+  ssize_t nread = 0;
+  ssize_t ret;
+  bool sequential;
+  size_t avail;
+  size_t ncopy;
+  int i;
+
+  file = hostfs_lookup(fd);
+  if (file == NULL)
+    {
+      return hostfs_transfer(HOSTFS_OP_READ, fd, buf, count, 0);
+    }
+
+  hostfs_flushothers(file);
+  if (hostfs_flush(fd, file) < 0)
+    {
+      return -1;
+    }
+
+  while (count > 0)
+    {
+      /* Look for the file position in the readahead buffers.  Wait for a
+       * pending fill if it covers the file position.
+       */
+
+      ra = NULL;
+      for (i = 0; i < 2; i++)
+        {
+          if (file->ra[i].offset >= 0 && file->pos >= file->ra[i].offset &&
+              file->pos < file->ra[i].offset + HOSTFS_BUFSIZE)
+            {
+              hostfs_collect(&file->ra[i]);
+              if (file->ra[i].offset >= 0 &&
+                  file->pos < file->ra[i].offset + (off_t)file->ra[i].len)
+                {
+                  ra = &file->ra[i];
+                }
+
+              break;
+            }
+        }
+
+      if (ra != NULL)
+        {
+          avail = ra->offset + ra->len - file->pos;
+          ncopy = count < avail ? count : avail;
+          memcpy(dest, ra->data + (file->pos - ra->offset), ncopy);
+
+          dest      += ncopy;
+          count     -= ncopy;
+          nread     += ncopy;
+          file->pos += ncopy;
+
+          /* Once reading moves into the prefetched buffer, make it the
+           * current buffer and prefetch the one after it.
+           */
+
+          if (ra == &file->ra[1])
+            {
+              tmp         = file->ra[0];
+              file->ra[0] = file->ra[1];
+              file->ra[1] = tmp;
+
+              if (file->ra[0].len == HOSTFS_BUFSIZE)
+                {
+                  hostfs_fill(fd, &file->ra[1],
+                              file->ra[0].offset + HOSTFS_BUFSIZE);
+                  file->lastend = file->ra[1].offset + HOSTFS_BUFSIZE;
+                }
+            }
+
+          continue;
+        }
+
+      /* A miss.  Is this a continuation of the previous read? */
+
+      sequential = file->pos == file->lastend || file->pos == 0;
+
+      if (count >= HOSTFS_BUFSIZE)
+        {
+          /* Large reads go directly to the caller's buffer */
+
+          ret = hostfs_transfer(HOSTFS_OP_PREAD, fd, dest, count,
+                                file->pos);
+          if (ret > 0)
+            {
+              nread        += ret;
+              file->pos    += ret;
+              file->lastend = file->pos;
+            }
+          else if (nread == 0)
+            {
+              return ret;
+            }
+
+          break;
+        }
+
+      /* Fill the current buffer and wait for it */
+
+      hostfs_fill(fd, &file->ra[0], file->pos);
+      hostfs_collect(&file->ra[0]);
+      file->lastend = file->pos + file->ra[0].len;
+
+      if (file->ra[0].offset < 0)
+        {
+          /* Read error */
+
+          if (nread == 0)
+            {
+              errno = file->ra[0].req.errcode;
+              return -1;
+            }
+
+          break;
+        }
+
+      if (file->ra[0].len == 0)
+        {
+          /* End of file */
+
+          break;
+        }
+
+      /* Sequential access: prefetch the next buffer */
+
+      if (sequential && file->ra[0].len == HOSTFS_BUFSIZE)
+        {
+          hostfs_fill(fd, &file->ra[1], file->pos + HOSTFS_BUFSIZE);
+          file->lastend = file->ra[1].offset + HOSTFS_BUFSIZE;
+        }
+    }
+
+  return nread;
+}
+
+/****************************************************************************
+ * Name: hostfs_async_write
+ *
+ * Description:
+ *   Write to a file.  Small sequential writes to buffered files are
+ *   collected and written to the host as one transfer.
+ *
+ ****************************************************************************/
+
+ssize_t hostfs_async_write(int fd, const void *buf, size_t count)
+{
+  struct hostfs_file_s *file;
+  ssize_t ret;
+
+  file = hostfs_lookup(fd);
+  if (file == NULL)
+    {
+      return hostfs_transfer(HOSTFS_OP_WRITE, fd, (void *)buf, count, 0);
+    }
+
+  hostfs_flushothers(file);
+
+  /* Write out the buffered data unless the new data directly follows it
+   * and fits.  Retry a failed earlier write first.
+   */
+
+  if (file->wlen > 0 &&
+      (file->errcode != 0 ||
+       file->pos != file->woffset + (off_t)file->wlen ||
+       file->wlen + count > HOSTFS_BUFSIZE))
+    {
+      if (hostfs_flush(fd, file) < 0)
+        {
+          return -1;
+        }
+    }
+
+  if (count >= HOSTFS_BUFSIZE)
+    {
+      hostfs_invalidate(file);
+      ret = hostfs_transfer(HOSTFS_OP_PWRITE, fd, (void *)buf, count,
+                            file->pos);
+      if (ret > 0)
+        {
+          hostfs_invalidateothers(file);
+          file->pos += ret;
+        }
+
+      return ret;
+    }
+
+  if (file->wlen == 0)
+    {
+      file->woffset = file->pos;
+    }
+
+  memcpy(file->wbuf + file->wlen, buf, count);
+  file->wlen += count;
+  file->pos  += count;
+  return count;
+}
+
+/****************************************************************************
+ * Name: hostfs_async_lseek
+ ****************************************************************************/
+
+off_t hostfs_async_lseek(int fd, off_t offset, int whence)
+{
+  struct hostfs_file_s *file;
+  off_t pos;
+
+  file = hostfs_lookup(fd);
+  if (file == NULL)
+    {
+      return lseek(fd, offset, whence);
+    }
+
+  hostfs_flushothers(file);
+  if (hostfs_flush(fd, file) < 0)
+    {
+      return -1;
+    }
+
+  switch (whence)
+    {
+      case SEEK_SET:
+        pos = offset;
+        break;
+
+      case SEEK_CUR:
+        pos = file->pos + offset;
+        break;
+
+      case SEEK_END:
+        pos = lseek(fd, offset, SEEK_END);
+        if (pos < 0)
+          {
+            return -1;
+          }
+        break;
+
+      default:
+        errno = EINVAL;
+        return -1;
+    }
+
+  if (pos < 0)
+    {
+      errno = EINVAL;
+      return -1;
+    }
+
+  file->pos = pos;
+  return pos;
+}
+
+/****************************************************************************
+ * Name: hostfs_async_dup
+ ****************************************************************************/
+
+int hostfs_async_dup(int fd)
+{
+  struct hostfs_file_s *file;
+  int newfd;
+
+  /* The duplicate starts at the same position but, unlike a host dup(),
+   * then keeps its own file position.
+   */
+
+  file = hostfs_lookup(fd);
+  if (file != NULL && hostfs_flush(fd, file) < 0)
+    {
+      return -1;
+    }
+
+  newfd = dup(fd);
+  if (newfd >= 0 && file != NULL)
+    {
+      hostfs_attach(newfd, file->pos);
+    }
+
+  return newfd;
+}
+
+/****************************************************************************
+ * Name: hostfs_async_sync
+ ****************************************************************************/
+
+void hostfs_async_sync(int fd)
+{
+  struct hostfs_req_s req;
+  struct hostfs_file_s *file;
+
+  file = hostfs_lookup(fd);
+  if (file != NULL)
+    {
+      (void)hostfs_flush(fd, file);
+    }
+
+  req.op = HOSTFS_OP_SYNC;
+
+  hostfs_submit(&req);
+  (void)hostfs_wait(&req);
+}
+
+/****************************************************************************
+ * Name: hostfs_async_stat
+ ****************************************************************************/
+
+int hostfs_async_stat(const char *path, struct stat *buf)
+{
+  struct hostfs_req_s req;
+
+  hostfs_flushall();
+
+  req.op   = HOSTFS_OP_STAT;
+  req.path = path;
+  req.st   = buf;
+
+  hostfs_submit(&req);
+  return hostfs_wait(&req);
+}
@@ -0,0 +1,169 @@
+/****************************************************************************
+ * arch/sim/src/up_hostfswait.c
+ *
+ *   Copyright (C) 2016 Gregory Nutt. All rights reserved.
+ *   Author: Gregory Nutt <gnutt@nuttx.org>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name NuttX nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************/
+
+/****************************************************************************
+ * Included Files
+ ****************************************************************************/
+
+#include <nuttx/config.h>
+
+#include <stdint.h>
+#include <semaphore.h>
+#include <errno.h>
+#include <assert.h>
+
+#include "up_internal.h"
+
+/****************************************************************************
+ * Pre-processor Definitions
+ ****************************************************************************/
+
+#define NSLOTS CONFIG_SIM_HOSTFS_NREQUESTS
+
+#if NSLOTS > 32
+#  error "CONFIG_SIM_HOSTFS_NREQUESTS must not exceed 32"
+#endif
+
+/****************************************************************************
+ * Private Data
+ ****************************************************************************/
+
+/* Each NuttX task waiting for host file system I/O holds one wait slot */
+
+static sem_t g_slotavail;               /* Counts free wait slots */
+static sem_t g_slotdone[NSLOTS];        /* Posted when the I/O completes */
+static volatile uint32_t g_slotinuse;   /* Bit set of allocated slots */
+
+/****************************************************************************
+ * Public Functions
+ ****************************************************************************/
+
+/****************************************************************************
+ * Name: simhostfs_initialize
+ ****************************************************************************/
+
+void simhostfs_initialize(void)
+{
+  int i;
+
+  sem_init(&g_slotavail, 0, NSLOTS);
+  for (i = 0; i < NSLOTS; i++)
+    {
+      sem_init(&g_slotdone[i], 0, 0);
+    }
+}
+
+/****************************************************************************
+ * Name: simhostfs_getslot
+ *
+ * Description:
+ *   Allocate a wait slot, waiting for one to become free if necessary.
+ *
+ ****************************************************************************/
+
+int simhostfs_getslot(void)
+{
+  uint32_t inuse;
+  int slot;
+
+  /* Should only fail if interrupted by a signal */
+
+  while (sem_wait(&g_slotavail) < 0)
+    {
+      DEBUGASSERT(errno == EINTR);
+    }
+
+  /* The semaphore guarantees that a slot is free, but other CPUs may be
+   * allocating slots at the same time.
+   */
+
+  for (; ; )
+    {
+      inuse = g_slotinuse;
+      for (slot = 0; slot < NSLOTS && (inuse & (1u << slot)) != 0; slot++);
+      DEBUGASSERT(slot < NSLOTS);
+
+      if (__sync_bool_compare_and_swap(&g_slotinuse, inuse,
+                                       inuse | (1u << slot)))
+        {
+          return slot;
+        }
+    }
+}
+
+/****************************************************************************
+ * Name: simhostfs_putslot
+ ****************************************************************************/
+
+void simhostfs_putslot(int slot)
+{
+  __sync_fetch_and_and(&g_slotinuse, ~(1u << slot));
+  sem_post(&g_slotavail);
+}
+
+/****************************************************************************
+ * Name: simhostfs_wait
+ ****************************************************************************/
+
+void simhostfs_wait(int slot)
+{
+  /* Should only fail if interrupted by a signal */
+
+  while (sem_wait(&g_slotdone[slot]) < 0);
+}
+
+/****************************************************************************
+ * Name: simhostfs_post
+ *
+ * Description:
+ *   Called from the IDLE loop.  Wake up the tasks whose host I/O has
+ *   completed.
+ *
+ ****************************************************************************/
+
+void simhostfs_post(void)
+{
+  uint32_t done;
+  int slot;
+
+  done = __sync_fetch_and_and(&g_hostfs_completed, 0);
+  for (slot = 0; done != 0; slot++, done >>= 1)
+    {
+      if ((done & 1) != 0)
+        {
+          sem_post(&g_slotdone[slot]);
+        }
+    }
+}
@@ -0,0 +1,268 @@
+/****************************************************************************
+ * arch/sim/src/up_hostheap.c
+ *
+ *   Copyright (C) 2016 Gregory Nutt. All rights reserved.
+ *   Author: Gregory Nutt <gnutt@nuttx.org>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name NuttX nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************/
+
+/****************************************************************************
+ * Included Files
+ ****************************************************************************/
+
+#include <sys/mman.h>
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+/****************************************************************************
+ * Pre-processor Definitions
+ ****************************************************************************/
+
+#ifndef CONFIG_SIM_HEAP_SIZE_KB
+#  define CONFIG_SIM_HEAP_SIZE_KB 4096
+#endif
+
+#ifndef CONFIG_SIM_HEAP_REGION_SIZE_KB
+#  define CONFIG_SIM_HEAP_REGION_SIZE_KB 0
+#endif
+
+#ifndef CONFIG_MM_REGIONS
+#  define CONFIG_MM_REGIONS 1
+#endif
+
+/* The memory manager keeps sizes in 32 bits */
+
+#define SIM_HEAP_MAXSIZE 0xfff00000ul
+
+/****************************************************************************
+ * Private Data
+ ****************************************************************************/
+
+static uint64_t g_heapsize = (uint64_t)CONFIG_SIM_HEAP_SIZE_KB * 1024;
+
+#if CONFIG_MM_REGIONS > 1
+static uint64_t g_regionsize[CONFIG_MM_REGIONS - 1];
+static int g_nregions = -1;  /* -1:  Not given on the command line */
+#endif
+
+/****************************************************************************
+ * Private Functions
+ ****************************************************************************/
+
+/****************************************************************************
+ * Name: sim_heap_parsesize
+ *
+ * Description:
+ *   Parse a size with an optional K, M or G suffix
+ *
+ ****************************************************************************/
+
+static uint64_t sim_heap_parsesize(const char *str)
+{
+  char *end;
+  uint64_t size = strtoull(str, &end, 0);
+
+  switch (*end)
+    {
+      case 'g':
+      case 'G':
+        size <<= 10;
+
+      /* Fall through */
+
+      case 'm':
+      case 'M':
+        size <<= 10;
+
+      /* Fall through */
+
+      case 'k':
+      case 'K':
+        size <<= 10;
+        break;
+
+      default:
+        break;
+    }
+
+  return size;
+}
+
+/****************************************************************************
+ * Name: sim_heap_reserve
+ *
+ * Description:
+ *   Reserve address space for one heap region.  With MAP_NORESERVE, no
+ *   swap is committed and host pages are only allocated when they are
+ *   first touched.
+ *
+ ****************************************************************************/
+
+static void *sim_heap_reserve(uint64_t *size)
+{
+  void *mem;
+
+  if (*size > SIM_HEAP_MAXSIZE)
+    {
+      fprintf(stderr, "heap: region of %llu bytes limited to %lu bytes\n",
+              (unsigned long long)*size, SIM_HEAP_MAXSIZE);
+      *size = SIM_HEAP_MAXSIZE;
+    }
+
+  mem = mmap(NULL, (size_t)*size, PROT_READ | PROT_WRITE,
+             MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+  if (mem == MAP_FAILED)
+    {
+      fprintf(stderr, "heap: cannot reserve %llu bytes\n",
+              (unsigned long long)*size);
+      return NULL;
+    }
+
+  return mem;
+}
+
+/****************************************************************************
+ * Public Functions
+ ****************************************************************************/
+
+/****************************************************************************
+ * Name: sim_heap_args
+ *
+ * Description:
+ *   Pick up the heap configuration from the command line:
+ *
+ *     --heap=<size>         Size of the primary heap
+ *     --heap-region=<size>  Add a heap region (may be repeated up to
+ *                           CONFIG_MM_REGIONS - 1 times)
+ *
+ *   Sizes may have a K, M or G suffix.  Other arguments are ignored.
+ *
+ ****************************************************************************/
+
+void sim_heap_args(int argc, char **argv)
+{
+  int i;
+
+  for (i = 1; i < argc; i++)
+    {
+      if (strncmp(argv[i], "--heap=", 7) == 0)
+        {
+          g_heapsize = sim_heap_parsesize(argv[i] + 7);
+        }
+#if CONFIG_MM_REGIONS > 1
+      else if (strncmp(argv[i], "--heap-region=", 14) == 0)
+        {
+          if (g_nregions < 0)
+            {
+              g_nregions = 0;
+            }
+
+          if (g_nregions < CONFIG_MM_REGIONS - 1)
+            {
+              g_regionsize[g_nregions++] = sim_heap_parsesize(argv[i] + 14);
+            }
+          else
+            {
+              fprintf(stderr, "heap: too many regions (CONFIG_MM_REGIONS)\n");
+            }
+        }
+#endif
+    }
+}
+
+/****************************************************************************
+ * Name: sim_heap_map
+ *
+ * Description:
+ *   Reserve the primary heap
+ *
+ ****************************************************************************/
+
+void *sim_heap_map(size_t *size)
+{
+  uint64_t heapsize = g_heapsize;
+  void *mem;
+
+  mem   = sim_heap_reserve(&heapsize);
+  *size = (size_t)heapsize;
+  return mem;
+}
+
+/****************************************************************************
+ * Name: sim_heap_region
+ *
+ * Description:
+ *   Reserve the additional heap region 'region' (0 .. CONFIG_MM_REGIONS-2).
+ *   Without --heap-region arguments, every additional region is
+ *   CONFIG_SIM_HEAP_REGION_SIZE_KB in size.
+ *
+ * Returned Value:
+ *   The start of the region or NULL if there is no such region.
+ *
+ ****************************************************************************/
+
+void *sim_heap_region(int region, size_t *size)
+{
+#if CONFIG_MM_REGIONS > 1
+  uint64_t regionsize;
+  void *mem;
+
+  if (region < 0 || region >= CONFIG_MM_REGIONS - 1)
+    {
+      regionsize = 0;
+    }
+  else if (g_nregions < 0)
+    {
+      regionsize = (uint64_t)CONFIG_SIM_HEAP_REGION_SIZE_KB * 1024;
+    }
+  else if (region < g_nregions)
+    {
+      regionsize = g_regionsize[region];
+    }
+  else
+    {
+      regionsize = 0;
+    }
+
+  if (regionsize == 0)
+    {
+      return NULL;
+    }
+
+  mem   = sim_heap_reserve(&regionsize);
+  *size = (size_t)regionsize;
+  return mem;
+#else
+  return NULL;
+#endif
+}
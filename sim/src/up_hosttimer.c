@@ -0,0 +1,238 @@
+/****************************************************************************
+ * arch/sim/src/up_hosttimer.c
+ *
+ *   Copyright (C) 2016 Gregory Nutt. All rights reserved.
+ *   Author: Gregory Nutt <gnutt@nuttx.org>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name NuttX nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************/
+
+/****************************************************************************
+ * Included Files
+ ****************************************************************************/
+
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <poll.h>
+#include <time.h>
+
+/****************************************************************************
+ * Pre-processor Definitions
+ ****************************************************************************/
+
+#define NSEC_PER_SEC 1000000000ull
+
+/****************************************************************************
+ * Private Data
+ ****************************************************************************/
+
+static int g_timerfd  = -1;     /* Host interval timer */
+static int g_wakeupfd = -1;     /* Wakes up the IDLE loop */
+static uint64_t g_timerbase;    /* Host time at initialization */
+
+/****************************************************************************
+ * Private Functions
+ ****************************************************************************/
+
+/****************************************************************************
+ * Name: host_monotonic
+ ****************************************************************************/
+
+static uint64_t host_monotonic(void)
+{
+  struct timespec ts;
+
+  (void)clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * NSEC_PER_SEC + ts.tv_nsec;
+}
+
+/****************************************************************************
+ * Public Functions
+ ****************************************************************************/
+
+/****************************************************************************
+ * Name: host_timer_initialize
+ *
+ * Description:
+ *   Create the host interval timer and the IDLE wake-up event.  The time
+ *   base of host_timer_gettime() starts now.
+ *
+ ****************************************************************************/
+
+int host_timer_initialize(void)
+{
+  g_timerbase = host_monotonic();
+
+  g_timerfd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+  if (g_timerfd < 0)
+    {
+      return -1;
+    }
+
+  g_wakeupfd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  if (g_wakeupfd < 0)
+    {
+      close(g_timerfd);
+      g_timerfd = -1;
+      return -1;
+    }
+
+  return 0;
+}
+
+/****************************************************************************
+ * Name: host_timer_gettime
+ *
+ * Description:
+ *   Return the host monotonic time in nanoseconds since initialization
+ *
+ ****************************************************************************/
+
+uint64_t host_timer_gettime(void)
+{
+  return host_monotonic() - g_timerbase;
+}
+
+/****************************************************************************
+ * Name: host_timer_start
+ *
+ * Description:
+ *   Arm the host interval timer to expire once after 'nsec' nanoseconds
+ *
+ ****************************************************************************/
+
+void host_timer_start(uint64_t nsec)
+{
+  struct itimerspec it;
+
+  /* A zero it_value would disarm the timer.  Expire as soon as possible
+   * instead.
+   */
+
+  if (nsec == 0)
+    {
+      nsec = 1;
+    }
+
+  memset(&it, 0, sizeof(it));
+  it.it_value.tv_sec  = nsec / NSEC_PER_SEC;
+  it.it_value.tv_nsec = nsec % NSEC_PER_SEC;
+
+  (void)timerfd_settime(g_timerfd, 0, &it, NULL);
+}
+
+/****************************************************************************
+ * Name: host_timer_cancel
+ *
+ * Description:
+ *   Disarm the host interval timer, discard any pending expiration and
+ *   return the time that was remaining in nanoseconds.
+ *
+ ****************************************************************************/
+
+uint64_t host_timer_cancel(void)
+{
+  struct itimerspec it;
+  struct itimerspec old;
+  uint64_t expirations;
+
+  memset(&it, 0, sizeof(it));
+  memset(&old, 0, sizeof(old));
+
+  (void)timerfd_settime(g_timerfd, 0, &it, &old);
+  (void)read(g_timerfd, &expirations, sizeof(expirations));
+
+  return (uint64_t)old.it_value.tv_sec * NSEC_PER_SEC +
+         old.it_value.tv_nsec;
+}
+
+/****************************************************************************
+ * Name: host_timer_expired
+ *
+ * Description:
+ *   Return non-zero (once) if the host interval timer has expired
+ *
+ ****************************************************************************/
+
+int host_timer_expired(void)
+{
+  uint64_t expirations;
+
+  return read(g_timerfd, &expirations, sizeof(expirations)) ==
+         sizeof(expirations);
+}
+
+/****************************************************************************
+ * Name: host_idle_wait
+ *
+ * Description:
+ *   Called from the IDLE loop when there is nothing to do.  Block until the
+ *   interval timer expires, until a host thread calls host_idle_wakeup(),
+ *   or for at most 'usec' microseconds.
+ *
+ ****************************************************************************/
+
+void host_idle_wait(unsigned int usec)
+{
+  struct pollfd fds[2];
+  uint64_t count;
+
+  fds[0].fd     = g_timerfd;
+  fds[0].events = POLLIN;
+  fds[1].fd     = g_wakeupfd;
+  fds[1].events = POLLIN;
+
+  (void)poll(fds, 2, (int)((usec + 999) / 1000));
+  (void)read(g_wakeupfd, &count, sizeof(count));
+}
+
+/****************************************************************************
+ * Name: host_idle_wakeup
+ *
+ * Description:
+ *   Called from host threads (such as the simulated UART or network I/O
+ *   threads) when they have new input for the NuttX domain.  Makes a
+ *   pending host_idle_wait() return.  The event counter latches, so a
+ *   wake-up posted just before the IDLE loop blocks is not lost.
+ *
+ ****************************************************************************/
+
+void host_idle_wakeup(void)
+{
+  uint64_t count = 1;
+
+  if (g_wakeupfd >= 0)
+    {
+      (void)write(g_wakeupfd, &count, sizeof(count));
+    }
+}
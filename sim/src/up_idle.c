@@ -60,14 +60,6 @@
 
 #define PM_IDLE_DOMAIN 0 /* Revisit */
 
-/****************************************************************************
- * Private Data
- ****************************************************************************/
-
-#ifdef CONFIG_SIM_X11FB
-static int g_x11refresh = 0;
-#endif
-
 /****************************************************************************
  * Public Function Prototypes
  ****************************************************************************/
@@ -102,7 +94,8 @@ void up_idle(void)
 {
 #ifdef CONFIG_SMP
   /* In the SMP configuration, only one CPU should do these operations.  It
-   * should not matter which, however.
+   * should not matter which, however.  This "interrupt CPU" tends to stay
+   * the same because it retakes the lock right after releasing it.
    */
 
   static volatile spinlock_t lock = SP_UNLOCKED;
@@ -111,11 +104,12 @@ void up_idle(void)
 
   if (up_testset(&lock) != SP_UNLOCKED)
     {
-      /* We didn't get it... Give other pthreads/CPUs a shot and try again
-       * later.
+      /* We didn't get it... Sleep rather than spin.  Another CPU wakes us
+       * when it has work for us (see up_cpu_pause()).  Otherwise, try again
+       * after one tick in case the interrupt CPU is no longer idle.
        */
 
-      pthread_yield();
+      sim_cpu_idle(1000000 / CLK_TCK);
       return;
     }
 #endif
@@ -132,6 +126,18 @@ void up_idle(void)
   sched_process_timer();
 #endif
 
+#ifdef CONFIG_SIM_REPLAY
+  /* Advance the virtual time of recorded events */
+
+  sim_replay_advance();
+
+#ifdef CONFIG_DEV_CONSOLE
+  /* Deliver console input (only) here so that it can be replayed */
+
+  simuart_replay();
+#endif
+#endif
+
 #if defined(CONFIG_DEV_CONSOLE) && !defined(CONFIG_SIM_UART_DATAPOST)
   /* Handle UART data availability */
 
@@ -142,6 +148,34 @@ void up_idle(void)
     }
 #endif
 
+#ifdef CONFIG_SIM_SWITCHBENCH
+  /* Start the context switch benchmark, the first time only */
+
+  sim_switchbench_start();
+#endif
+
+#ifdef CONFIG_SIM_HOSTFS_ASYNC
+  /* Wake up tasks whose host file system I/O has completed */
+
+  if (g_hostfs_completed != 0)
+    {
+      simhostfs_post();
+    }
+#endif
+
+#ifdef CONFIG_DEV_CONSOLE
+  /* Write out console output that is still buffered */
+
+  simuart_flush();
+#endif
+
+#if defined(CONFIG_SCHED_INSTRUMENTATION) && \
+   !defined(CONFIG_SCHED_INSTRUMENTATION_BUFFER)
+  /* Write the scheduler trace if requested */
+
+  sched_trace_poll();
+#endif
+
 #ifdef CONFIG_NET_ETHERNET
   /* Run the network if enabled */
 
@@ -166,12 +200,22 @@ void up_idle(void)
   }
 #endif
 
+#if defined(CONFIG_SIM_HOSTTIMER)
+  /* Sleep until the host timer expires or until there is new input.  Wake
+   * up at least once per tick to service polled devices.
+   */
+
+  host_idle_wait(1000000 / CLK_TCK);
+#endif
+
 #if defined(CONFIG_SIM_WALLTIME) || defined(CONFIG_SIM_X11FB)
+#ifndef CONFIG_SIM_HOSTTIMER
   /* Wait a bit so that the sched_process_timer() is called close to the
    * correct rate.
    */
 
   (void)up_hostusleep(1000000 / CLK_TCK);
+#endif
 
   /* Handle X11-related events */
 
@@ -187,17 +231,21 @@ void up_idle(void)
         }
 #endif
 
-      /* Update the display periodically */
+      /* Update the display.  up_x11update() limits the rate of updates and
+       * only sends what has changed.
+       */
 
-      g_x11refresh += 1000000 / CLK_TCK;
-      if (g_x11refresh > 500000)
-        {
-          up_x11update();
-        }
+      up_x11update();
     }
 #endif
 #endif
 
+#ifdef CONFIG_SIM_FBCAPTURE
+  /* Sample the display for the headless capture */
+
+  fbcapture_update();
+#endif
+
 #ifdef CONFIG_SMP
   /* Release the spinlock */
 
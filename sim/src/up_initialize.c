@@ -124,6 +124,22 @@ static void up_init_smartfs(void)
 
 void up_initialize(void)
 {
+  /* Add any extra memory fragments to the memory manager */
+
+  up_addregion();
+
+#ifdef CONFIG_SIM_PROFILE
+  /* Start the sampling profiler */
+
+  sim_profile_initialize();
+#endif
+
+#ifdef CONFIG_SIM_REPLAY
+  /* Open the event log before any of the event sources are started */
+
+  sim_replay_initialize();
+#endif
+
   /* The real purpose of the following is to make sure that syslog
    * is drawn into the link.  It is needed by up_tapdev which is linked
    * separately.
@@ -175,7 +191,8 @@ void up_initialize(void)
   ramlog_sysloginit();      /* System logging device */
 #endif
 
-#if defined(CONFIG_FS_FAT) && !defined(CONFIG_DISABLE_MOUNTPOINT)
+#if (defined(CONFIG_FS_FAT) || defined(CONFIG_SIM_BLOCKFILE)) && \
+    !defined(CONFIG_DISABLE_MOUNTPOINT)
   up_registerblockdevice(); /* Our FAT ramdisk at /dev/ram0 */
 #endif
 
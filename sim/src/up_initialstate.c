@@ -46,6 +46,17 @@
 
 #include "up_internal.h"
 
+/****************************************************************************
+ * Pre-processor Definitions
+ ****************************************************************************/
+
+/* Power-up values of MXCSR (all exceptions masked, round to nearest) and
+ * of the x87 control word (all exceptions masked, extended precision).
+ */
+
+#define SIM_MXCSR_INIT 0x1f80
+#define SIM_FPUCW_INIT 0x037f
+
 /****************************************************************************
  * Public Functions
  ****************************************************************************/
@@ -69,4 +80,18 @@ void up_initial_state(struct tcb_s *tcb)
   memset(&tcb->xcp, 0, sizeof(struct xcptcontext));
   tcb->xcp.regs[JB_SP] = (xcpt_reg_t)tcb->adj_stack_ptr;
   tcb->xcp.regs[JB_PC] = (xcpt_reg_t)tcb->start;
+
+#ifdef CONFIG_SIM_FASTSWITCH_FPCTRL
+  /* New tasks start with the default floating point control state instead
+   * of inheriting that of whichever task ran before them.
+   */
+
+#  ifdef JB_FPCTRL
+  tcb->xcp.regs[JB_FPCTRL] = SIM_MXCSR_INIT |
+                             ((xcpt_reg_t)SIM_FPUCW_INIT << 32);
+#  else
+  tcb->xcp.regs[JB_MXCSR] = SIM_MXCSR_INIT;
+  tcb->xcp.regs[JB_FPUCW] = SIM_FPUCW_INIT;
+#  endif
+#endif
 }
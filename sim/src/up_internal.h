@@ -45,6 +45,7 @@
 
 #ifndef __ASSEMBLY__
 #  include <sys/types.h>
+#  include <stdint.h>
 #  include <stdbool.h>
 
 #  include <nuttx/irq.h>
@@ -82,6 +83,18 @@
 #  endif
 #endif
 
+/* Number of simulated Ethernet devices.  Only one is supported with
+ * WinPcap.
+ */
+
+#ifndef CONFIG_SIM_NETDEV_NUMBER
+#  define CONFIG_SIM_NETDEV_NUMBER 1
+#endif
+
+#if defined(__CYGWIN__) && CONFIG_SIM_NETDEV_NUMBER != 1
+#  error "Only one network device is supported with WinPcap"
+#endif
+
 /* Determine which (if any) console driver to use */
 
 #if !defined(CONFIG_DEV_CONSOLE) || CONFIG_NFILE_DESCRIPTORS == 0
@@ -120,6 +133,8 @@
 #    define JB_R14 (5*8)
 #    define JB_R15 (6*8)
 #    define JB_RSI (7*8)
+#    define JB_MXCSR (8*8)
+#    define JB_FPUCW (8*8+4)
 
 #  else
 #    define JB_RBX (0)
@@ -130,6 +145,7 @@
 #    define JB_R14 (5)
 #    define JB_R15 (6)
 #    define JB_RSI (7)
+#    define JB_FPCTRL (8)
 
 #  endif /* __ASSEMBLY__ */
 
@@ -148,6 +164,8 @@
 #    define JB_EBP (3*4)
 #    define JB_SP  (4*4)
 #    define JB_PC  (5*4)
+#    define JB_MXCSR (6*4)
+#    define JB_FPUCW (7*4)
 
 #  else
 #    define JB_EBX (0)
@@ -156,12 +174,14 @@
 #    define JB_EBP (3)
 #    define JB_SP  (4)
 #    define JB_PC  (5)
+#    define JB_MXCSR (6)
+#    define JB_FPUCW (7)
 
 #  endif /* __ASSEMBLY__ */
 #endif /* CONFIG_HOST_X86_64 && !CONFIG_SIM_M32 */
 
 /* Simulated Heap Definitions **********************************************/
-/* Size of the simulated heap */
+/* Size of the simulated heap (unless it is reserved with mmap) */
 
 #ifdef CONFIG_MM_SMALL
 #  define SIM_HEAP_SIZE (64*1024)
@@ -209,16 +229,35 @@ extern volatile int g_uart_data_available;
  * Public Function Prototypes
  ****************************************************************************/
 
+/* up_hostusleep.c ********************************************************/
+
+uint64_t up_hosttime(void);
+
 /* up_setjmp32.S **********************************************************/
 
 int  up_setjmp(xcpt_reg_t *jb);
 void up_longjmp(xcpt_reg_t *jb, int val) noreturn_function;
+#ifdef CONFIG_SIM_FASTSWITCH
+void up_swapcontext(xcpt_reg_t *saveregs, xcpt_reg_t *restoreregs);
+#endif
+
+/* up_switchtask.c ********************************************************/
+
+struct tcb_s; /* Forward reference */
+void up_switchtask(FAR struct tcb_s *rtcb);
+
+/* up_switchbench.c *******************************************************/
+
+#ifdef CONFIG_SIM_SWITCHBENCH
+void sim_switchbench_start(void);
+#endif
 
 /* up_simsmp.c ************************************************************/
 
 #ifdef CONFIG_SMP
 int sim_cpu0_initialize(void);
 void sim_cpu0_start(void);
+void sim_cpu_idle(unsigned int usec);
 #endif
 
 /* up_smpsignal.c *********************************************************/
@@ -240,6 +279,36 @@ void sim_smp_hook(void);
 void up_timer_update(void);
 #endif
 
+/* up_hosttimer.c *********************************************************/
+
+#ifdef CONFIG_SIM_HOSTTIMER
+int host_timer_initialize(void);
+uint64_t host_timer_gettime(void);
+void host_timer_start(uint64_t nsec);
+uint64_t host_timer_cancel(void);
+int host_timer_expired(void);
+void host_idle_wait(unsigned int usec);
+#endif
+
+/* up_schedtrace.c ********************************************************/
+
+#if defined(CONFIG_SCHED_INSTRUMENTATION) && \
+   !defined(CONFIG_SCHED_INSTRUMENTATION_BUFFER)
+/* Trace events.  Must match the definitions in up_schedtrace.c */
+
+#  define SCHED_TRACE_START    0
+#  define SCHED_TRACE_STOP     1
+#  define SCHED_TRACE_SUSPEND  2
+#  define SCHED_TRACE_RESUME   3
+#  define SCHED_TRACE_PREEMPT  4
+#  define SCHED_TRACE_CSECTION 5
+
+void sched_trace_record(int cpu, int event, FAR void *tcb, int pid,
+                        unsigned int arg);
+void sched_trace_name(int pid, FAR const char *name);
+void sched_trace_poll(void);
+#endif
+
 /* up_devconsole.c ********************************************************/
 
 void up_devconsole(void);
@@ -249,6 +318,7 @@ void up_registerblockdevice(void);
 
 void simuart_start(void);
 int simuart_putc(int ch);
+void simuart_flush(void);
 int simuart_getc(void);
 bool simuart_checkc(void);
 void simuart_terminate(void);
@@ -259,6 +329,75 @@ void simuart_initialize(void);
 void simuart_post(void);
 void simuart_wait(void);
 
+/* up_allocateheap.c ******************************************************/
+
+#if CONFIG_MM_REGIONS > 1 && defined(CONFIG_SIM_HEAP_MMAP)
+void up_addregion(void);
+#else
+#  define up_addregion()
+#endif
+
+/* up_hostheap.c **********************************************************/
+
+#ifdef CONFIG_SIM_HEAP_MMAP
+void sim_heap_args(int argc, FAR char **argv);
+FAR void *sim_heap_map(FAR size_t *size);
+FAR void *sim_heap_region(int region, FAR size_t *size);
+#endif
+
+/* up_replay.c ************************************************************/
+
+#ifdef CONFIG_SIM_REPLAY
+/* Event sources.  Must match the definitions in the host event sources */
+
+#  define SIM_REPLAY_UART 0     /* Console input (up_simuart.c) */
+#  define SIM_REPLAY_X11  1     /* Touchscreen/joystick (up_x11eventloop.c) */
+#  define SIM_REPLAY_NET  2     /* + device index: Received frames */
+
+void sim_replay_initialize(void);
+void sim_replay_advance(void);
+#ifdef CONFIG_SIM_REPLAY_RECORD
+void sim_replay_record(int source, FAR const void *data, unsigned int len);
+#else
+unsigned int sim_replay_fetch(int source, FAR void *data, unsigned int len);
+#endif
+#ifdef CONFIG_DEV_CONSOLE
+void simuart_replay(void);
+#endif
+#endif
+
+/* up_profile.c ***********************************************************/
+
+#ifdef CONFIG_SIM_PROFILE
+void sim_profile_initialize(void);
+void sim_profile_cputhread(void);
+int sim_profile_task(FAR uintptr_t *stackbase, FAR uintptr_t *stacktop,
+                     FAR const char **name);
+#endif
+
+/* up_hostfswait.c ********************************************************/
+
+#ifdef CONFIG_SIM_HOSTFS_ASYNC
+extern volatile uint32_t g_hostfs_completed;
+
+void simhostfs_initialize(void);
+int  simhostfs_getslot(void);
+void simhostfs_putslot(int slot);
+void simhostfs_wait(int slot);
+void simhostfs_post(void);
+#endif
+
+/* up_blockfile.c *********************************************************/
+
+#ifdef CONFIG_SIM_BLOCKFILE
+int blockfile_open(unsigned long nsectors, unsigned int sectorsize);
+int blockfile_read(FAR void *buffer, unsigned long start,
+                   unsigned int nsectors);
+int blockfile_write(FAR const void *buffer, unsigned long start,
+                    unsigned int nsectors);
+int blockfile_sync(void);
+#endif
+
 /* up_deviceimage.c *******************************************************/
 
 char *up_deviceimage(void);
@@ -282,6 +421,16 @@ int up_x11cmap(unsigned short first, unsigned short len,
 #endif
 #endif
 
+/* up_fbcapture.c *********************************************************/
+
+#ifdef CONFIG_SIM_FBCAPTURE
+int fbcapture_initialize(const void *fbmem, unsigned int width,
+                         unsigned int height, unsigned int bpp,
+                         unsigned int stride);
+void fbcapture_written(unsigned int nbytes);
+void fbcapture_update(void);
+#endif
+
 /* up_eventloop.c *********************************************************/
 
 #if defined(CONFIG_SIM_X11FB) && \
@@ -302,16 +451,44 @@ int up_buttonevent(int x, int y, int buttons);
 int sim_ajoy_initialize(void);
 #endif
 
+/* up_shmdev.c ************************************************************/
+
+#if defined(CONFIG_NET_ETHERNET) && defined(CONFIG_SIM_NETDEV_SHMEM)
+void shmdev_init(int devidx);
+unsigned int shmdev_read(int devidx, unsigned char *buf,
+                         unsigned int buflen);
+void shmdev_send(int devidx, unsigned char *buf, unsigned int buflen);
+
+#define netdev_init(devidx)            shmdev_init(devidx)
+#define netdev_read(devidx,buf,buflen) shmdev_read(devidx,buf,buflen)
+#define netdev_send(devidx,buf,buflen) shmdev_send(devidx,buf,buflen)
+#endif
+
+/* up_pcapdev.c ***********************************************************/
+
+#if defined(CONFIG_NET_ETHERNET) && defined(CONFIG_SIM_NETDEV_PCAP)
+void pcapdev_init(int devidx);
+unsigned int pcapdev_read(int devidx, unsigned char *buf,
+                          unsigned int buflen);
+void pcapdev_send(int devidx, unsigned char *buf, unsigned int buflen);
+
+#define netdev_init(devidx)            pcapdev_init(devidx)
+#define netdev_read(devidx,buf,buflen) pcapdev_read(devidx,buf,buflen)
+#define netdev_send(devidx,buf,buflen) pcapdev_send(devidx,buf,buflen)
+#endif
+
 /* up_tapdev.c ************************************************************/
 
-#if defined(CONFIG_NET_ETHERNET) && !defined(__CYGWIN__)
-void tapdev_init(void);
-unsigned int tapdev_read(unsigned char *buf, unsigned int buflen);
-void tapdev_send(unsigned char *buf, unsigned int buflen);
+#if defined(CONFIG_NET_ETHERNET) && !defined(__CYGWIN__) && \
+    !defined(CONFIG_SIM_NETDEV_SHMEM) && !defined(CONFIG_SIM_NETDEV_PCAP)
+void tapdev_init(int devidx);
+unsigned int tapdev_read(int devidx, unsigned char *buf,
+                         unsigned int buflen);
+void tapdev_send(int devidx, unsigned char *buf, unsigned int buflen);
 
-#define netdev_init()           tapdev_init()
-#define netdev_read(buf,buflen) tapdev_read(buf,buflen)
-#define netdev_send(buf,buflen) tapdev_send(buf,buflen)
+#define netdev_init(devidx)            tapdev_init(devidx)
+#define netdev_read(devidx,buf,buflen) tapdev_read(devidx,buf,buflen)
+#define netdev_send(devidx,buf,buflen) tapdev_send(devidx,buf,buflen)
 #endif
 
 /* up_wpcap.c *************************************************************/
@@ -321,16 +498,16 @@ void wpcap_init(void);
 unsigned int wpcap_read(unsigned char *buf, unsigned int buflen);
 void wpcap_send(unsigned char *buf, unsigned int buflen);
 
-#define netdev_init()           wpcap_init()
-#define netdev_read(buf,buflen) wpcap_read(buf,buflen)
-#define netdev_send(buf,buflen) wpcap_send(buf,buflen)
+#define netdev_init(devidx)            wpcap_init()
+#define netdev_read(devidx,buf,buflen) wpcap_read(buf,buflen)
+#define netdev_send(devidx,buf,buflen) wpcap_send(buf,buflen)
 #endif
 
 /* up_netdriver.c *********************************************************/
 
 #ifdef CONFIG_NET_ETHERNET
 int netdriver_init(void);
-int netdriver_setmacaddr(unsigned char *macaddr);
+int netdriver_setmacaddr(int devidx, unsigned char *macaddr);
 void netdriver_loop(void);
 #endif
 
@@ -339,5 +516,16 @@ struct spi_dev_s;
 struct spi_dev_s *up_spiflashinitialize(void);
 #endif
 
+/* up_spiflashhost.c ******************************************************/
+
+#ifdef CONFIG_SIM_SPIFLASH_PERSIST
+FAR void *spiflash_host_map(size_t size);
+#endif
+
+#ifdef CONFIG_SIM_SPIFLASH_STATS
+uint64_t spiflash_host_gettime(void);
+void spiflash_host_account(int cmd, uint64_t start, unsigned long nbytes);
+#endif
+
 #endif /* __ASSEMBLY__ */
 #endif /* __ARCH_SIM_SRC_UP_INTERNAL_H */
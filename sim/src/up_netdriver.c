@@ -66,7 +66,8 @@
  * Pre-processor Definitions
  ****************************************************************************/
 
-#define BUF ((struct eth_hdr_s *)g_sim_dev.d_buf)
+#define BUF(dev)    ((struct eth_hdr_s *)(dev)->d_buf)
+#define DEVIDX(dev) ((int)((dev) - g_sim_dev))
 
 /****************************************************************************
  * Private Types
@@ -87,7 +88,7 @@ struct timer
  ****************************************************************************/
 
 static struct timer g_periodic_timer;
-static struct net_driver_s g_sim_dev;
+static struct net_driver_s g_sim_dev[CONFIG_SIM_NETDEV_NUMBER];
 
 /****************************************************************************
  * Private Functions
@@ -124,7 +125,7 @@ static int sim_txpoll(struct net_driver_s *dev)
    * the field d_len is set to a value > 0.
    */
 
-  if (g_sim_dev.d_len > 0)
+  if (dev->d_len > 0)
     {
       /* Look up the destination MAC address and add it to the Ethernet
        * header.
@@ -132,10 +133,10 @@ static int sim_txpoll(struct net_driver_s *dev)
 
 #ifdef CONFIG_NET_IPv4
 #ifdef CONFIG_NET_IPv6
-      if (IFF_IS_IPv4(&g_sim_dev))
+      if (IFF_IS_IPv4(dev->d_flags))
 #endif
         {
-          arp_out(&g_sim_dev);
+          arp_out(dev);
         }
 #endif /* CONFIG_NET_IPv4 */
 
@@ -144,13 +145,13 @@ static int sim_txpoll(struct net_driver_s *dev)
       else
 #endif
         {
-          neighbor_out(&g_sim_dev);
+          neighbor_out(dev);
         }
 #endif /* CONFIG_NET_IPv6 */
 
       /* Send the packet */
 
-      netdev_send(g_sim_dev.d_buf, g_sim_dev.d_len);
+      netdev_send(DEVIDX(dev), dev->d_buf, dev->d_len);
     }
 
   /* If zero is returned, the polling will continue until all connections have
@@ -161,170 +162,245 @@ static int sim_txpoll(struct net_driver_s *dev)
 }
 
 /****************************************************************************
- * Public Functions
+ * Name: netdriver_receive
+ *
+ * Description:
+ *   Process one received frame held in dev->d_buf
+ *
  ****************************************************************************/
 
-void netdriver_loop(void)
+static void netdriver_receive(FAR struct net_driver_s *dev)
 {
   FAR struct eth_hdr_s *eth;
 
-  /* netdev_read will return 0 on a timeout event and >0 on a data received event */
+  /* Check for valid Ethernet header with destination == our MAC address */
 
-  g_sim_dev.d_len = netdev_read((FAR unsigned char *)g_sim_dev.d_buf,
-                                CONFIG_NET_ETH_MTU);
-
-  /* Disable preemption through to the following so that it behaves a little more
-   * like an interrupt (otherwise, the following logic gets pre-empted an behaves
-   * oddly.
-   */
-
-  sched_lock();
-  if (g_sim_dev.d_len > 0)
+  eth = BUF(dev);
+  if (dev->d_len > ETH_HDRLEN &&
+      up_comparemac(eth->dest, &dev->d_mac) == 0)
     {
-      /* Data received event.  Check for valid Ethernet header with destination == our
-       * MAC address
-       */
-
-      eth = BUF;
-      if (g_sim_dev.d_len > ETH_HDRLEN &&
-          up_comparemac(eth->dest, &g_sim_dev.d_mac) == 0)
-        {
 #ifdef CONFIG_NET_PKT
-          /* When packet sockets are enabled, feed the frame into the packet
-           * tap.
-           */
+      /* When packet sockets are enabled, feed the frame into the packet
+       * tap.
+       */
 
-          pkt_input(&g_sim_dev);
+      pkt_input(dev);
 #endif
 
-          /* We only accept IP packets of the configured type and ARP packets */
+      /* We only accept IP packets of the configured type and ARP packets */
 
 #ifdef CONFIG_NET_IPv4
-          if (eth->type == HTONS(ETHTYPE_IP))
-            {
-              nllvdbg("IPv4 frame\n");
+      if (eth->type == HTONS(ETHTYPE_IP))
+        {
+          nllvdbg("IPv4 frame\n");
 
-              /* Handle ARP on input then give the IPv4 packet to the network
-               * layer
-               */
+          /* Handle ARP on input then give the IPv4 packet to the network
+           * layer
+           */
 
-              arp_ipin(&g_sim_dev);
-              ipv4_input(&g_sim_dev);
+          arp_ipin(dev);
+          ipv4_input(dev);
 
-              /* If the above function invocation resulted in data that
-               * should be sent out on the network, the global variable
-               * d_len is set to a value > 0.
-               */
+          /* If the above function invocation resulted in data that
+           * should be sent out on the network, the global variable
+           * d_len is set to a value > 0.
+           */
 
-              if (g_sim_dev.d_len > 0)
-                {
-                  /* Update the Ethernet header with the correct MAC address */
+          if (dev->d_len > 0)
+            {
+              /* Update the Ethernet header with the correct MAC address */
 
 #ifdef CONFIG_NET_IPv6
-                  if (IFF_IS_IPv4(g_sim_dev.d_flags))
+              if (IFF_IS_IPv4(dev->d_flags))
 #endif
-                    {
-                      arp_out(&g_sim_dev);
-                    }
+                {
+                  arp_out(dev);
+                }
 #ifdef CONFIG_NET_IPv6
-                  else
-                    {
-                      neighbor_out(&g_sim_dev);
-                    }
+              else
+                {
+                  neighbor_out(dev);
+                }
 #endif
 
-                  /* And send the packet */
+              /* And send the packet */
 
-                  netdev_send(g_sim_dev.d_buf, g_sim_dev.d_len);
-                }
+              netdev_send(DEVIDX(dev), dev->d_buf, dev->d_len);
             }
-          else
+        }
+      else
 #endif
 #ifdef CONFIG_NET_IPv6
-          if (eth->type == HTONS(ETHTYPE_IP6))
-            {
-              nllvdbg("Iv6 frame\n");
+      if (eth->type == HTONS(ETHTYPE_IP6))
+        {
+          nllvdbg("Iv6 frame\n");
 
-              /* Give the IPv6 packet to the network layer */
+          /* Give the IPv6 packet to the network layer */
 
-              ipv6_input(&g_sim_dev);
+          ipv6_input(dev);
 
-              /* If the above function invocation resulted in data that
-               * should be sent out on the network, the global variable
-               * d_len is set to a value > 0.
-               */
+          /* If the above function invocation resulted in data that
+           * should be sent out on the network, the global variable
+           * d_len is set to a value > 0.
+           */
 
-              if (g_sim_dev.d_len > 0)
-               {
-                  /* Update the Ethernet header with the correct MAC address */
+          if (dev->d_len > 0)
+           {
+              /* Update the Ethernet header with the correct MAC address */
 
 #ifdef CONFIG_NET_IPv4
-                  if (IFF_IS_IPv4(g_sim_dev.d_flags))
-                    {
-                      arp_out(&g_sim_dev);
-                    }
-                  else
+              if (IFF_IS_IPv4(dev->d_flags))
+                {
+                  arp_out(dev);
+                }
+              else
 #endif
 #ifdef CONFIG_NET_IPv6
-                    {
-                      neighbor_out(&g_sim_dev);
-                    }
+                {
+                  neighbor_out(dev);
+                }
 #endif
 
-                  /* And send the packet */
+              /* And send the packet */
 
-                  netdev_send(g_sim_dev.d_buf, g_sim_dev.d_len);
-                }
+              netdev_send(DEVIDX(dev), dev->d_buf, dev->d_len);
             }
-          else
+        }
+      else
 #endif
 #ifdef CONFIG_NET_ARP
-          if (eth->type == htons(ETHTYPE_ARP))
-            {
-              arp_arpin(&g_sim_dev);
+      if (eth->type == htons(ETHTYPE_ARP))
+        {
+          arp_arpin(dev);
 
-              /* If the above function invocation resulted in data that
-               * should be sent out on the network, the global variable
-               * d_len is set to a value > 0.
-               */
+          /* If the above function invocation resulted in data that
+           * should be sent out on the network, the global variable
+           * d_len is set to a value > 0.
+           */
 
-              if (g_sim_dev.d_len > 0)
-                {
-                  netdev_send(g_sim_dev.d_buf, g_sim_dev.d_len);
-                }
+          if (dev->d_len > 0)
+            {
+              netdev_send(DEVIDX(dev), dev->d_buf, dev->d_len);
             }
+        }
+#endif
+    }
+}
+
+/****************************************************************************
+ * Name: netdriver_read
+ *
+ * Description:
+ *   Take the next received frame from the host network device.  Frames are
+ *   logged when recording events.  When replaying, live frames are dropped
+ *   and the recorded frames are returned instead.
+ *
+ ****************************************************************************/
+
+static unsigned int netdriver_read(int devidx, FAR unsigned char *buf,
+                                   unsigned int buflen)
+{
+#if defined(CONFIG_SIM_REPLAY_PLAY)
+  while (netdev_read(devidx, buf, buflen) > 0);
+
+  return sim_replay_fetch(SIM_REPLAY_NET + devidx, buf, buflen);
+#else
+  unsigned int len = netdev_read(devidx, buf, buflen);
+
+#ifdef CONFIG_SIM_REPLAY_RECORD
+  if (len > 0)
+    {
+      sim_replay_record(SIM_REPLAY_NET + devidx, buf, len);
+    }
 #endif
+
+  return len;
+#endif
+}
+
+/****************************************************************************
+ * Public Functions
+ ****************************************************************************/
+
+void netdriver_loop(void)
+{
+  FAR struct net_driver_s *dev;
+  int devidx;
+  int nframes;
+
+  /* Disable preemption through to the following so that it behaves a little more
+   * like an interrupt (otherwise, the following logic gets pre-empted an behaves
+   * oddly.
+   */
+
+  sched_lock();
+
+  /* Process a burst of received frames from each device in turn.
+   * netdev_read() returns 0 when no further frame is buffered.  The burst
+   * is bounded so that one busy device cannot starve the others or the
+   * rest of the IDLE processing.
+   */
+
+  for (devidx = 0; devidx < CONFIG_SIM_NETDEV_NUMBER; devidx++)
+    {
+      dev = &g_sim_dev[devidx];
+
+      for (nframes = 0; nframes < CONFIG_SIM_NETDEV_RXRING; nframes++)
+        {
+          dev->d_len = netdriver_read(devidx,
+                                      (FAR unsigned char *)dev->d_buf,
+                                      CONFIG_NET_ETH_MTU);
+          if (dev->d_len == 0)
+            {
+              break;
+            }
+
+          netdriver_receive(dev);
         }
     }
 
-  /* Otherwise, it must be a timeout event */
+  /* Then check for a periodic timer event */
 
-  else if (timer_expired(&g_periodic_timer))
+  if (timer_expired(&g_periodic_timer))
     {
       timer_reset(&g_periodic_timer);
-      devif_timer(&g_sim_dev, sim_txpoll);
+
+      for (devidx = 0; devidx < CONFIG_SIM_NETDEV_NUMBER; devidx++)
+        {
+          devif_timer(&g_sim_dev[devidx], sim_txpoll);
+        }
     }
+
   sched_unlock();
 }
 
 int netdriver_init(void)
 {
+  int devidx;
+
   /* Internal initalization */
 
   timer_set(&g_periodic_timer, 500);
-  netdev_init();
 
-  /* Register the device with the OS so that socket IOCTLs can be performed */
+  for (devidx = 0; devidx < CONFIG_SIM_NETDEV_NUMBER; devidx++)
+    {
+      netdev_init(devidx);
+
+      /* Register the device with the OS so that socket IOCTLs can be
+       * performed
+       */
+
+      (void)netdev_register(&g_sim_dev[devidx], NET_LL_ETHERNET);
+    }
 
-  (void)netdev_register(&g_sim_dev, NET_LL_ETHERNET);
   return OK;
 }
 
-int netdriver_setmacaddr(unsigned char *macaddr)
+int netdriver_setmacaddr(int devidx, unsigned char *macaddr)
 {
-  (void)memcpy(g_sim_dev.d_mac.ether_addr_octet, macaddr, IFHWADDRLEN);
+  (void)memcpy(g_sim_dev[devidx].d_mac.ether_addr_octet, macaddr,
+               IFHWADDRLEN);
   return 0;
 }
 
 #endif /* CONFIG_NET_ETHERNET */
-
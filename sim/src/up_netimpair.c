@@ -0,0 +1,406 @@
+/****************************************************************************
+ * arch/sim/src/up_netimpair.c
+ *
+ *   Copyright (C) 2016 Gregory Nutt. All rights reserved.
+ *   Author: Gregory Nutt <gnutt@nuttx.org>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name NuttX nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************/
+
+/****************************************************************************
+ * Included Files
+ ****************************************************************************/
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/****************************************************************************
+ * Pre-processor Definitions
+ ****************************************************************************/
+
+/* Impairment settings.  These must be provided on the command line from the
+ * Kconfig settings.  Loss and reordering probabilities are in units of 0.1%.
+ */
+
+#ifndef CONFIG_SIM_NETIMPAIR_SEED
+#  define CONFIG_SIM_NETIMPAIR_SEED    1
+#endif
+
+#ifndef CONFIG_SIM_NETIMPAIR_LOSS
+#  define CONFIG_SIM_NETIMPAIR_LOSS    0
+#endif
+
+#ifndef CONFIG_SIM_NETIMPAIR_LATENCY
+#  define CONFIG_SIM_NETIMPAIR_LATENCY 0
+#endif
+
+#ifndef CONFIG_SIM_NETIMPAIR_JITTER
+#  define CONFIG_SIM_NETIMPAIR_JITTER  0
+#endif
+
+#ifndef CONFIG_SIM_NETIMPAIR_REORDER
+#  define CONFIG_SIM_NETIMPAIR_REORDER 0
+#endif
+
+#ifndef CONFIG_SIM_NETIMPAIR_RATE
+#  define CONFIG_SIM_NETIMPAIR_RATE    0
+#endif
+
+#ifndef CONFIG_SIM_NETIMPAIR_QLEN
+#  define CONFIG_SIM_NETIMPAIR_QLEN    64
+#endif
+
+/* Size of one frame buffer.  Normally provided on the command line */
+
+#ifndef NETDEV_BUFSIZE
+#  define NETDEV_BUFSIZE 1518
+#endif
+
+/****************************************************************************
+ * Private Types
+ ****************************************************************************/
+
+/* One frame held in the impairment queue */
+
+struct netimpair_frame_s
+{
+  struct netimpair_frame_s *flink;  /* Next frame in release order */
+  uint64_t      release;            /* Time (usec) when the frame leaves */
+  unsigned int  len;                /* Length of the frame */
+  unsigned char buf[NETDEV_BUFSIZE];
+};
+
+/* The state of one direction of an impaired link */
+
+struct netimpair_s
+{
+  struct netimpair_s *next;         /* Next in the list of all links */
+  struct netimpair_frame_s *head;   /* Queued frames in release order */
+  struct netimpair_frame_s *free;   /* Unused frames */
+  uint64_t linkfree;                /* Time (usec) when the link is idle */
+  unsigned int stream;              /* Stream number given at creation */
+  uint32_t rand;                    /* Pseudo-random number state */
+  unsigned long nlost;              /* Frames dropped by the loss model */
+  unsigned long noverflow;          /* Frames dropped on queue overflow */
+  unsigned long nreordered;         /* Frames sent out of order */
+  struct netimpair_frame_s frames[CONFIG_SIM_NETIMPAIR_QLEN];
+};
+
+/****************************************************************************
+ * Private Data
+ ****************************************************************************/
+
+/* All impairment stages, for the report at exit */
+
+static struct netimpair_s *g_netimpair;
+
+/****************************************************************************
+ * Private Functions
+ ****************************************************************************/
+
+/****************************************************************************
+ * Name: netimpair_now
+ *
+ * Description:
+ *   Return the current host monotonic time in microseconds
+ *
+ ****************************************************************************/
+
+static uint64_t netimpair_now(void)
+{
+  struct timespec ts;
+
+  (void)clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+/****************************************************************************
+ * Name: netimpair_random
+ *
+ * Description:
+ *   Return the next value from a xorshift32 sequence.  The sequence depends
+ *   only on the seed so that impaired runs are reproducible.
+ *
+ ****************************************************************************/
+
+static uint32_t netimpair_random(struct netimpair_s *imp)
+{
+  uint32_t x = imp->rand;
+
+  x ^= x << 13;
+  x ^= x >> 17;
+  x ^= x << 5;
+
+  imp->rand = x;
+  return x;
+}
+
+/****************************************************************************
+ * Name: netimpair_chance
+ *
+ * Description:
+ *   Return non-zero with the probability 'permille' / 1000
+ *
+ ****************************************************************************/
+
+static int netimpair_chance(struct netimpair_s *imp, unsigned int permille)
+{
+  return permille > 0 && (netimpair_random(imp) % 1000) < permille;
+}
+
+/****************************************************************************
+ * Name: netimpair_report
+ *
+ * Description:
+ *   Called at exit.  Report how many frames each impairment stage dropped
+ *   or reordered.
+ *
+ ****************************************************************************/
+
+static void netimpair_report(void)
+{
+  struct netimpair_s *imp;
+
+  for (imp = g_netimpair; imp != NULL; imp = imp->next)
+    {
+      fprintf(stderr, "netimpair %u: %lu lost, %lu overflowed, "
+              "%lu reordered\n", imp->stream, imp->nlost, imp->noverflow,
+              imp->nreordered);
+    }
+}
+
+/****************************************************************************
+ * Public Functions
+ ****************************************************************************/
+
+/****************************************************************************
+ * Name: netimpair_create
+ *
+ * Description:
+ *   Create the impairment state for one direction of a link.  Each
+ *   direction should be given a different 'stream' number so that the two
+ *   directions see independent but reproducible random sequences.
+ *
+ ****************************************************************************/
+
+struct netimpair_s *netimpair_create(unsigned int stream)
+{
+  struct netimpair_s *imp;
+  int i;
+
+  imp = (struct netimpair_s *)calloc(1, sizeof(struct netimpair_s));
+  if (imp == NULL)
+    {
+      return NULL;
+    }
+
+  for (i = 0; i < CONFIG_SIM_NETIMPAIR_QLEN; i++)
+    {
+      imp->frames[i].flink = imp->free;
+      imp->free            = &imp->frames[i];
+    }
+
+  /* xorshift32 must not be seeded with zero */
+
+  imp->rand = (uint32_t)CONFIG_SIM_NETIMPAIR_SEED * 2654435761u +
+              (uint32_t)stream * 40503u;
+  if (imp->rand == 0)
+    {
+      imp->rand = 1;
+    }
+
+  /* Report the statistics of all stages when the simulation exits */
+
+  if (g_netimpair == NULL)
+    {
+      (void)atexit(netimpair_report);
+    }
+
+  imp->stream = stream;
+  imp->next   = g_netimpair;
+  g_netimpair = imp;
+  return imp;
+}
+
+/****************************************************************************
+ * Name: netimpair_enqueue
+ *
+ * Description:
+ *   Pass one frame into the impairment stage.  The frame may be dropped;
+ *   otherwise it is copied and held until its release time.
+ *
+ * Returned Value:
+ *   1 if the frame was queued; 0 if it was dropped.
+ *
+ ****************************************************************************/
+
+int netimpair_enqueue(struct netimpair_s *imp, const unsigned char *buf,
+                      unsigned int len)
+{
+  struct netimpair_frame_s *frame;
+  struct netimpair_frame_s **pprev;
+  uint64_t sent;
+  int64_t delay;
+
+  /* Apply the random loss model first */
+
+  if (netimpair_chance(imp, CONFIG_SIM_NETIMPAIR_LOSS))
+    {
+      imp->nlost++;
+      return 0;
+    }
+
+  /* Then tail drop if the queue is full, as a router would */
+
+  frame = imp->free;
+  if (frame == NULL || len > NETDEV_BUFSIZE)
+    {
+      imp->noverflow++;
+      return 0;
+    }
+
+  imp->free  = frame->flink;
+  frame->len = len;
+  memcpy(frame->buf, buf, len);
+
+  /* Determine the delay.  A reordered frame skips the delay and
+   * overtakes the frames ahead of it that are still in flight.
+   */
+
+  if (netimpair_chance(imp, CONFIG_SIM_NETIMPAIR_REORDER))
+    {
+      imp->nreordered++;
+      delay = 0;
+    }
+  else
+    {
+      delay = (int64_t)CONFIG_SIM_NETIMPAIR_LATENCY * 1000;
+#if CONFIG_SIM_NETIMPAIR_JITTER > 0
+      delay += (int64_t)(netimpair_random(imp) %
+                         (2 * CONFIG_SIM_NETIMPAIR_JITTER * 1000 + 1)) -
+               (int64_t)CONFIG_SIM_NETIMPAIR_JITTER * 1000;
+      if (delay < 0)
+        {
+          delay = 0;
+        }
+#endif
+    }
+
+  /* Apply the bandwidth cap:  The frame is serialized onto the link after
+   * all earlier frames, reordered or not, and is then delayed.
+   */
+
+  sent = netimpair_now();
+
+#if CONFIG_SIM_NETIMPAIR_RATE > 0
+  if (sent < imp->linkfree)
+    {
+      sent = imp->linkfree;
+    }
+
+  sent         += (uint64_t)len * 8 * 1000 / CONFIG_SIM_NETIMPAIR_RATE;
+  imp->linkfree = sent;
+#endif
+
+  frame->release = sent + delay;
+
+  /* Insert the frame in release order, after any frames with the same
+   * release time.
+   */
+
+  for (pprev = &imp->head;
+       *pprev != NULL && (*pprev)->release <= frame->release;
+       pprev = &(*pprev)->flink);
+
+  frame->flink = *pprev;
+  *pprev       = frame;
+  return 1;
+}
+
+/****************************************************************************
+ * Name: netimpair_dequeue
+ *
+ * Description:
+ *   Return the next frame whose release time has passed.
+ *
+ * Returned Value:
+ *   The length of the frame copied to 'buf' or 0 if no frame is due.
+ *
+ ****************************************************************************/
+
+unsigned int netimpair_dequeue(struct netimpair_s *imp, unsigned char *buf,
+                               unsigned int buflen)
+{
+  struct netimpair_frame_s *frame = imp->head;
+  unsigned int len;
+
+  if (frame == NULL || frame->release > netimpair_now())
+    {
+      return 0;
+    }
+
+  len = frame->len < buflen ? frame->len : buflen;
+  memcpy(buf, frame->buf, len);
+
+  imp->head    = frame->flink;
+  frame->flink = imp->free;
+  imp->free    = frame;
+  return len;
+}
+
+/****************************************************************************
+ * Name: netimpair_timeout
+ *
+ * Description:
+ *   Return the time in milliseconds (rounded up) until the next queued
+ *   frame is due, or -1 if the queue is empty.  This is suitable for use
+ *   as a poll() timeout.
+ *
+ ****************************************************************************/
+
+int netimpair_timeout(struct netimpair_s *imp)
+{
+  uint64_t now;
+
+  if (imp->head == NULL)
+    {
+      return -1;
+    }
+
+  now = netimpair_now();
+  if (imp->head->release <= now)
+    {
+      return 0;
+    }
+
+  return (int)((imp->head->release - now + 999) / 1000);
+}
@@ -0,0 +1,587 @@
+/****************************************************************************
+ * arch/sim/src/up_pcapdev.c
+ *
+ *   Copyright (C) 2016 Gregory Nutt. All rights reserved.
+ *   Author: Gregory Nutt <gnutt@nuttx.org>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name NuttX nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************/
+
+/****************************************************************************
+ * Included Files
+ ****************************************************************************/
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+/****************************************************************************
+ * Pre-processor Definitions
+ ****************************************************************************/
+
+/* Configuration.  These must be provided on the command line from the
+ * Kconfig settings.
+ */
+
+#ifndef CONFIG_SIM_NETDEV_NUMBER
+#  define CONFIG_SIM_NETDEV_NUMBER 1
+#endif
+
+#ifndef CONFIG_SIM_NETDEV_PCAP_RXFILE
+#  define CONFIG_SIM_NETDEV_PCAP_RXFILE "nuttx-rx"
+#endif
+
+#ifndef CONFIG_SIM_NETDEV_PCAP_TXFILE
+#  define CONFIG_SIM_NETDEV_PCAP_TXFILE "nuttx-tx"
+#endif
+
+/* Size of one frame buffer.  Normally provided on the command line */
+
+#ifndef NETDEV_BUFSIZE
+#  define NETDEV_BUFSIZE 1518
+#endif
+
+/* The capture files of device N may be overridden with the host environment
+ * variables SIM_PCAPRX<N> and SIM_PCAPTX<N>.
+ */
+
+#define PCAPDEV_RXENV       "SIM_PCAPRX%d"
+#define PCAPDEV_TXENV       "SIM_PCAPTX%d"
+
+/* pcap file format */
+
+#define PCAP_MAGIC_USEC     0xa1b2c3d4
+#define PCAP_MAGIC_NSEC     0xa1b23c4d
+#define PCAP_VERSION_MAJOR  2
+#define PCAP_VERSION_MINOR  4
+#define PCAP_LINKTYPE_ETHER 1
+#define PCAP_SNAPLEN        65535
+
+/* Syslog priority (must match definitions in nuttx/include/syslog.h) */
+
+#define LOG_INFO      1  /* Informational message */
+#define LOG_ERR       4  /* Error conditions */
+
+/****************************************************************************
+ * Private Types
+ ****************************************************************************/
+
+struct pcap_filehdr_s
+{
+  uint32_t magic;
+  uint16_t major;
+  uint16_t minor;
+  int32_t  thiszone;
+  uint32_t sigfigs;
+  uint32_t snaplen;
+  uint32_t linktype;
+};
+
+struct pcap_rechdr_s
+{
+  uint32_t sec;
+  uint32_t subsec;                 /* usec or nsec, depending on magic */
+  uint32_t caplen;
+  uint32_t len;
+};
+
+/* The state of one device */
+
+struct pcapdev_s
+{
+  int devidx;                      /* Device index */
+  FILE *rxfile;                    /* Capture to be replayed (or NULL) */
+  FILE *txfile;                    /* Capture of transmitted frames */
+  int swapped;                     /* The replay file has foreign byte order */
+  int nsec;                        /* The replay file has nsec timestamps */
+  int pending;                     /* A replay frame has been read ahead */
+  unsigned char mac[6];            /* MAC address of the device */
+  uint64_t t0file;                 /* Time stamp of the first replay frame */
+  uint64_t t0host;                 /* Host time when it was delivered */
+  uint64_t tsfile;                 /* Time stamp of the pending frame */
+  unsigned int pendlen;            /* Length of the pending frame */
+  unsigned char pendbuf[NETDEV_BUFSIZE];
+
+  /* Statistics */
+
+  unsigned long rxframes;
+  unsigned long long rxbytes;
+  unsigned long txframes;
+  unsigned long long txbytes;
+  uint64_t tfirst;                 /* Time of the first frame */
+  uint64_t tlast;                  /* Time of the last frame */
+  uint64_t tlastrx;                /* Time of the last unanswered frame */
+  unsigned long nlatency;          /* Number of latency samples */
+  uint64_t latsum;                 /* Sum of response latencies */
+  uint64_t latmax;                 /* Worst response latency */
+};
+
+/****************************************************************************
+ * NuttX Domain Public Function Prototypes
+ ****************************************************************************/
+
+int syslog(int priority, const char *format, ...);
+int netdriver_setmacaddr(int devidx, unsigned char *macaddr);
+
+/****************************************************************************
+ * Host Domain Public Function Prototypes
+ ****************************************************************************/
+
+#ifdef CONFIG_SIM_HOSTTIMER
+void host_idle_wakeup(void);
+#endif
+
+/****************************************************************************
+ * Private Data
+ ****************************************************************************/
+
+static struct pcapdev_s g_pcapdev[CONFIG_SIM_NETDEV_NUMBER];
+static int g_pcapdev_atexit;
+
+/****************************************************************************
+ * Private Functions
+ ****************************************************************************/
+
+/****************************************************************************
+ * Name: pcapdev_now
+ *
+ * Description:
+ *   Return the current host monotonic time in microseconds
+ *
+ ****************************************************************************/
+
+static uint64_t pcapdev_now(void)
+{
+  struct timespec ts;
+
+  (void)clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+/****************************************************************************
+ * Name: pcapdev_swap32
+ ****************************************************************************/
+
+static inline uint32_t pcapdev_swap32(struct pcapdev_s *priv, uint32_t val)
+{
+  return priv->swapped ? __builtin_bswap32(val) : val;
+}
+
+/****************************************************************************
+ * Name: pcapdev_filename
+ *
+ * Description:
+ *   Return the name of a capture file:  The value of the environment
+ *   variable if it is set, otherwise the default prefix followed by the
+ *   device index and ".pcap".
+ *
+ ****************************************************************************/
+
+static const char *pcapdev_filename(char *buf, size_t buflen,
+                                    const char *envfmt, const char *prefix,
+                                    int devidx)
+{
+  char envname[16];
+  const char *env;
+
+  snprintf(envname, sizeof(envname), envfmt, devidx);
+  env = getenv(envname);
+  if (env != NULL)
+    {
+      return env;
+    }
+
+  snprintf(buf, buflen, "%s%d.pcap", prefix, devidx);
+  return buf;
+}
+
+/****************************************************************************
+ * Name: pcapdev_readahead
+ *
+ * Description:
+ *   Read the next frame of the replay file into the pending buffer
+ *
+ ****************************************************************************/
+
+static void pcapdev_readahead(struct pcapdev_s *priv)
+{
+  struct pcap_rechdr_s rec;
+  uint32_t caplen;
+  uint32_t subsec;
+
+  while (fread(&rec, sizeof(rec), 1, priv->rxfile) == 1)
+    {
+      caplen = pcapdev_swap32(priv, rec.caplen);
+      subsec = pcapdev_swap32(priv, rec.subsec);
+
+      if (caplen > NETDEV_BUFSIZE)
+        {
+          /* Too big for the device.  Skip it. */
+
+          if (fseek(priv->rxfile, caplen, SEEK_CUR) < 0)
+            {
+              break;
+            }
+
+          continue;
+        }
+
+      if (fread(priv->pendbuf, 1, caplen, priv->rxfile) != caplen)
+        {
+          break;
+        }
+
+      priv->pendlen = caplen;
+      priv->tsfile  = (uint64_t)pcapdev_swap32(priv, rec.sec) * 1000000 +
+                      (priv->nsec ? subsec / 1000 : subsec);
+      priv->pending = 1;
+      return;
+    }
+
+  /* End of the replay file */
+
+  priv->pending = 0;
+}
+
+/****************************************************************************
+ * Name: pcapdev_due
+ *
+ * Description:
+ *   Return non-zero if the pending replay frame may be delivered now.  The
+ *   first frame is always due.
+ *
+ ****************************************************************************/
+
+static int pcapdev_due(struct pcapdev_s *priv, uint64_t now)
+{
+#ifdef CONFIG_SIM_NETDEV_PCAP_REALTIME
+  return priv->rxframes == 0 ||
+         now - priv->t0host >= priv->tsfile - priv->t0file;
+#else
+  (void)priv;
+  (void)now;
+  return 1;
+#endif
+}
+
+/****************************************************************************
+ * Name: pcapdev_report
+ *
+ * Description:
+ *   Report the statistics of all devices.  Runs at exit of the simulation.
+ *
+ ****************************************************************************/
+
+static void pcapdev_report(void)
+{
+  struct pcapdev_s *priv;
+  uint64_t elapsed;
+  int devidx;
+
+  for (devidx = 0; devidx < CONFIG_SIM_NETDEV_NUMBER; devidx++)
+    {
+      priv    = &g_pcapdev[devidx];
+      elapsed = priv->tlast - priv->tfirst;
+
+      fprintf(stderr, "PCAPDEV%d: RX %lu frames %llu bytes, "
+              "TX %lu frames %llu bytes in %llu usec\n",
+              devidx, priv->rxframes, priv->rxbytes, priv->txframes,
+              priv->txbytes, (unsigned long long)elapsed);
+
+      if (elapsed > 0)
+        {
+          fprintf(stderr, "PCAPDEV%d: %llu RX frames/sec %llu TX frames/sec\n",
+                  devidx,
+                  (unsigned long long)priv->rxframes * 1000000 / elapsed,
+                  (unsigned long long)priv->txframes * 1000000 / elapsed);
+        }
+
+      if (priv->nlatency > 0)
+        {
+          fprintf(stderr, "PCAPDEV%d: Response latency avg %llu usec "
+                  "max %llu usec (%lu samples)\n",
+                  devidx,
+                  (unsigned long long)(priv->latsum / priv->nlatency),
+                  (unsigned long long)priv->latmax, priv->nlatency);
+        }
+
+      if (priv->txfile != NULL)
+        {
+          fclose(priv->txfile);
+          priv->txfile = NULL;
+        }
+    }
+}
+
+/****************************************************************************
+ * Public Functions
+ ****************************************************************************/
+
+/****************************************************************************
+ * Name: pcapdev_init
+ *
+ * Description:
+ *   Open the replay and capture files of device 'devidx'.  A missing
+ *   replay file is not an error; the device then only captures.
+ *
+ ****************************************************************************/
+
+void pcapdev_init(int devidx)
+{
+  struct pcapdev_s *priv = &g_pcapdev[devidx];
+  struct pcap_filehdr_s hdr;
+  unsigned char *mac = priv->mac;
+  const char *name;
+  char buf[256];
+
+  priv->devidx = devidx;
+
+  /* Open the replay file and check its header */
+
+  name = pcapdev_filename(buf, sizeof(buf), PCAPDEV_RXENV,
+                          CONFIG_SIM_NETDEV_PCAP_RXFILE, devidx);
+
+  priv->rxfile = fopen(name, "rb");
+  if (priv->rxfile != NULL)
+    {
+      if (fread(&hdr, sizeof(hdr), 1, priv->rxfile) != 1)
+        {
+          goto errout_with_rxfile;
+        }
+
+      if (hdr.magic == PCAP_MAGIC_USEC || hdr.magic == PCAP_MAGIC_NSEC)
+        {
+          priv->swapped = 0;
+        }
+      else if (__builtin_bswap32(hdr.magic) == PCAP_MAGIC_USEC ||
+               __builtin_bswap32(hdr.magic) == PCAP_MAGIC_NSEC)
+        {
+          priv->swapped = 1;
+        }
+      else
+        {
+          goto errout_with_rxfile;
+        }
+
+      priv->nsec = (pcapdev_swap32(priv, hdr.magic) == PCAP_MAGIC_NSEC);
+      if (pcapdev_swap32(priv, hdr.linktype) != PCAP_LINKTYPE_ETHER)
+        {
+          goto errout_with_rxfile;
+        }
+
+      syslog(LOG_INFO, "PCAPDEV: Device %d replaying %s\n", devidx, name);
+      pcapdev_readahead(priv);
+    }
+
+  /* Create the capture file of transmitted frames */
+
+  name = pcapdev_filename(buf, sizeof(buf), PCAPDEV_TXENV,
+                          CONFIG_SIM_NETDEV_PCAP_TXFILE, devidx);
+
+  priv->txfile = fopen(name, "wb");
+  if (priv->txfile == NULL)
+    {
+      syslog(LOG_ERR, "PCAPDEV: Failed to create %s\n", name);
+    }
+  else
+    {
+      memset(&hdr, 0, sizeof(hdr));
+      hdr.magic    = PCAP_MAGIC_USEC;
+      hdr.major    = PCAP_VERSION_MAJOR;
+      hdr.minor    = PCAP_VERSION_MINOR;
+      hdr.snaplen  = PCAP_SNAPLEN;
+      hdr.linktype = PCAP_LINKTYPE_ETHER;
+
+      (void)fwrite(&hdr, sizeof(hdr), 1, priv->txfile);
+    }
+
+  /* The destination of the replayed frames is not known in advance.  Use a
+   * fixed, locally administered MAC address.
+   */
+
+  mac[0] = 0x02;
+  mac[1] = 0x4e;
+  mac[2] = 0x58;
+  mac[3] = 0x00;
+  mac[4] = 0x00;
+  mac[5] = (unsigned char)devidx;
+
+  (void)netdriver_setmacaddr(devidx, mac);
+
+  if (!g_pcapdev_atexit)
+    {
+      g_pcapdev_atexit = 1;
+      (void)atexit(pcapdev_report);
+    }
+
+  return;
+
+errout_with_rxfile:
+  syslog(LOG_ERR, "PCAPDEV: %s is not an Ethernet pcap file\n", name);
+  fclose(priv->rxfile);
+  priv->rxfile = NULL;
+}
+
+/****************************************************************************
+ * Name: pcapdev_read
+ *
+ * Description:
+ *   Return the next frame of the replay file.  If CONFIG_SIM_NETDEV_PCAP_-
+ *   REALTIME is selected, frames are returned no earlier than their
+ *   original time relative to the first frame.  Otherwise they are returned
+ *   as fast as the network can take them.
+ *
+ * Returned Value:
+ *   The length of the frame or zero if no frame is due.
+ *
+ ****************************************************************************/
+
+unsigned int pcapdev_read(int devidx, unsigned char *buf, unsigned int buflen)
+{
+  struct pcapdev_s *priv = &g_pcapdev[devidx];
+  unsigned int len;
+  uint64_t now;
+
+  if (!priv->pending)
+    {
+      return 0;
+    }
+
+  now = pcapdev_now();
+  if (!pcapdev_due(priv, now))
+    {
+      return 0;
+    }
+
+  if (priv->rxframes == 0)
+    {
+      priv->t0file = priv->tsfile;
+      priv->t0host = now;
+    }
+
+  len = priv->pendlen < buflen ? priv->pendlen : buflen;
+  memcpy(buf, priv->pendbuf, len);
+
+#ifdef CONFIG_SIM_NETDEV_PCAP_REWRITE
+  /* Address unicast frames to this device so that the network accepts
+   * them no matter where they were captured.
+   */
+
+  if (len >= sizeof(priv->mac) && (buf[0] & 1) == 0)
+    {
+      memcpy(buf, priv->mac, sizeof(priv->mac));
+    }
+#endif
+
+  if (priv->rxframes == 0 && priv->txframes == 0)
+    {
+      priv->tfirst = now;
+    }
+
+  priv->rxframes++;
+  priv->rxbytes += len;
+  priv->tlast    = now;
+  priv->tlastrx  = now;
+
+  pcapdev_readahead(priv);
+
+#ifdef CONFIG_SIM_HOSTTIMER
+  /* There is no host thread to signal new input.  If the next frame is
+   * already due but does not fit into this IDLE loop pass, don't let it
+   * wait for the IDLE loop timeout.
+   */
+
+  if (priv->pending && pcapdev_due(priv, now))
+    {
+      host_idle_wakeup();
+    }
+#endif
+
+  return len;
+}
+
+/****************************************************************************
+ * Name: pcapdev_send
+ *
+ * Description:
+ *   Append a transmitted frame to the capture file, time stamped with the
+ *   host wall clock time.
+ *
+ ****************************************************************************/
+
+void pcapdev_send(int devidx, unsigned char *buf, unsigned int buflen)
+{
+  struct pcapdev_s *priv = &g_pcapdev[devidx];
+  struct pcap_rechdr_s rec;
+  struct timespec ts;
+  uint64_t now;
+
+  now = pcapdev_now();
+  if (priv->rxframes == 0 && priv->txframes == 0)
+    {
+      priv->tfirst = now;
+    }
+
+  priv->txframes++;
+  priv->txbytes += buflen;
+  priv->tlast    = now;
+
+  /* The first frame sent after a frame was received is taken to be the
+   * response to it.
+   */
+
+  if (priv->tlastrx != 0)
+    {
+      uint64_t latency = now - priv->tlastrx;
+
+      priv->latsum += latency;
+      if (latency > priv->latmax)
+        {
+          priv->latmax = latency;
+        }
+
+      priv->nlatency++;
+      priv->tlastrx = 0;
+    }
+
+  if (priv->txfile != NULL)
+    {
+      (void)clock_gettime(CLOCK_REALTIME, &ts);
+
+      rec.sec    = (uint32_t)ts.tv_sec;
+      rec.subsec = (uint32_t)(ts.tv_nsec / 1000);
+      rec.caplen = buflen;
+      rec.len    = buflen;
+
+      (void)fwrite(&rec, sizeof(rec), 1, priv->txfile);
+      (void)fwrite(buf, 1, buflen, priv->txfile);
+    }
+}
@@ -0,0 +1,554 @@
+/****************************************************************************
+ * arch/sim/src/up_profile.c
+ *
+ *   Copyright (C) 2016 Gregory Nutt. All rights reserved.
+ *   Author: Gregory Nutt <gnutt@nuttx.org>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name NuttX nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************/
+
+/****************************************************************************
+ * Included Files
+ ****************************************************************************/
+
+#define _GNU_SOURCE 1
+
+#include <sys/types.h>
+#include <sys/time.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <link.h>
+#include <signal.h>
+#include <ucontext.h>
+#include <unistd.h>
+
+/****************************************************************************
+ * Pre-processor Definitions
+ ****************************************************************************/
+
+#ifndef CONFIG_SIM_PROFILE_HZ
+#  define CONFIG_SIM_PROFILE_HZ 997
+#endif
+
+#ifndef CONFIG_SIM_PROFILE_NSAMPLES
+#  define CONFIG_SIM_PROFILE_NSAMPLES 65536
+#endif
+
+#ifndef CONFIG_SIM_PROFILE_DEPTH
+#  define CONFIG_SIM_PROFILE_DEPTH 32
+#endif
+
+#ifndef CONFIG_SIM_PROFILE_PATH
+#  define CONFIG_SIM_PROFILE_PATH "nuttx-profile.folded"
+#endif
+
+/* Number of remembered task names */
+
+#define PROFILE_NNAMES   128
+#define PROFILE_NAMESIZE 32
+
+/* Registers of the interrupted context */
+
+#ifdef __x86_64__
+#  define PROFILE_PC(uc) ((uc)->uc_mcontext.gregs[REG_RIP])
+#  define PROFILE_FP(uc) ((uc)->uc_mcontext.gregs[REG_RBP])
+#else
+#  define PROFILE_PC(uc) ((uc)->uc_mcontext.gregs[REG_EIP])
+#  define PROFILE_FP(uc) ((uc)->uc_mcontext.gregs[REG_EBP])
+#endif
+
+/****************************************************************************
+ * Private Types
+ ****************************************************************************/
+
+struct profile_sample_s
+{
+  int pid;                                 /* Interrupted NuttX task */
+  int depth;                               /* Number of valid frames */
+  uintptr_t frame[CONFIG_SIM_PROFILE_DEPTH]; /* PC, then return addresses */
+};
+
+struct profile_name_s
+{
+  int pid;
+  char name[PROFILE_NAMESIZE];
+};
+
+struct profile_symbol_s
+{
+  uintptr_t value;
+  uintptr_t size;
+  const char *name;
+};
+
+/****************************************************************************
+ * NuttX Domain Public Function Prototypes
+ ****************************************************************************/
+
+int sim_profile_task(uintptr_t *stackbase, uintptr_t *stacktop,
+                     const char **name);
+
+/****************************************************************************
+ * Private Data
+ ****************************************************************************/
+
+static struct profile_sample_s *g_samples;
+static volatile unsigned long g_nsamples;   /* Samples claimed */
+static volatile unsigned long g_ndropped;   /* Samples lost: buffer full */
+
+static struct profile_name_s g_names[PROFILE_NNAMES];
+
+/* Set in the host threads that simulate CPUs.  SIGPROF is delivered to
+ * whichever thread is running, including host helper threads (network,
+ * UART and host file system I/O), whose samples are discarded.
+ */
+
+static __thread int g_profilecpu;
+
+/* Function symbols of the executable, sorted by address */
+
+static struct profile_symbol_s *g_symbols;
+static size_t g_nsymbols;
+static uintptr_t g_bias;
+
+/****************************************************************************
+ * Private Functions
+ ****************************************************************************/
+
+/****************************************************************************
+ * Name: profile_handler
+ *
+ * Description:
+ *   SIGPROF handler.  Record the interrupted PC and NuttX task.  If the
+ *   task's stack is known, follow the frame pointer chain within it to
+ *   collect the callers.  Samples are claimed with an atomic increment,
+ *   so this is safe on any CPU thread.  Samples from other host threads
+ *   are ignored.
+ *
+ ****************************************************************************/
+
+static void profile_handler(int signo, siginfo_t *info, void *context)
+{
+  ucontext_t *uc = (ucontext_t *)context;
+  struct profile_sample_s *sample;
+  struct profile_name_s *entry;
+  const char *name;
+  uintptr_t stackbase;
+  uintptr_t stacktop;
+  uintptr_t fp;
+  uintptr_t next;
+  unsigned long index;
+  int saved_errno = errno;
+  int depth;
+  int pid;
+
+  if (!g_profilecpu)
+    {
+      return;
+    }
+
+  index = __atomic_fetch_add(&g_nsamples, 1, __ATOMIC_RELAXED);
+  if (index >= CONFIG_SIM_PROFILE_NSAMPLES)
+    {
+      __atomic_fetch_add(&g_ndropped, 1, __ATOMIC_RELAXED);
+      errno = saved_errno;
+      return;
+    }
+
+  sample = &g_samples[index];
+  pid    = sim_profile_task(&stackbase, &stacktop, &name);
+
+  sample->frame[0] = (uintptr_t)PROFILE_PC(uc);
+  depth            = 1;
+
+  fp = (uintptr_t)PROFILE_FP(uc);
+  while (depth < CONFIG_SIM_PROFILE_DEPTH && stackbase != 0 &&
+         fp >= stackbase && fp + 2 * sizeof(uintptr_t) <= stacktop &&
+         (fp & (sizeof(uintptr_t) - 1)) == 0)
+    {
+      sample->frame[depth++] = ((uintptr_t *)fp)[1];
+
+      /* Frames must move towards the top of the stack */
+
+      next = ((uintptr_t *)fp)[0];
+      if (next <= fp)
+        {
+          break;
+        }
+
+      fp = next;
+    }
+
+  sample->depth = depth;
+  __atomic_store_n(&sample->pid, pid, __ATOMIC_RELEASE);
+
+  /* Remember the task name while the TCB still exists */
+
+  entry = &g_names[pid % PROFILE_NNAMES];
+  if (name != NULL && entry->pid != pid)
+    {
+      strncpy(entry->name, name, PROFILE_NAMESIZE - 1);
+      entry->pid = pid;
+    }
+
+  errno = saved_errno;
+}
+
+/****************************************************************************
+ * Name: profile_symcompare and profile_strcompare
+ ****************************************************************************/
+
+static int profile_symcompare(const void *a, const void *b)
+{
+  const struct profile_symbol_s *sa = a;
+  const struct profile_symbol_s *sb = b;
+
+  return sa->value < sb->value ? -1 : sa->value > sb->value;
+}
+
+static int profile_strcompare(const void *a, const void *b)
+{
+  return strcmp(*(char * const *)a, *(char * const *)b);
+}
+
+/****************************************************************************
+ * Name: profile_loadsymbols
+ *
+ * Description:
+ *   Read the function symbols from the symbol table of the running
+ *   executable.  The load bias of a position independent executable is
+ *   found from the address of profile_handler().
+ *
+ ****************************************************************************/
+
+static void profile_loadsymbols(void)
+{
+  const ElfW(Ehdr) *ehdr;
+  const ElfW(Shdr) *shdr;
+  const ElfW(Sym) *sym;
+  const char *strtab;
+  struct stat buf;
+  uint8_t *image;
+  size_t nsyms;
+  size_t i;
+  int fd;
+  int s;
+
+  fd = open("/proc/self/exe", O_RDONLY);
+  if (fd < 0 || fstat(fd, &buf) < 0)
+    {
+      goto errout;
+    }
+
+  image = mmap(NULL, buf.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  if (image == MAP_FAILED)
+    {
+      goto errout;
+    }
+
+  ehdr = (const ElfW(Ehdr) *)image;
+  shdr = (const ElfW(Shdr) *)(image + ehdr->e_shoff);
+
+  for (s = 0; s < ehdr->e_shnum; s++)
+    {
+      if (shdr[s].sh_type != SHT_SYMTAB)
+        {
+          continue;
+        }
+
+      sym    = (const ElfW(Sym) *)(image + shdr[s].sh_offset);
+      nsyms  = shdr[s].sh_size / sizeof(ElfW(Sym));
+      strtab = (const char *)(image + shdr[shdr[s].sh_link].sh_offset);
+
+      g_symbols = malloc(nsyms * sizeof(struct profile_symbol_s));
+      if (g_symbols == NULL)
+        {
+          break;
+        }
+
+      for (i = 0; i < nsyms; i++)
+        {
+          if (ELF32_ST_TYPE(sym[i].st_info) == STT_FUNC &&
+              sym[i].st_value != 0)
+            {
+              g_symbols[g_nsymbols].value = sym[i].st_value;
+              g_symbols[g_nsymbols].size  = sym[i].st_size;
+              g_symbols[g_nsymbols].name  = strtab + sym[i].st_name;
+
+              if (strcmp(g_symbols[g_nsymbols].name,
+                         "profile_handler") == 0)
+                {
+                  g_bias = (uintptr_t)profile_handler - sym[i].st_value;
+                }
+
+              g_nsymbols++;
+            }
+        }
+
+      qsort(g_symbols, g_nsymbols, sizeof(struct profile_symbol_s),
+            profile_symcompare);
+      break;
+    }
+
+  /* The mapping is kept because the symbol names point into it */
+
+errout:
+  if (fd >= 0)
+    {
+      (void)close(fd);
+    }
+}
+
+/****************************************************************************
+ * Name: profile_symbolize
+ *
+ * Description:
+ *   Return the name of the function containing an address or format the
+ *   address in hexadecimal if it is not within a known function.
+ *
+ ****************************************************************************/
+
+static const char *profile_symbolize(uintptr_t addr, char *buffer,
+                                     size_t len)
+{
+  size_t low = 0;
+  size_t high = g_nsymbols;
+  size_t mid;
+
+  addr -= g_bias;
+  while (low < high)
+    {
+      mid = (low + high) / 2;
+      if (g_symbols[mid].value <= addr)
+        {
+          low = mid + 1;
+        }
+      else
+        {
+          high = mid;
+        }
+    }
+
+  /* Symbols without a size (such as assembly functions) extend up to the
+   * next symbol, but the last one is not trusted.
+   */
+
+  if (low > 0 &&
+      (addr < g_symbols[low - 1].value + g_symbols[low - 1].size ||
+       (g_symbols[low - 1].size == 0 && low < g_nsymbols)))
+    {
+      return g_symbols[low - 1].name;
+    }
+
+  snprintf(buffer, len, "0x%lx", (unsigned long)(addr + g_bias));
+  return buffer;
+}
+
+/****************************************************************************
+ * Name: profile_report
+ *
+ * Description:
+ *   Stop sampling and write the samples as folded stacks, one line per
+ *   distinct stack with its sample count:
+ *
+ *     task;outermost;...;innermost count
+ *
+ *   The output can be passed directly to flamegraph.pl.
+ *
+ ****************************************************************************/
+
+static void profile_report(void)
+{
+  struct itimerval timer;
+  struct profile_sample_s *sample;
+  struct profile_name_s *entry;
+  char symbuf[24];
+  char **lines;
+  char *line;
+  size_t linesize;
+  size_t used;
+  unsigned long nsamples;
+  unsigned long nlines = 0;
+  unsigned long count;
+  unsigned long i;
+  FILE *stream;
+  int d;
+
+  memset(&timer, 0, sizeof(timer));
+  (void)setitimer(ITIMER_PROF, &timer, NULL);
+
+  nsamples = g_nsamples;
+  if (nsamples > CONFIG_SIM_PROFILE_NSAMPLES)
+    {
+      nsamples = CONFIG_SIM_PROFILE_NSAMPLES;
+    }
+
+  profile_loadsymbols();
+
+  linesize = PROFILE_NAMESIZE + 16 + CONFIG_SIM_PROFILE_DEPTH * 64;
+  lines    = malloc(nsamples * sizeof(char *));
+  if (lines == NULL)
+    {
+      return;
+    }
+
+  for (i = 0; i < nsamples; i++)
+    {
+      sample = &g_samples[i];
+      if (__atomic_load_n(&sample->pid, __ATOMIC_ACQUIRE) < 0)
+        {
+          continue;
+        }
+
+      line = malloc(linesize);
+      if (line == NULL)
+        {
+          break;
+        }
+
+      entry = &g_names[sample->pid % PROFILE_NNAMES];
+      if (entry->pid == sample->pid && entry->name[0] != '\0')
+        {
+          used = snprintf(line, linesize, "%s (%d)", entry->name,
+                          sample->pid);
+        }
+      else
+        {
+          used = snprintf(line, linesize, "pid %d", sample->pid);
+        }
+
+      /* Return addresses point after the call; look up the call itself */
+
+      for (d = sample->depth - 1; d >= 0 && used < linesize; d--)
+        {
+          used += snprintf(line + used, linesize - used, ";%s",
+                           profile_symbolize(sample->frame[d] - (d > 0),
+                                             symbuf, sizeof(symbuf)));
+        }
+
+      lines[nlines++] = line;
+    }
+
+  qsort(lines, nlines, sizeof(char *), profile_strcompare);
+
+  stream = fopen(CONFIG_SIM_PROFILE_PATH, "w");
+  if (stream != NULL)
+    {
+      for (i = 0; i < nlines; i += count)
+        {
+          for (count = 1; i + count < nlines &&
+               strcmp(lines[i], lines[i + count]) == 0; count++);
+          fprintf(stream, "%s %lu\n", lines[i], count);
+        }
+
+      (void)fclose(stream);
+    }
+
+  fprintf(stderr, "profile: %lu samples (%lu dropped) written to %s\n",
+          nlines, g_ndropped, CONFIG_SIM_PROFILE_PATH);
+
+  for (i = 0; i < nlines; i++)
+    {
+      free(lines[i]);
+    }
+
+  free(lines);
+}
+
+/****************************************************************************
+ * Public Functions
+ ****************************************************************************/
+
+/****************************************************************************
+ * Name: sim_profile_cputhread
+ *
+ * Description:
+ *   Mark the calling host thread as one that simulates a CPU, so that
+ *   SIGPROF samples taken on it are recorded.
+ *
+ ****************************************************************************/
+
+void sim_profile_cputhread(void)
+{
+  g_profilecpu = 1;
+}
+
+/****************************************************************************
+ * Name: sim_profile_initialize
+ *
+ * Description:
+ *   Start sampling at CONFIG_SIM_PROFILE_HZ samples per second of CPU time
+ *   used by the simulation.  The profile is written when it exits.  This
+ *   is called on the thread of CPU0, which is marked as a CPU thread.
+ *
+ ****************************************************************************/
+
+void sim_profile_initialize(void)
+{
+  struct sigaction act;
+  struct itimerval timer;
+  unsigned long i;
+
+  g_samples = calloc(CONFIG_SIM_PROFILE_NSAMPLES,
+                     sizeof(struct profile_sample_s));
+  if (g_samples == NULL)
+    {
+      return;
+    }
+
+  for (i = 0; i < CONFIG_SIM_PROFILE_NSAMPLES; i++)
+    {
+      g_samples[i].pid = -1;
+    }
+
+  memset(&act, 0, sizeof(act));
+  act.sa_sigaction = profile_handler;
+  act.sa_flags     = SA_SIGINFO | SA_RESTART;
+  sigemptyset(&act.sa_mask);
+
+  if (sigaction(SIGPROF, &act, NULL) < 0)
+    {
+      return;
+    }
+
+  (void)atexit(profile_report);
+  sim_profile_cputhread();
+
+  timer.it_interval.tv_sec  = 0;
+  timer.it_interval.tv_usec = 1000000 / CONFIG_SIM_PROFILE_HZ;
+  timer.it_value            = timer.it_interval;
+  (void)setitimer(ITIMER_PROF, &timer, NULL);
+}
@@ -0,0 +1,88 @@
+/****************************************************************************
+ * arch/sim/src/up_profiletask.c
+ *
+ *   Copyright (C) 2016 Gregory Nutt. All rights reserved.
+ *   Author: Gregory Nutt <gnutt@nuttx.org>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name NuttX nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************/
+
+/****************************************************************************
+ * Included Files
+ ****************************************************************************/
+
+#include <nuttx/config.h>
+
+#include <stdint.h>
+
+#include <nuttx/sched.h>
+
+#include "sched/sched.h"
+#include "up_internal.h"
+
+/****************************************************************************
+ * Public Functions
+ ****************************************************************************/
+
+/****************************************************************************
+ * Name: sim_profile_task
+ *
+ * Description:
+ *   Called from the SIGPROF handler.  Return the PID of the running task
+ *   and the bounds of its stack and its name, if known.  This only reads
+ *   the TCB and so is safe to call from a signal handler.
+ *
+ ****************************************************************************/
+
+int sim_profile_task(FAR uintptr_t *stackbase, FAR uintptr_t *stacktop,
+                     FAR const char **name)
+{
+  FAR struct tcb_s *tcb = this_task();
+
+  /* The stack of the IDLE task is the host stack and is not known */
+
+  if (tcb->adj_stack_ptr != NULL)
+    {
+      *stacktop  = (uintptr_t)tcb->adj_stack_ptr + sizeof(uint32_t);
+      *stackbase = *stacktop - tcb->adj_stack_size;
+    }
+  else
+    {
+      *stacktop  = 0;
+      *stackbase = 0;
+    }
+
+#if CONFIG_TASK_NAME_SIZE > 0
+  *name = tcb->name;
+#else
+  *name = NULL;
+#endif
+
+  return tcb->pid;
+}
@@ -0,0 +1,327 @@
+/****************************************************************************
+ * arch/sim/src/up_replay.c
+ *
+ *   Copyright (C) 2016 Gregory Nutt. All rights reserved.
+ *   Author: Gregory Nutt <gnutt@nuttx.org>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name NuttX nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************/
+
+/****************************************************************************
+ * Included Files
+ ****************************************************************************/
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+/****************************************************************************
+ * Pre-processor Definitions
+ ****************************************************************************/
+
+#ifndef CONFIG_SIM_REPLAY_PATH
+#  define CONFIG_SIM_REPLAY_PATH "nuttx-events.rpl"
+#endif
+
+#if defined(CONFIG_SIM_REPLAY_RECORD) && defined(CONFIG_SIM_REPLAY_PLAY)
+#  error CONFIG_SIM_REPLAY_RECORD and CONFIG_SIM_REPLAY_PLAY are exclusive
+#elif !defined(CONFIG_SIM_REPLAY_PLAY)
+#  define CONFIG_SIM_REPLAY_RECORD 1
+#endif
+
+/* The log starts with this 8 byte magic and is followed by one record per
+ * event: A struct replay_record_s header followed by 'len' bytes of event
+ * data.  Everything is in host byte order.
+ */
+
+#define REPLAY_MAGIC "SIMRPL01"
+#define REPLAY_MAGICLEN 8
+
+/****************************************************************************
+ * Private Types
+ ****************************************************************************/
+
+struct replay_record_s
+{
+  uint64_t pass;    /* IDLE pass in which the event was delivered */
+  uint32_t source;  /* SIM_REPLAY_UART, SIM_REPLAY_X11, SIM_REPLAY_NET + n */
+  uint32_t len;     /* Number of bytes of event data that follow */
+};
+
+/****************************************************************************
+ * Private Data
+ ****************************************************************************/
+
+static FILE *g_replay_file;
+
+/* The virtual time:  The number of passes through the IDLE loop.  Host
+ * events are only made visible to NuttX at fixed points in the IDLE loop,
+ * so an event is fully placed by the pass in which it was delivered.
+ */
+
+static uint64_t g_replay_pass;
+static unsigned long g_replay_nevents;
+
+#ifdef CONFIG_SIM_REPLAY_RECORD
+static bool g_replay_dirty;
+#else
+/* The next record to be replayed and its data */
+
+static struct replay_record_s g_replay_next;
+static unsigned char *g_replay_data;
+static uint32_t g_replay_datalen;
+static bool g_replay_valid;
+static unsigned long g_replay_nmissed;
+static unsigned long g_replay_ntruncated;
+#endif
+
+/****************************************************************************
+ * Private Functions
+ ****************************************************************************/
+
+#ifdef CONFIG_SIM_REPLAY_PLAY
+/****************************************************************************
+ * Name: replay_load
+ *
+ * Description:
+ *   Read the next record from the log.
+ *
+ ****************************************************************************/
+
+static void replay_load(void)
+{
+  g_replay_valid = false;
+
+  if (fread(&g_replay_next, sizeof(g_replay_next), 1, g_replay_file) != 1)
+    {
+      return;
+    }
+
+  if (g_replay_next.len > g_replay_datalen)
+    {
+      unsigned char *data = realloc(g_replay_data, g_replay_next.len);
+      if (data == NULL)
+        {
+          return;
+        }
+
+      g_replay_data    = data;
+      g_replay_datalen = g_replay_next.len;
+    }
+
+  if (g_replay_next.len > 0 &&
+      fread(g_replay_data, g_replay_next.len, 1, g_replay_file) != 1)
+    {
+      return;
+    }
+
+  g_replay_valid = true;
+}
+#endif
+
+/****************************************************************************
+ * Name: replay_report
+ ****************************************************************************/
+
+static void replay_report(void)
+{
+#ifdef CONFIG_SIM_REPLAY_RECORD
+  fprintf(stderr, "replay: Recorded %lu events in %llu IDLE passes to %s\n",
+          g_replay_nevents, (unsigned long long)g_replay_pass,
+          CONFIG_SIM_REPLAY_PATH);
+#else
+  fprintf(stderr, "replay: Replayed %lu events in %llu IDLE passes from %s"
+          "%s\n", g_replay_nevents, (unsigned long long)g_replay_pass,
+          CONFIG_SIM_REPLAY_PATH, g_replay_valid ? " (incomplete)" : "");
+
+  if (g_replay_nmissed > 0 || g_replay_ntruncated > 0)
+    {
+      fprintf(stderr, "replay: DIVERGED: %lu events missed, %lu truncated\n",
+              g_replay_nmissed, g_replay_ntruncated);
+    }
+#endif
+
+  fclose(g_replay_file);
+}
+
+/****************************************************************************
+ * Public Functions
+ ****************************************************************************/
+
+/****************************************************************************
+ * Name: sim_replay_initialize
+ *
+ * Description:
+ *   Open the event log for recording or for replay.  Called before any of
+ *   the event sources are started.
+ *
+ ****************************************************************************/
+
+void sim_replay_initialize(void)
+{
+#ifdef CONFIG_SIM_REPLAY_RECORD
+  g_replay_file = fopen(CONFIG_SIM_REPLAY_PATH, "wb");
+  if (g_replay_file == NULL)
+    {
+      fprintf(stderr, "replay: Failed to create %s\n",
+              CONFIG_SIM_REPLAY_PATH);
+      return;
+    }
+
+  (void)fwrite(REPLAY_MAGIC, REPLAY_MAGICLEN, 1, g_replay_file);
+#else
+  char magic[REPLAY_MAGICLEN];
+
+  g_replay_file = fopen(CONFIG_SIM_REPLAY_PATH, "rb");
+  if (g_replay_file == NULL)
+    {
+      fprintf(stderr, "replay: Failed to open %s\n", CONFIG_SIM_REPLAY_PATH);
+      return;
+    }
+
+  if (fread(magic, REPLAY_MAGICLEN, 1, g_replay_file) != 1 ||
+      memcmp(magic, REPLAY_MAGIC, REPLAY_MAGICLEN) != 0)
+    {
+      fprintf(stderr, "replay: %s is not an event log\n",
+              CONFIG_SIM_REPLAY_PATH);
+      fclose(g_replay_file);
+      g_replay_file = NULL;
+      return;
+    }
+
+  replay_load();
+#endif
+
+  atexit(replay_report);
+}
+
+/****************************************************************************
+ * Name: sim_replay_advance
+ *
+ * Description:
+ *   Called at the start of each pass through the IDLE loop to advance the
+ *   virtual time.  When recording, the events of the previous pass are
+ *   written out so that the log survives a crash.
+ *
+ ****************************************************************************/
+
+void sim_replay_advance(void)
+{
+  g_replay_pass++;
+
+#ifdef CONFIG_SIM_REPLAY_RECORD
+  if (g_replay_dirty)
+    {
+      (void)fflush(g_replay_file);
+      g_replay_dirty = false;
+    }
+#endif
+}
+
+#ifdef CONFIG_SIM_REPLAY_RECORD
+/****************************************************************************
+ * Name: sim_replay_record
+ *
+ * Description:
+ *   Log an event at the point where it is delivered to NuttX.
+ *
+ ****************************************************************************/
+
+void sim_replay_record(int source, const void *data, unsigned int len)
+{
+  struct replay_record_s record;
+
+  if (g_replay_file == NULL)
+    {
+      return;
+    }
+
+  record.pass   = g_replay_pass;
+  record.source = source;
+  record.len    = len;
+
+  (void)fwrite(&record, sizeof(record), 1, g_replay_file);
+  (void)fwrite(data, len, 1, g_replay_file);
+
+  g_replay_nevents++;
+  g_replay_dirty = true;
+}
+#endif
+
+#ifdef CONFIG_SIM_REPLAY_PLAY
+/****************************************************************************
+ * Name: sim_replay_fetch
+ *
+ * Description:
+ *   Return the next logged event if it was delivered from 'source' in the
+ *   current IDLE pass.  Events are consumed strictly in log order, which
+ *   is the order in which the IDLE loop polls its sources.
+ *
+ * Returned Value:
+ *   The number of bytes of event data returned, or zero if there is no
+ *   event for 'source' now.
+ *
+ ****************************************************************************/
+
+unsigned int sim_replay_fetch(int source, void *data, unsigned int len)
+{
+  /* Events logged in an earlier pass were not consumed when they should
+   * have been.  The run has diverged from the recording.  Drop them.
+   */
+
+  while (g_replay_valid && g_replay_next.pass < g_replay_pass)
+    {
+      g_replay_nmissed++;
+      replay_load();
+    }
+
+  if (!g_replay_valid || g_replay_next.pass != g_replay_pass ||
+      g_replay_next.source != (uint32_t)source)
+    {
+      return 0;
+    }
+
+  if (g_replay_next.len > len)
+    {
+      g_replay_ntruncated++;
+    }
+  else
+    {
+      len = g_replay_next.len;
+    }
+
+  memcpy(data, g_replay_data, len);
+  g_replay_nevents++;
+
+  replay_load();
+  return len;
+}
+#endif
@@ -132,44 +132,11 @@ void up_reprioritize_rtr(struct tcb_s *tcb, uint8_t priority)
               sched_mergepending();
             }
 
-          /* Update scheduler parameters */
-
-          sched_suspend_scheduler(rtcb);
-
-          /* Copy the exception context into the TCB at the (old) head of the
-           * ready-to-run Task list. if up_setjmp returns a non-zero
-           * value, then this is really the previously running task restarting!
+          /* Save the context of the task at the (old) head of the
+           * ready-to-run list and switch to the task at the (new) head.
            */
 
-          if (!up_setjmp(rtcb->xcp.regs))
-            {
-              /* Restore the exception context of the rtcb at the (new) head
-               * of the ready-to-run task list.
-               */
-
-              rtcb = this_task();
-              sdbg("New Active Task TCB=%p\n", rtcb);
-
-              /* The way that we handle signals in the simulation is kind of
-               * a kludge.  This would be unsafe in a truly multi-threaded, interrupt
-               * driven environment.
-               */
-
-              if (rtcb->xcp.sigdeliver)
-                {
-                  sdbg("Delivering signals TCB=%p\n", rtcb);
-                  ((sig_deliver_t)rtcb->xcp.sigdeliver)(rtcb);
-                  rtcb->xcp.sigdeliver = NULL;
-                }
-
-              /* Update scheduler parameters */
-
-              sched_resume_scheduler(rtcb);
-
-              /* Then switch contexts */
-
-              up_longjmp(rtcb->xcp.regs, 1);
-            }
+          up_switchtask(rtcb);
         }
     }
 }
@@ -39,12 +39,26 @@
 
 #include <nuttx/config.h>
 #include <stdbool.h>
-#include <syslog.h>
+#include <nuttx/arch.h>
 #include <nuttx/sched.h>
 
+#include "up_internal.h"
+
 #if defined(CONFIG_SCHED_INSTRUMENTATION) && \
    !defined(CONFIG_SCHED_INSTRUMENTATION_BUFFER)
 
+/****************************************************************************
+ * Pre-processor Definitions
+ ****************************************************************************/
+
+/* Notes are recorded in the trace ring of the CPU that reports them */
+
+#ifdef CONFIG_SMP
+#  define NOTE_CPU() up_cpu_index()
+#else
+#  define NOTE_CPU() 0
+#endif
+
 /****************************************************************************
  * Public Functions
  ****************************************************************************/
@@ -54,7 +68,9 @@
  *       sched_note_premption
  *
  * Description:
- *   Hooks to scheduler monitor
+ *   Hooks to scheduler monitor.  Each note is saved as a fixed-size binary
+ *   record in a per-CPU trace ring (see up_schedtrace.c) which is written
+ *   to a file at exit or when SIGUSR2 is received.
  *
  * Input Parameters:
  *   Varies
@@ -66,145 +82,44 @@
 
 void sched_note_start(FAR struct tcb_s *tcb)
 {
-#ifdef CONFIG_SMP
-#if CONFIG_TASK_NAME_SIZE > 0
-  lowsyslog(LOG_INFO, "CPU%d: Start %s, TCB@%p, state=%d\n",
-            tcb->cpu, tcb->name, tcb, tcb->task_state);
-#else
-  lowsyslog(LOG_INFO, "CPU%d: Start TCB@%p, state=%d\n"
-            tcb->cpu, tcb, tcb->task_state);
-#endif
-#else
 #if CONFIG_TASK_NAME_SIZE > 0
-  lowsyslog(LOG_INFO, "Start %s, TCB@%p, state=%d\n",
-            tcb->name, tcb, tcb->task_state);
-#else
-  lowsyslog(LOG_INFO, "Start TCB@%p, state=%d\n",
-            tcb, tcb->task_state);
-#endif
+  sched_trace_name(tcb->pid, tcb->name);
 #endif
+  sched_trace_record(NOTE_CPU(), SCHED_TRACE_START, tcb, tcb->pid,
+                     tcb->task_state);
 }
 
 void sched_note_stop(FAR struct tcb_s *tcb)
 {
-#ifdef CONFIG_SMP
-#if CONFIG_TASK_NAME_SIZE > 0
-  lowsyslog(LOG_INFO, "CPU%d: Stop %s, TCB@%p, state=%d\n",
-            tcb->cpu, tcb->name, tcb, tcb->task_state);
-#else
-  lowsyslog(LOG_INFO, "CPU%d: Stop TCB@%p, state=%d\n",
-            tcb->cpu, tcb, tcb->task_state);
-#endif
-#else
-#if CONFIG_TASK_NAME_SIZE > 0
-  lowsyslog(LOG_INFO, "Stop %s, TCB@%p, state=%d\n",
-            tcb->name, tcb, tcb->task_state);
-#else
-  lowsyslog(LOG_INFO, "Stop TCB@%p, state=%d\n",
-            tcb, tcb->task_state);
-#endif
-#endif
+  sched_trace_record(NOTE_CPU(), SCHED_TRACE_STOP, tcb, tcb->pid,
+                     tcb->task_state);
 }
 
 void sched_note_suspend(FAR struct tcb_s *tcb)
 {
-#ifdef CONFIG_SMP
-#if CONFIG_TASK_NAME_SIZE > 0
-  lowsyslog(LOG_INFO, "CPU%d: Suspend %s, TCB@%p, state=%d\n",
-            tcb->cpu, tcb->name, tcb, tcb->task_state);
-#else
-  lowsyslog(LOG_INFO, "CPU%d: Suspend TCB@%p, state=%d\n",
-            tcb->cpu, tcb, tcb->task_state);
-#endif
-#else
-#if CONFIG_TASK_NAME_SIZE > 0
-  lowsyslog(LOG_INFO, "Suspend %s, TCB@%p, state=%d\n",
-            tcb->name, tcb, tcb->task_state);
-#else
-  lowsyslog(LOG_INFO, "Suspend TCB@%p, state=%d\n",
-            tcb, tcb->task_state);
-#endif
-#endif
+  sched_trace_record(NOTE_CPU(), SCHED_TRACE_SUSPEND, tcb, tcb->pid,
+                     tcb->task_state);
 }
 
 void sched_note_resume(FAR struct tcb_s *tcb)
 {
-#ifdef CONFIG_SMP
-#if CONFIG_TASK_NAME_SIZE > 0
-  lowsyslog(LOG_INFO, "CPU%d: Resume %s, TCB@%p, state=%d\n",
-            tcb->cpu, tcb->name, tcb, tcb->task_state);
-#else
-  lowsyslog(LOG_INFO, "CPU%d: Resume TCB@%p, state=%d\n",
-            tcb->cpu, tcb, tcb->task_state);
-#endif
-#else
-#if CONFIG_TASK_NAME_SIZE > 0
-  lowsyslog(LOG_INFO, "Resume %s, TCB@%p, state=%d\n",
-            tcb->name, tcb, tcb->task_state);
-#else
-  lowsyslog(LOG_INFO, "Resume TCB@%p, state=%d\n",
-            tcb, tcb->task_state);
-#endif
-#endif
+  sched_trace_record(NOTE_CPU(), SCHED_TRACE_RESUME, tcb, tcb->pid,
+                     tcb->task_state);
 }
 
 #ifdef CONFIG_SCHED_INSTRUMENTATION_PREEMPTION
-/* This does not work well... it interferes with the operation of the
- * simulated /dev/console device which, of course, does disable preemption
- * and does use critical sections.
- */
-
-#warning CONFIG_SCHED_INSTRUMENTATION_PREEMPTION is a bad idea
-
 void sched_note_premption(FAR struct tcb_s *tcb, bool locked)
 {
-#ifdef CONFIG_SMP
-#if CONFIG_TASK_NAME_SIZE > 0
-  lowsyslog(LOG_INFO, "CPU%d: Task %s TCB@%p preemption %s\n",
-            tcb->cpu, tcb->name, tcb, locked ? "LOCKED" : "UNLOCKED");
-#else
-  lowsyslog(LOG_INFO, "CPU%d: TCB@%p preemption %s\n",
-            tcb->cpu, tcb, locked ? "LOCKED" : "UNLOCKED");
-#endif
-#else
-#if CONFIG_TASK_NAME_SIZE > 0
-  lowsyslog(LOG_INFO, "Task %s, TCB@%p preemption %s\n",
-            tcb->name, tcb, locked ? "LOCKED" : "UNLOCKED");
-#else
-  lowsyslog(LOG_INFO, "TCB@%p preemption %s\n",
-            tcb, locked ? "LOCKED" : "UNLOCKED");
-#endif
-#endif
+  sched_trace_record(NOTE_CPU(), SCHED_TRACE_PREEMPT, tcb, tcb->pid,
+                     locked);
 }
 #endif
 
 #ifdef CONFIG_SCHED_INSTRUMENTATION_CSECTION
-/* This does not work well... it interferes with the operation of the
- * simulated /dev/console device which, of course, does disable preemption
- * and does use critical sections.
- */
-
-#warning CONFIG_SCHED_INSTRUMENTATION_CSECTION is a bad idea
-
 void sched_note_csection(FAR struct tcb_s *tcb, bool enter)
 {
-#ifdef CONFIG_SMP
-#if CONFIG_TASK_NAME_SIZE > 0
-  lowsyslog(LOG_INFO, "CPU%d: Task %s TCB@%p critical section %s\n",
-            tcb->cpu, tcb->name, tcb, enter ? "ENTER" : "LEAVE");
-#else
-  lowsyslog(LOG_INFO, "CPU%d: TCB@%p critical section %s\n",
-            tcb->cpu, tcb, enter ? "ENTER" : "LEAVE");
-#endif
-#else
-#if CONFIG_TASK_NAME_SIZE > 0
-  lowsyslog(LOG_INFO, "Task %s, TCB@%p critical section %s\n",
-            tcb->name, tcb, enter ? "ENTER" : "LEAVE");
-#else
-  lowsyslog(LOG_INFO, "TCB@%p critical section %s\n",
-            tcb, enter ? "ENTER" : "LEAVE");
-#endif
-#endif
+  sched_trace_record(NOTE_CPU(), SCHED_TRACE_CSECTION, tcb, tcb->pid,
+                     enter);
 }
 #endif
 
@@ -0,0 +1,686 @@
+/****************************************************************************
+ * arch/sim/src/up_schedtrace.c
+ *
+ *   Copyright (C) 2016 Gregory Nutt. All rights reserved.
+ *   Author: Gregory Nutt <gnutt@nuttx.org>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name NuttX nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************/
+
+/****************************************************************************
+ * Included Files
+ ****************************************************************************/
+
+#include <sys/stat.h>
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <pthread.h>
+#include <time.h>
+
+/****************************************************************************
+ * Pre-processor Definitions
+ ****************************************************************************/
+
+#ifndef CONFIG_SMP_NCPUS
+#  define CONFIG_SMP_NCPUS 1
+#endif
+
+#ifndef CONFIG_SIM_SCHEDNOTE_NRECORDS
+#  define CONFIG_SIM_SCHEDNOTE_NRECORDS 8192
+#endif
+
+#ifndef CONFIG_SIM_SCHEDNOTE_PATH
+#  define CONFIG_SIM_SCHEDNOTE_PATH "nuttx-trace"
+#endif
+
+/* Trace events.  Must match the definitions in up_internal.h */
+
+#define SCHED_TRACE_START    0
+#define SCHED_TRACE_STOP     1
+#define SCHED_TRACE_SUSPEND  2
+#define SCHED_TRACE_RESUME   3
+#define SCHED_TRACE_PREEMPT  4
+#define SCHED_TRACE_CSECTION 5
+#define SCHED_TRACE_NEVENTS  6
+
+/* Task names are remembered in a small table indexed by PID */
+
+#define SCHED_TRACE_NNAMES   64
+#define SCHED_TRACE_NAMELEN  32
+
+/****************************************************************************
+ * Private Types
+ ****************************************************************************/
+
+/* One fixed-size trace record */
+
+struct sched_trace_s
+{
+  uint64_t time;                /* Host monotonic time (ns) */
+  uint64_t tcb;                 /* TCB address */
+  int16_t  pid;                 /* Task ID */
+  uint8_t  cpu;                 /* CPU that recorded the event */
+  uint8_t  event;               /* SCHED_TRACE_* */
+  uint32_t arg;                 /* Event-specific argument */
+};
+
+/* The trace ring of one CPU.  Only that CPU writes to it, so no locking is
+ * needed.  When the ring is full, the oldest records are overwritten.
+ */
+
+struct sched_tracering_s
+{
+  uint64_t count;               /* Total number of records written */
+  struct sched_trace_s rec[CONFIG_SIM_SCHEDNOTE_NRECORDS];
+};
+
+struct sched_tracename_s
+{
+  int  pid;
+  char name[SCHED_TRACE_NAMELEN];
+};
+
+/****************************************************************************
+ * Private Data
+ ****************************************************************************/
+
+static struct sched_tracering_s g_sched_trace[CONFIG_SMP_NCPUS];
+static struct sched_tracename_s g_sched_tracenames[SCHED_TRACE_NNAMES];
+static pthread_once_t g_sched_traceonce = PTHREAD_ONCE_INIT;
+static volatile int g_sched_tracerequest;
+static uint64_t g_sched_tracebase;
+
+#ifndef CONFIG_SIM_SCHEDNOTE_CTF
+static const char *g_sched_tracewhat[SCHED_TRACE_NEVENTS] =
+{
+  "start", "stop", "suspend", "resume", "preemption", "critical section"
+};
+#endif
+
+/****************************************************************************
+ * Host Domain Public Function Prototypes
+ ****************************************************************************/
+
+void sched_trace_dump(void);
+
+/****************************************************************************
+ * Private Functions
+ ****************************************************************************/
+
+/****************************************************************************
+ * Name: sched_trace_gettime
+ ****************************************************************************/
+
+static uint64_t sched_trace_gettime(void)
+{
+  struct timespec ts;
+
+  (void)clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+/****************************************************************************
+ * Name: sched_trace_signal
+ *
+ * Description:
+ *   SIGUSR2 handler.  Requests a trace dump from the IDLE loop.
+ *
+ ****************************************************************************/
+
+static void sched_trace_signal(int signo)
+{
+  g_sched_tracerequest = 1;
+}
+
+/****************************************************************************
+ * Name: sched_trace_setup
+ ****************************************************************************/
+
+static void sched_trace_setup(void)
+{
+  g_sched_tracebase = sched_trace_gettime();
+  (void)signal(SIGUSR2, sched_trace_signal);
+  (void)atexit(sched_trace_dump);
+}
+
+/****************************************************************************
+ * Name: sched_trace_first
+ *
+ * Description:
+ *   Return the sequence number of the oldest record still in a ring
+ *
+ ****************************************************************************/
+
+static uint64_t sched_trace_first(struct sched_tracering_s *ring)
+{
+  if (ring->count > CONFIG_SIM_SCHEDNOTE_NRECORDS)
+    {
+      return ring->count - CONFIG_SIM_SCHEDNOTE_NRECORDS;
+    }
+
+  return 0;
+}
+
+#ifndef CONFIG_SIM_SCHEDNOTE_CTF
+/****************************************************************************
+ * Name: sched_trace_getname
+ ****************************************************************************/
+
+static const char *sched_trace_getname(int pid)
+{
+  struct sched_tracename_s *entry;
+
+  entry = &g_sched_tracenames[pid % SCHED_TRACE_NNAMES];
+  if (entry->pid == pid && entry->name[0] != '\0')
+    {
+      return entry->name;
+    }
+
+  return NULL;
+}
+
+/****************************************************************************
+ * Name: sched_trace_jsonstring
+ *
+ * Description:
+ *   Output the characters of a JSON string, escaping quotes, backslashes
+ *   and control characters.  Task names are chosen by applications and
+ *   may contain any of them.
+ *
+ ****************************************************************************/
+
+static void sched_trace_jsonstring(FILE *stream, const char *str)
+{
+  unsigned char ch;
+
+  for (; (ch = (unsigned char)*str) != '\0'; str++)
+    {
+      if (ch == '"' || ch == '\\')
+        {
+          fprintf(stream, "\\%c", ch);
+        }
+      else if (ch < 0x20)
+        {
+          fprintf(stream, "\\u%04x", ch);
+        }
+      else
+        {
+          fputc(ch, stream);
+        }
+    }
+}
+
+/****************************************************************************
+ * Name: sched_trace_jsonslice
+ *
+ * Description:
+ *   Output one Chrome trace "complete" event
+ *
+ ****************************************************************************/
+
+static void sched_trace_jsonslice(FILE *stream, int pid, const char *what,
+                                  int tid, uint64_t start, uint64_t end,
+                                  int *sep)
+{
+  const char *name = sched_trace_getname(pid);
+
+  fprintf(stream, "%s\n{\"ph\":\"X\",\"pid\":0,\"tid\":%d,"
+          "\"ts\":%.3f,\"dur\":%.3f,",
+          *sep ? "," : "", tid,
+          (double)(start - g_sched_tracebase) / 1000.0,
+          (double)(end - start) / 1000.0);
+
+  fprintf(stream, "\"name\":\"");
+  sched_trace_jsonstring(stream, what);
+  if (*what != '\0')
+    {
+      fputc(' ', stream);
+    }
+
+  if (name != NULL)
+    {
+      sched_trace_jsonstring(stream, name);
+    }
+  else
+    {
+      fprintf(stream, "pid %d", pid);
+    }
+
+  fprintf(stream, "\",\"args\":{\"pid\":%d}}", pid);
+  *sep = 1;
+}
+
+/****************************************************************************
+ * Name: sched_trace_json
+ *
+ * Description:
+ *   Write the trace in the Chrome trace event (JSON) format that is also
+ *   read by Perfetto.  Each CPU gets three rows:  The running task, the
+ *   critical sections, and the pre-emption locked intervals.
+ *
+ ****************************************************************************/
+
+static void sched_trace_json(FILE *stream)
+{
+  struct sched_tracering_s *ring;
+  struct sched_trace_s *rec;
+  uint64_t runstart;
+  uint64_t csstart;
+  uint64_t lockstart;
+  uint64_t last;
+  uint64_t seq;
+  int runpid;
+  int cspid;
+  int lockpid;
+  int sep = 0;
+  int cpu;
+
+  fprintf(stream, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[");
+
+  for (cpu = 0; cpu < CONFIG_SMP_NCPUS; cpu++)
+    {
+      fprintf(stream,
+              "%s\n{\"ph\":\"M\",\"pid\":0,\"tid\":%d,"
+              "\"name\":\"thread_name\",\"args\":{\"name\":\"CPU%d\"}},"
+              "\n{\"ph\":\"M\",\"pid\":0,\"tid\":%d,"
+              "\"name\":\"thread_name\","
+              "\"args\":{\"name\":\"CPU%d critical section\"}},"
+              "\n{\"ph\":\"M\",\"pid\":0,\"tid\":%d,"
+              "\"name\":\"thread_name\","
+              "\"args\":{\"name\":\"CPU%d preemption\"}}",
+              sep ? "," : "", cpu, cpu, 100 + cpu, cpu, 200 + cpu, cpu);
+      sep = 1;
+
+      ring    = &g_sched_trace[cpu];
+      runpid  = -1;
+      cspid   = -1;
+      lockpid = -1;
+      runstart = csstart = lockstart = last = 0;
+
+      for (seq = sched_trace_first(ring); seq < ring->count; seq++)
+        {
+          rec  = &ring->rec[seq % CONFIG_SIM_SCHEDNOTE_NRECORDS];
+          last = rec->time;
+
+          switch (rec->event)
+            {
+              case SCHED_TRACE_RESUME:
+                runpid   = rec->pid;
+                runstart = rec->time;
+                break;
+
+              case SCHED_TRACE_SUSPEND:
+                if (runpid == rec->pid)
+                  {
+                    sched_trace_jsonslice(stream, runpid, "", cpu,
+                                          runstart, rec->time, &sep);
+                  }
+
+                runpid = -1;
+                break;
+
+              case SCHED_TRACE_CSECTION:
+                if (rec->arg)
+                  {
+                    cspid   = rec->pid;
+                    csstart = rec->time;
+                  }
+                else if (cspid >= 0)
+                  {
+                    sched_trace_jsonslice(stream, cspid, "csection",
+                                          100 + cpu, csstart, rec->time,
+                                          &sep);
+                    cspid = -1;
+                  }
+                break;
+
+              case SCHED_TRACE_PREEMPT:
+                if (rec->arg)
+                  {
+                    lockpid   = rec->pid;
+                    lockstart = rec->time;
+                  }
+                else if (lockpid >= 0)
+                  {
+                    sched_trace_jsonslice(stream, lockpid, "locked",
+                                          200 + cpu, lockstart, rec->time,
+                                          &sep);
+                    lockpid = -1;
+                  }
+                break;
+
+              default:
+                fprintf(stream, ",\n{\"ph\":\"i\",\"s\":\"t\",\"pid\":0,"
+                        "\"tid\":%d,\"ts\":%.3f,\"name\":\"%s pid %d\","
+                        "\"args\":{\"state\":%u}}",
+                        cpu,
+                        (double)(rec->time - g_sched_tracebase) / 1000.0,
+                        g_sched_tracewhat[rec->event], rec->pid,
+                        (unsigned int)rec->arg);
+                break;
+            }
+        }
+
+      /* Close the intervals that are still open */
+
+      if (runpid >= 0)
+        {
+          sched_trace_jsonslice(stream, runpid, "", cpu, runstart, last,
+                                &sep);
+        }
+
+      if (cspid >= 0)
+        {
+          sched_trace_jsonslice(stream, cspid, "csection", 100 + cpu,
+                                csstart, last, &sep);
+        }
+
+      if (lockpid >= 0)
+        {
+          sched_trace_jsonslice(stream, lockpid, "locked", 200 + cpu,
+                                lockstart, last, &sep);
+        }
+    }
+
+  fprintf(stream, "\n]}\n");
+}
+#endif
+
+#ifdef CONFIG_SIM_SCHEDNOTE_CTF
+/****************************************************************************
+ * Name: sched_trace_ctfmetadata
+ *
+ * Description:
+ *   Write the CTF 1.8 metadata (TSDL) describing the per-CPU streams
+ *
+ ****************************************************************************/
+
+static void sched_trace_ctfmetadata(FILE *stream)
+{
+  static const char *names[SCHED_TRACE_NEVENTS] =
+  {
+    "sched_start", "sched_stop", "sched_suspend", "sched_resume",
+    "sched_preemption", "sched_csection"
+  };
+
+  uint16_t endian = 1;
+  int i;
+
+  fprintf(stream,
+          "/* CTF 1.8 */\n\n"
+          "typealias integer { size = 8; align = 8; signed = false; } "
+          ":= uint8_t;\n"
+          "typealias integer { size = 16; align = 8; signed = true; } "
+          ":= int16_t;\n"
+          "typealias integer { size = 32; align = 8; signed = false; } "
+          ":= uint32_t;\n"
+          "typealias integer { size = 64; align = 8; signed = false; } "
+          ":= uint64_t;\n\n"
+          "trace {\n"
+          "  major = 1;\n"
+          "  minor = 8;\n"
+          "  byte_order = %s;\n"
+          "  packet.header := struct {\n"
+          "    uint32_t magic;\n"
+          "    uint32_t stream_id;\n"
+          "  };\n"
+          "};\n\n"
+          "clock {\n"
+          "  name = monotonic;\n"
+          "  freq = 1000000000;\n"
+          "};\n\n"
+          "typealias integer { size = 64; align = 8; signed = false; "
+          "map = clock.monotonic.value; } := uint64_clock_t;\n\n"
+          "stream {\n"
+          "  id = 0;\n"
+          "  packet.context := struct {\n"
+          "    uint32_t cpu_id;\n"
+          "  };\n"
+          "  event.header := struct {\n"
+          "    uint64_clock_t timestamp;\n"
+          "    uint8_t id;\n"
+          "  };\n"
+          "};\n\n"
+          "event {\n"
+          "  name = \"task_name\";\n"
+          "  id = %d;\n"
+          "  stream_id = 0;\n"
+          "  fields := struct {\n"
+          "    int16_t pid;\n"
+          "    string name;\n"
+          "  };\n"
+          "};\n",
+          *(uint8_t *)&endian ? "le" : "be", SCHED_TRACE_NEVENTS);
+
+  for (i = 0; i < SCHED_TRACE_NEVENTS; i++)
+    {
+      fprintf(stream,
+              "\nevent {\n"
+              "  name = \"%s\";\n"
+              "  id = %d;\n"
+              "  stream_id = 0;\n"
+              "  fields := struct {\n"
+              "    uint64_t tcb;\n"
+              "    int16_t pid;\n"
+              "    uint32_t arg;\n"
+              "  };\n"
+              "};\n", names[i], i);
+    }
+}
+
+/****************************************************************************
+ * Name: sched_trace_ctfstream
+ *
+ * Description:
+ *   Write the records of one CPU as a CTF stream with a single packet.
+ *   The task names are written at the beginning of the stream of CPU0.
+ *
+ ****************************************************************************/
+
+static void sched_trace_ctfstream(FILE *stream, int cpu)
+{
+  struct sched_tracering_s *ring = &g_sched_trace[cpu];
+  struct sched_trace_s *rec;
+  uint32_t header[3];
+  uint64_t seq;
+  uint64_t time;
+  uint8_t id;
+  int i;
+
+  header[0] = 0xc1fc1fc1;       /* CTF magic */
+  header[1] = 0;                /* Stream ID */
+  header[2] = cpu;              /* Packet context: CPU */
+  (void)fwrite(header, sizeof(header), 1, stream);
+
+  if (cpu == 0)
+    {
+      time = sched_trace_first(ring) < ring->count ?
+             ring->rec[sched_trace_first(ring) %
+                       CONFIG_SIM_SCHEDNOTE_NRECORDS].time :
+             g_sched_tracebase;
+
+      for (i = 0; i < SCHED_TRACE_NNAMES; i++)
+        {
+          struct sched_tracename_s *entry = &g_sched_tracenames[i];
+          int16_t pid = entry->pid;
+
+          if (entry->name[0] != '\0')
+            {
+              id = SCHED_TRACE_NEVENTS;
+              (void)fwrite(&time, sizeof(time), 1, stream);
+              (void)fwrite(&id, sizeof(id), 1, stream);
+              (void)fwrite(&pid, sizeof(pid), 1, stream);
+              (void)fwrite(entry->name, strlen(entry->name) + 1, 1, stream);
+            }
+        }
+    }
+
+  for (seq = sched_trace_first(ring); seq < ring->count; seq++)
+    {
+      rec = &ring->rec[seq % CONFIG_SIM_SCHEDNOTE_NRECORDS];
+      id  = rec->event;
+
+      (void)fwrite(&rec->time, sizeof(rec->time), 1, stream);
+      (void)fwrite(&id, sizeof(id), 1, stream);
+      (void)fwrite(&rec->tcb, sizeof(rec->tcb), 1, stream);
+      (void)fwrite(&rec->pid, sizeof(rec->pid), 1, stream);
+      (void)fwrite(&rec->arg, sizeof(rec->arg), 1, stream);
+    }
+}
+#endif
+
+/****************************************************************************
+ * Public Functions
+ ****************************************************************************/
+
+/****************************************************************************
+ * Name: sched_trace_record
+ *
+ * Description:
+ *   Add one record to the trace ring of 'cpu'.  Called from the NuttX
+ *   domain on every scheduler note; must be cheap.
+ *
+ ****************************************************************************/
+
+void sched_trace_record(int cpu, int event, void *tcb, int pid,
+                        unsigned int arg)
+{
+  struct sched_tracering_s *ring = &g_sched_trace[cpu];
+  struct sched_trace_s *rec;
+
+  (void)pthread_once(&g_sched_traceonce, sched_trace_setup);
+
+  rec        = &ring->rec[ring->count % CONFIG_SIM_SCHEDNOTE_NRECORDS];
+  rec->time  = sched_trace_gettime();
+  rec->tcb   = (uint64_t)(uintptr_t)tcb;
+  rec->pid   = (int16_t)pid;
+  rec->cpu   = (uint8_t)cpu;
+  rec->event = (uint8_t)event;
+  rec->arg   = arg;
+  ring->count++;
+}
+
+/****************************************************************************
+ * Name: sched_trace_name
+ *
+ * Description:
+ *   Remember the name of a task so that it can be shown in the trace
+ *
+ ****************************************************************************/
+
+void sched_trace_name(int pid, const char *name)
+{
+  struct sched_tracename_s *entry;
+
+  entry      = &g_sched_tracenames[pid % SCHED_TRACE_NNAMES];
+  entry->pid = pid;
+  strncpy(entry->name, name, SCHED_TRACE_NAMELEN - 1);
+  entry->name[SCHED_TRACE_NAMELEN - 1] = '\0';
+}
+
+/****************************************************************************
+ * Name: sched_trace_dump
+ *
+ * Description:
+ *   Write the contents of the trace rings to CONFIG_SIM_SCHEDNOTE_PATH
+ *   with a .json extension, or as a CTF trace into a directory with a .ctf
+ *   extension.  Called at exit and when requested with SIGUSR2.
+ *
+ ****************************************************************************/
+
+void sched_trace_dump(void)
+{
+  char path[256];
+  FILE *stream;
+#ifdef CONFIG_SIM_SCHEDNOTE_CTF
+  int cpu;
+
+  snprintf(path, sizeof(path), "%s.ctf", CONFIG_SIM_SCHEDNOTE_PATH);
+  (void)mkdir(path, 0755);
+
+  snprintf(path, sizeof(path), "%s.ctf/metadata", CONFIG_SIM_SCHEDNOTE_PATH);
+  stream = fopen(path, "w");
+  if (stream == NULL)
+    {
+      fprintf(stderr, "schednote: cannot create %s\n", path);
+      return;
+    }
+
+  sched_trace_ctfmetadata(stream);
+  fclose(stream);
+
+  for (cpu = 0; cpu < CONFIG_SMP_NCPUS; cpu++)
+    {
+      snprintf(path, sizeof(path), "%s.ctf/stream_%d",
+               CONFIG_SIM_SCHEDNOTE_PATH, cpu);
+      stream = fopen(path, "wb");
+      if (stream != NULL)
+        {
+          sched_trace_ctfstream(stream, cpu);
+          fclose(stream);
+        }
+    }
+
+  snprintf(path, sizeof(path), "%s.ctf", CONFIG_SIM_SCHEDNOTE_PATH);
+#else
+  snprintf(path, sizeof(path), "%s.json", CONFIG_SIM_SCHEDNOTE_PATH);
+  stream = fopen(path, "w");
+  if (stream == NULL)
+    {
+      fprintf(stderr, "schednote: cannot create %s\n", path);
+      return;
+    }
+
+  sched_trace_json(stream);
+  fclose(stream);
+#endif
+
+  fprintf(stderr, "schednote: trace written to %s\n", path);
+}
+
+/****************************************************************************
+ * Name: sched_trace_poll
+ *
+ * Description:
+ *   Called from the IDLE loop.  Dumps the trace if requested with SIGUSR2.
+ *
+ ****************************************************************************/
+
+void sched_trace_poll(void)
+{
+  if (g_sched_tracerequest)
+    {
+      g_sched_tracerequest = 0;
+      sched_trace_dump();
+    }
+}
@@ -0,0 +1,673 @@
+/****************************************************************************
+ * arch/sim/src/up_shmdev.c
+ *
+ *   Copyright (C) 2016 Gregory Nutt. All rights reserved.
+ *   Author: Gregory Nutt <gnutt@nuttx.org>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name NuttX nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************/
+
+/****************************************************************************
+ * Included Files
+ ****************************************************************************/
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/types.h>
+
+#include <linux/futex.h>
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <pthread.h>
+#include <signal.h>
+#include <time.h>
+
+/****************************************************************************
+ * Pre-processor Definitions
+ ****************************************************************************/
+
+/* Configuration.  These must be provided on the command line from the
+ * Kconfig settings.
+ */
+
+#ifndef CONFIG_SIM_NETDEV_NUMBER
+#  define CONFIG_SIM_NETDEV_NUMBER 1
+#endif
+
+#ifndef CONFIG_SIM_NETDEV_SHMEM_NAME
+#  define CONFIG_SIM_NETDEV_SHMEM_NAME "/nuttx-shmnet"
+#endif
+
+#ifndef CONFIG_SIM_NETDEV_SHMEM_NFRAMES
+#  define CONFIG_SIM_NETDEV_SHMEM_NFRAMES 64
+#endif
+
+/* Size of one frame buffer.  Normally provided on the command line */
+
+#ifndef NETDEV_BUFSIZE
+#  define NETDEV_BUFSIZE 1518
+#endif
+
+/* The link name of device N may be overridden with the host environment
+ * variable SIM_SHMNET<N>.
+ */
+
+#define SHMDEV_ENVNAME   "SIM_SHMNET%d"
+
+#define SHMDEV_MAGIC     0x4e585332    /* "NXS2" */
+#define SHMDEV_NSIDES    2
+
+/* How long to wait (in msec) for the other instance to finish setting up
+ * a link segment before the segment is considered stale.
+ */
+
+#define SHMDEV_SETUPWAIT 1000
+
+/* Syslog priority (must match definitions in nuttx/include/syslog.h) */
+
+#define LOG_INFO      1  /* Informational message */
+#define LOG_ERR       4  /* Error conditions */
+
+/****************************************************************************
+ * Private Types
+ ****************************************************************************/
+
+/* One frame slot in a ring */
+
+struct shmdev_frame_s
+{
+  uint32_t len;
+  unsigned char buf[NETDEV_BUFSIZE];
+};
+
+/* A single-producer, single-consumer ring of frames in shared memory.  The
+ * head index is only modified by the producer and the tail index only by
+ * the consumer.  The head index is also used as a futex word on which the
+ * receiving instance waits for new frames.
+ */
+
+struct shmdev_ring_s
+{
+  volatile uint32_t head;              /* Next slot to be written */
+  volatile uint32_t rxwaiting;         /* Consumer is waiting for frames */
+  uint32_t pad1[14];                   /* Keep indices in separate lines */
+  volatile uint32_t tail;              /* Next slot to be read */
+  uint32_t pad2[15];
+  struct shmdev_frame_s frames[CONFIG_SIM_NETDEV_SHMEM_NFRAMES];
+};
+
+/* The shared memory segment of one point-to-point link.  The instance that
+ * attaches first owns side 0 and transmits on ring[0]; the other owns
+ * side 1 and transmits on ring[1].
+ */
+
+struct shmdev_link_s
+{
+  volatile uint32_t magic;             /* Set when initialized */
+  volatile uint32_t nattached;         /* Number of attached instances */
+  uint32_t nframes;                    /* Must match on both sides */
+  uint32_t bufsize;                    /* Must match on both sides */
+  volatile uint32_t named;             /* The segment name still exists */
+  volatile int32_t pid[SHMDEV_NSIDES]; /* Host PID of each side, or 0 */
+  struct shmdev_ring_s ring[SHMDEV_NSIDES];
+};
+
+/* The state of one local device */
+
+struct shmdev_s
+{
+  struct shmdev_link_s *link;          /* Mapped link segment */
+  struct shmdev_ring_s *rx;            /* Ring written by the peer */
+  struct shmdev_ring_s *tx;            /* Ring written by us */
+  int side;                            /* Our side of the link */
+  unsigned long txdropped;             /* Frames dropped: peer ring full */
+  char name[64];                       /* Name of the link segment */
+};
+
+/****************************************************************************
+ * NuttX Domain Public Function Prototypes
+ ****************************************************************************/
+
+int syslog(int priority, const char *format, ...);
+int netdriver_setmacaddr(int devidx, unsigned char *macaddr);
+
+/****************************************************************************
+ * Host Domain Public Function Prototypes
+ ****************************************************************************/
+
+#ifdef CONFIG_SIM_HOSTTIMER
+void host_idle_wakeup(void);
+#endif
+
+/****************************************************************************
+ * Private Data
+ ****************************************************************************/
+
+static struct shmdev_s g_shmdev[CONFIG_SIM_NETDEV_NUMBER];
+
+/****************************************************************************
+ * Private Functions
+ ****************************************************************************/
+
+/****************************************************************************
+ * Name: shmdev_futex
+ ****************************************************************************/
+
+static inline int shmdev_futex(volatile uint32_t *uaddr, int op,
+                               uint32_t val,
+                               const struct timespec *timeout)
+{
+  /* The futex is shared between processes so FUTEX_PRIVATE_FLAG must not
+   * be used.
+   */
+
+  return syscall(SYS_futex, uaddr, op, val, timeout, NULL, 0);
+}
+
+/****************************************************************************
+ * Name: shmdev_next
+ ****************************************************************************/
+
+static inline uint32_t shmdev_next(uint32_t ndx)
+{
+  return (ndx + 1 >= CONFIG_SIM_NETDEV_SHMEM_NFRAMES) ? 0 : ndx + 1;
+}
+
+/****************************************************************************
+ * Name: shmdev_hash
+ *
+ * Description:
+ *   FNV-1a hash of the link name.  Used to derive a MAC address that is
+ *   unique on the link and stable from run to run.
+ *
+ ****************************************************************************/
+
+static uint32_t shmdev_hash(const char *name)
+{
+  uint32_t hash = 2166136261u;
+
+  while (*name != '\0')
+    {
+      hash ^= (unsigned char)*name++;
+      hash *= 16777619u;
+    }
+
+  return hash;
+}
+
+/****************************************************************************
+ * Name: shmdev_alive
+ *
+ * Description:
+ *   Return true if the host process 'pid' still exists
+ *
+ ****************************************************************************/
+
+static bool shmdev_alive(int32_t pid)
+{
+  return pid > 0 && (kill(pid, 0) == 0 || errno != ESRCH);
+}
+
+/****************************************************************************
+ * Name: shmdev_attach
+ *
+ * Description:
+ *   Open or create the link segment 'name', map it and claim a side of it.
+ *
+ * Returned Value:
+ *   The mapped segment on success.  NULL on failure, with '*stale' set if
+ *   the segment was left behind by an instance that has gone away.
+ *
+ ****************************************************************************/
+
+static struct shmdev_link_s *shmdev_attach(struct shmdev_s *priv,
+                                           const char *name, bool *stale)
+{
+  struct shmdev_link_s *link;
+  struct stat buf;
+  bool created = false;
+  int side;
+  int fd;
+  int i;
+
+  *stale = false;
+
+  /* Open (or create) the link segment.  Only the instance that succeeds in
+   * creating the segment sets its size.
+   */
+
+  fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0600);
+  if (fd >= 0)
+    {
+      created = true;
+      if (ftruncate(fd, sizeof(struct shmdev_link_s)) < 0)
+        {
+          syslog(LOG_ERR, "SHMDEV: ftruncate failed: %d\n", errno);
+          goto errout_with_fd;
+        }
+    }
+  else if (errno == EEXIST)
+    {
+      fd = shm_open(name, O_RDWR, 0600);
+      if (fd < 0)
+        {
+          syslog(LOG_ERR, "SHMDEV: shm_open %s failed: %d\n", name, errno);
+          return NULL;
+        }
+
+      /* Wait until the creator has sized the segment.  If it never does,
+       * the creator died while setting it up.
+       */
+
+      for (i = 0; ; i++)
+        {
+          if (fstat(fd, &buf) < 0)
+            {
+              syslog(LOG_ERR, "SHMDEV: fstat failed: %d\n", errno);
+              goto errout_with_fd;
+            }
+
+          if (buf.st_size >= (off_t)sizeof(struct shmdev_link_s))
+            {
+              break;
+            }
+
+          if (i >= SHMDEV_SETUPWAIT)
+            {
+              *stale = true;
+              goto errout_with_fd;
+            }
+
+          (void)usleep(1000);
+        }
+    }
+  else
+    {
+      syslog(LOG_ERR, "SHMDEV: shm_open %s failed: %d\n", name, errno);
+      return NULL;
+    }
+
+  link = (struct shmdev_link_s *)mmap(NULL, sizeof(struct shmdev_link_s),
+                                      PROT_READ | PROT_WRITE, MAP_SHARED,
+                                      fd, 0);
+  if (link == MAP_FAILED)
+    {
+      syslog(LOG_ERR, "SHMDEV: mmap failed: %d\n", errno);
+      goto errout_with_fd;
+    }
+
+  close(fd);
+
+  /* A segment whose first instance has exited without detaching is left
+   * over from an earlier run.
+   */
+
+  if (!created && link->magic == SHMDEV_MAGIC && link->nattached > 0 &&
+      !shmdev_alive(link->pid[0]))
+    {
+      *stale = true;
+      goto errout_with_map;
+    }
+
+  /* Claim a side of the link.  The first instance initializes the segment;
+   * the second waits for that initialization to complete and then removes
+   * the name so that the next run starts with a fresh link.
+   */
+
+  side = (int)__sync_fetch_and_add(&link->nattached, 1);
+  if (side == 0)
+    {
+      link->nframes = CONFIG_SIM_NETDEV_SHMEM_NFRAMES;
+      link->bufsize = NETDEV_BUFSIZE;
+      link->pid[0]  = getpid();
+      link->named   = 1;
+      __sync_synchronize();
+      link->magic   = SHMDEV_MAGIC;
+    }
+  else if (side == 1)
+    {
+      for (i = 0; link->magic != SHMDEV_MAGIC; i++)
+        {
+          if (i >= SHMDEV_SETUPWAIT)
+            {
+              *stale = true;
+              goto errout_with_claim;
+            }
+
+          (void)usleep(1000);
+        }
+
+      if (link->nframes != CONFIG_SIM_NETDEV_SHMEM_NFRAMES ||
+          link->bufsize != NETDEV_BUFSIZE)
+        {
+          syslog(LOG_ERR, "SHMDEV: %s: configuration mismatch\n", name);
+          goto errout_with_claim;
+        }
+
+      link->pid[1] = getpid();
+      if (__sync_bool_compare_and_swap(&link->named, 1, 0))
+        {
+          (void)shm_unlink(name);
+        }
+    }
+  else
+    {
+      syslog(LOG_ERR, "SHMDEV: %s: link already in use\n", name);
+      goto errout_with_claim;
+    }
+
+  priv->side = side;
+  return link;
+
+errout_with_claim:
+  (void)__sync_fetch_and_sub(&link->nattached, 1);
+
+errout_with_map:
+  (void)munmap(link, sizeof(struct shmdev_link_s));
+  return NULL;
+
+errout_with_fd:
+  close(fd);
+
+  /* Only remove the name of a segment that we created ourselves */
+
+  if (created)
+    {
+      (void)shm_unlink(name);
+    }
+
+  return NULL;
+}
+
+/****************************************************************************
+ * Name: shmdev_detach
+ *
+ * Description:
+ *   Called at exit.  Give up our side of each link so that the segment is
+ *   not mistaken for a live one, remove the names of links that no peer
+ *   has connected to, and report dropped frames.
+ *
+ ****************************************************************************/
+
+static void shmdev_detach(void)
+{
+  struct shmdev_s *priv;
+  int i;
+
+  for (i = 0; i < CONFIG_SIM_NETDEV_NUMBER; i++)
+    {
+      priv = &g_shmdev[i];
+      if (priv->link == NULL)
+        {
+          continue;
+        }
+
+      priv->link->pid[priv->side] = 0;
+      if (__sync_sub_and_fetch(&priv->link->nattached, 1) == 0 &&
+          __sync_bool_compare_and_swap(&priv->link->named, 1, 0))
+        {
+          (void)shm_unlink(priv->name);
+        }
+
+      if (priv->txdropped > 0)
+        {
+          fprintf(stderr, "shmnet%d: %lu frames dropped, peer ring full\n",
+                  i, priv->txdropped);
+        }
+    }
+}
+
+/****************************************************************************
+ * Name: shmdev_thread
+ *
+ * Description:
+ *   Wait for the peer to send frames and wake up the IDLE loop, so that
+ *   received frames don't wait for the next timer tick.
+ *
+ ****************************************************************************/
+
+#ifdef CONFIG_SIM_HOSTTIMER
+static void *shmdev_thread(void *arg)
+{
+  struct shmdev_ring_s *rx = (struct shmdev_ring_s *)arg;
+  uint32_t seen = rx->head;
+
+  for (; ; )
+    {
+      /* Announce that we are waiting before checking the head one last
+       * time.  shmdev_send() stores the head before checking the flag.
+       */
+
+      rx->rxwaiting = 1;
+      __sync_synchronize();
+
+      if (rx->head == seen)
+        {
+          (void)shmdev_futex(&rx->head, FUTEX_WAIT, seen, NULL);
+        }
+
+      rx->rxwaiting = 0;
+
+      if (rx->head != seen)
+        {
+          seen = rx->head;
+          host_idle_wakeup();
+        }
+    }
+
+  return NULL;
+}
+#endif
+
+/****************************************************************************
+ * Public Functions
+ ****************************************************************************/
+
+/****************************************************************************
+ * Name: shmdev_init
+ *
+ * Description:
+ *   Attach device 'devidx' to its shared memory link, creating the link
+ *   segment if this is the first instance to attach.  The name of the
+ *   segment is CONFIG_SIM_NETDEV_SHMEM_NAME followed by the device index
+ *   unless overridden by the environment variable SIM_SHMNET<devidx>.  Any
+ *   two simulation instances that use the same link name are connected.
+ *   A segment left behind by an instance that has gone away is replaced.
+ *
+ ****************************************************************************/
+
+void shmdev_init(int devidx)
+{
+  struct shmdev_s *priv = &g_shmdev[devidx];
+  struct shmdev_link_s *link;
+  unsigned char mac[6];
+  char envname[16];
+  const char *env;
+  uint32_t hash;
+  bool stale;
+#ifdef CONFIG_SIM_HOSTTIMER
+  pthread_t tid;
+#endif
+
+  snprintf(envname, sizeof(envname), SHMDEV_ENVNAME, devidx);
+  env = getenv(envname);
+  if (env != NULL)
+    {
+      snprintf(priv->name, sizeof(priv->name), "%s%s",
+               env[0] == '/' ? "" : "/", env);
+    }
+  else
+    {
+      snprintf(priv->name, sizeof(priv->name), "%s%d",
+               CONFIG_SIM_NETDEV_SHMEM_NAME, devidx);
+    }
+
+  link = shmdev_attach(priv, priv->name, &stale);
+  if (link == NULL && stale)
+    {
+      syslog(LOG_INFO, "SHMDEV: Replacing stale link %s\n", priv->name);
+      (void)shm_unlink(priv->name);
+      link = shmdev_attach(priv, priv->name, &stale);
+    }
+
+  if (link == NULL)
+    {
+      syslog(LOG_ERR, "SHMDEV: Device %d not attached to %s\n",
+             devidx, priv->name);
+      return;
+    }
+
+  if (devidx == 0)
+    {
+      (void)atexit(shmdev_detach);
+    }
+
+  priv->link = link;
+  priv->tx   = &link->ring[priv->side];
+  priv->rx   = &link->ring[priv->side ^ 1];
+
+#ifdef CONFIG_SIM_HOSTTIMER
+  /* Start the host thread that wakes up the IDLE loop on new frames */
+
+  if (pthread_create(&tid, NULL, shmdev_thread, priv->rx) != 0)
+    {
+      syslog(LOG_ERR, "SHMDEV: pthread_create failed\n");
+    }
+#endif
+
+  /* Use a locally administered MAC address that is unique on the link */
+
+  hash   = shmdev_hash(priv->name);
+  mac[0] = 0x02;
+  mac[1] = 0x4e;
+  mac[2] = (unsigned char)(hash >> 16);
+  mac[3] = (unsigned char)(hash >> 8);
+  mac[4] = (unsigned char)hash;
+  mac[5] = (unsigned char)priv->side;
+
+  (void)netdriver_setmacaddr(devidx, mac);
+
+  syslog(LOG_INFO, "SHMDEV: Device %d attached to %s side %d\n",
+         devidx, priv->name, priv->side);
+}
+
+/****************************************************************************
+ * Name: shmdev_read
+ *
+ * Description:
+ *   Copy the next frame sent by the peer into 'buf'.  Never waits.
+ *
+ * Returned Value:
+ *   The length of the frame or zero if no frame is available.
+ *
+ ****************************************************************************/
+
+unsigned int shmdev_read(int devidx, unsigned char *buf, unsigned int buflen)
+{
+  struct shmdev_ring_s *rx = g_shmdev[devidx].rx;
+  struct shmdev_frame_s *frame;
+  unsigned int len;
+  uint32_t tail;
+
+  if (rx == NULL)
+    {
+      return 0;
+    }
+
+  tail = rx->tail;
+  if (tail == rx->head)
+    {
+      return 0;
+    }
+
+  __sync_synchronize();
+
+  frame = &rx->frames[tail];
+  len   = frame->len < buflen ? frame->len : buflen;
+  memcpy(buf, frame->buf, len);
+
+  __sync_synchronize();
+  rx->tail = shmdev_next(tail);
+  return len;
+}
+
+/****************************************************************************
+ * Name: shmdev_send
+ *
+ * Description:
+ *   Copy a frame into the ring read by the peer.  If the ring is full, the
+ *   frame is dropped and counted, as a NIC would do.  Never waits.
+ *
+ ****************************************************************************/
+
+void shmdev_send(int devidx, unsigned char *buf, unsigned int buflen)
+{
+  struct shmdev_s *priv = &g_shmdev[devidx];
+  struct shmdev_ring_s *tx = priv->tx;
+  struct shmdev_frame_s *frame;
+  uint32_t head;
+  uint32_t next;
+
+  if (tx == NULL || buflen > NETDEV_BUFSIZE)
+    {
+      return;
+    }
+
+  head = tx->head;
+  next = shmdev_next(head);
+
+  if (next == tx->tail)
+    {
+      priv->txdropped++;
+      return;
+    }
+
+  frame      = &tx->frames[head];
+  frame->len = buflen;
+  memcpy(frame->buf, buf, buflen);
+
+  __sync_synchronize();
+  tx->head = next;
+
+  /* Wake up the host thread of the peer if it is waiting for frames */
+
+  __sync_synchronize();
+  if (tx->rxwaiting)
+    {
+      (void)shmdev_futex(&tx->head, FUTEX_WAKE, 1, NULL);
+    }
+}
@@ -39,11 +39,18 @@
 
 #define _GNU_SOURCE 1
 
+#include <sys/syscall.h>
+#include <linux/futex.h>
+
 #include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <unistd.h>
 #include <pthread.h>
 #include <semaphore.h>
 #include <signal.h>
 #include <errno.h>
+#include <time.h>
 
 /****************************************************************************
  * Pre-processor Definitions
@@ -72,6 +79,18 @@ struct sim_cpuinfo_s
   pthread_mutex_t mutex;  /* For synchronization */
 };
 
+/* IDLE statistics of one CPU */
+
+#ifdef CONFIG_SIM_SMP_IDLESTATS
+struct sim_idlestats_s
+{
+  unsigned long nsleeps;        /* Number of IDLE sleeps */
+  unsigned long nwakeups;       /* Sleeps ended by an inter-CPU signal */
+  uint64_t latsum;              /* Sum of wake-up latencies (nsec) */
+  uint64_t latmax;              /* Worst wake-up latency (nsec) */
+};
+#endif
+
 /****************************************************************************
  * Private Data
  ****************************************************************************/
@@ -80,6 +99,12 @@ static pthread_key_t          g_cpukey;
 static pthread_t              g_sim_cputhread[CONFIG_SMP_NCPUS];
 static volatile unsigned char g_sim_cpupaused[CONFIG_SMP_NCPUS];
 static volatile spinlock_t    g_sim_cpuwait[CONFIG_SMP_NCPUS];
+static volatile uint32_t      g_sim_cpuidle[CONFIG_SMP_NCPUS];
+
+#ifdef CONFIG_SIM_SMP_IDLESTATS
+static volatile uint64_t      g_sim_cpusignaled[CONFIG_SMP_NCPUS];
+static struct sim_idlestats_s g_sim_idlestats[CONFIG_SMP_NCPUS];
+#endif
 
 /****************************************************************************
  * NuttX domain function prototypes
@@ -90,10 +115,65 @@ void sim_cpu_pause(int cpu, volatile spinlock_t *wait,
                    volatile unsigned char *paused);
 void sim_smp_hook(void);
 
+#ifdef CONFIG_SIM_PROFILE
+void sim_profile_cputhread(void);
+#endif
+
 /****************************************************************************
  * Private Functions
  ****************************************************************************/
 
+/****************************************************************************
+ * Name: sim_gettime
+ *
+ * Description:
+ *   Return the host monotonic time in nanoseconds
+ *
+ ****************************************************************************/
+
+#ifdef CONFIG_SIM_SMP_IDLESTATS
+static uint64_t sim_gettime(void)
+{
+  struct timespec ts;
+
+  (void)clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+#endif
+
+/****************************************************************************
+ * Name: sim_idlestats_report
+ *
+ * Description:
+ *   Report the IDLE statistics of each CPU on stderr.  Runs at exit of the
+ *   simulation.
+ *
+ ****************************************************************************/
+
+#ifdef CONFIG_SIM_SMP_IDLESTATS
+static void sim_idlestats_report(void)
+{
+  struct sim_idlestats_s *stats;
+  int cpu;
+
+  for (cpu = 0; cpu < CONFIG_SMP_NCPUS; cpu++)
+    {
+      stats = &g_sim_idlestats[cpu];
+      fprintf(stderr, "CPU%d: %lu IDLE sleeps, %lu signaled wake-ups",
+              cpu, stats->nsleeps, stats->nwakeups);
+
+      if (stats->nwakeups > 0)
+        {
+          fprintf(stderr, ", latency avg %llu nsec max %llu nsec",
+                  (unsigned long long)(stats->latsum / stats->nwakeups),
+                  (unsigned long long)stats->latmax);
+        }
+
+      fprintf(stderr, "\n");
+    }
+}
+#endif
+
 /****************************************************************************
  * Name: sim_cpu0_trampoline
  *
@@ -187,6 +267,12 @@ static void *sim_idle_trampoline(void *arg)
       return NULL;
     }
 
+#ifdef CONFIG_SIM_PROFILE
+  /* Collect profile samples on this CPU */
+
+  sim_profile_cputhread();
+#endif
+
   /* Let up_cpu_start() continue */
 
   (void)pthread_mutex_unlock(&cpuinfo->mutex);
@@ -222,6 +308,29 @@ static void sim_handle_signal(int signo, siginfo_t *info, void *context)
 {
   int cpu = (int)((uintptr_t)pthread_getspecific(g_cpukey));
 
+#ifdef CONFIG_SIM_SMP_IDLESTATS
+  /* If the CPU was sleeping in the IDLE loop, account for the time from
+   * up_cpu_pause() until now.
+   */
+
+  if (g_sim_cpuidle[cpu] != 0)
+    {
+      struct sim_idlestats_s *stats = &g_sim_idlestats[cpu];
+      uint64_t latency = sim_gettime() - g_sim_cpusignaled[cpu];
+
+      stats->nwakeups++;
+      stats->latsum += latency;
+      if (latency > stats->latmax)
+        {
+          stats->latmax = latency;
+        }
+    }
+#endif
+
+  /* The CPU is no longer sleeping (if it was) */
+
+  g_sim_cpuidle[cpu] = 0;
+
   /* We need to perform the actual tasking operations in the NuttX domain */
 
   sim_cpu_pause(cpu, &g_sim_cpuwait[cpu], &g_sim_cpupaused[cpu]);
@@ -284,6 +393,10 @@ int sim_cpu0_initialize(void)
       return -errno;
     }
 
+#ifdef CONFIG_SIM_SMP_IDLESTATS
+  (void)atexit(sim_idlestats_report);
+#endif
+
   return 0;
 }
 
@@ -343,6 +456,47 @@ int up_cpu_index(void)
   return (int)((uintptr_t)value);
 }
 
+/****************************************************************************
+ * Name: sim_cpu_idle
+ *
+ * Description:
+ *   Put the calling CPU to sleep for up to 'usec' microseconds.  This is
+ *   called from the IDLE loop of a CPU that has nothing to do, including
+ *   servicing the simulated devices.  The sleep ends early when another
+ *   CPU signals this CPU with up_cpu_pause().
+ *
+ * Input Parameters:
+ *   usec - The maximum time to sleep in microseconds.
+ *
+ * Returned Value:
+ *   None
+ *
+ ****************************************************************************/
+
+void sim_cpu_idle(unsigned int usec)
+{
+  int cpu = up_cpu_index();
+  struct timespec timeout;
+
+  timeout.tv_sec  = usec / 1000000;
+  timeout.tv_nsec = (usec % 1000000) * 1000;
+
+#ifdef CONFIG_SIM_SMP_IDLESTATS
+  g_sim_idlestats[cpu].nsleeps++;
+#endif
+
+  /* Mark the CPU as sleeping and wait on the futex word.  Nothing ever
+   * changes the word; the wait ends with the timeout or with EINTR when
+   * SIGUSR1 is delivered.  If the signal handler switches to another task,
+   * the wait is simply abandoned.
+   */
+
+  g_sim_cpuidle[cpu] = 1;
+  (void)syscall(SYS_futex, &g_sim_cpuidle[cpu], FUTEX_WAIT_PRIVATE, 1,
+                &timeout, NULL, 0);
+  g_sim_cpuidle[cpu] = 0;
+}
+
 /****************************************************************************
  * Name: up_cpu_start
  *
@@ -448,6 +602,10 @@ int up_cpu_pause(int cpu)
 
   g_sim_cpuwait[cpu] = SP_LOCKED;
 
+#ifdef CONFIG_SIM_SMP_IDLESTATS
+  g_sim_cpusignaled[cpu] = sim_gettime();
+#endif
+
   /* Signal the CPU thread */
 
   pthread_kill(g_sim_cputhread[cpu], SIGUSR1);
@@ -37,25 +37,50 @@
  * Included Files
  ****************************************************************************/
 
+#include <sys/eventfd.h>
+
 #include <stdbool.h>
+#include <stdint.h>
 #include <unistd.h>
 #include <string.h>
+#include <errno.h>
 #include <termios.h>
 #include <pthread.h>
+#include <signal.h>
 
 /****************************************************************************
  * Pre-processor Definitions
  ****************************************************************************/
 
-/* Simulated console UART input buffer size */
-/* Must match the defintion in up_internal.h */
+/* Simulated console UART input and output buffer sizes */
+
+#ifndef CONFIG_SIM_UART_RXBUFSIZE
+#  define CONFIG_SIM_UART_RXBUFSIZE 256
+#endif
+
+#ifndef CONFIG_SIM_UART_TXBUFSIZE
+#  define CONFIG_SIM_UART_TXBUFSIZE 256
+#endif
+
+#if CONFIG_SIM_UART_TXBUFSIZE < 2
+#  error CONFIG_SIM_UART_TXBUFSIZE must hold at least "\r\n"
+#endif
 
-#define SIMUART_BUFSIZE 256
+#define SIMUART_BUFSIZE CONFIG_SIM_UART_RXBUFSIZE
 
 /* The design for how we signal UART data availability is up in the air */
 
 #undef CONFIG_SIM_UART_DATAPOST
 
+/* With event record/replay, input is only made visible to NuttX from the
+ * IDLE loop.  This must match SIM_REPLAY_UART in up_internal.h.
+ */
+
+#if defined(CONFIG_SIM_REPLAY_RECORD) || defined(CONFIG_SIM_REPLAY_PLAY)
+#  define SIMUART_REPLAY 1
+#  define SIMUART_REPLAY_SOURCE 0
+#endif
+
 /****************************************************************************
  * Private Data
  ****************************************************************************/
@@ -64,6 +89,46 @@ static char g_uartbuffer[SIMUART_BUFSIZE];
 static volatile int  g_uarthead;
 static volatile int  g_uarttail;
 
+#ifndef CONFIG_SIM_REPLAY_PLAY
+/* The host thread that fills g_uartbuffer (or g_uartstage) blocks on this
+ * event counter while the buffer is full.  The consumer posts it when it
+ * frees space in a full buffer.  The counter latches, so a post made just
+ * before the host thread blocks is not lost.
+ */
+
+static int g_uartspacefd = -1;
+#endif
+
+#ifndef SIMUART_REPLAY
+/* Set by simuart_thread() while it waits for space.  It is set before the
+ * thread checks g_uarttail for the last time, and the consumer checks it
+ * only after storing g_uarttail, so one of the two always sees the other.
+ */
+
+static volatile int g_uartspacewait;
+#endif
+
+/* Console output is collected here and written with a single write() when
+ * a newline is output, when the buffer fills, or when the system goes idle.
+ * With CONFIG_SMP, SIGUSR1 (which pauses a CPU and may switch tasks) is
+ * blocked while g_uarttxlock is held.  Otherwise a task could be switched
+ * out holding the lock and the next output on that CPU would deadlock.
+ */
+
+static char g_uarttxbuffer[CONFIG_SIM_UART_TXBUFSIZE];
+static int  g_uarttxlen;
+static pthread_mutex_t g_uarttxlock = PTHREAD_MUTEX_INITIALIZER;
+
+#ifdef CONFIG_SIM_REPLAY_RECORD
+/* When recording, stdin is collected here until the IDLE loop moves it
+ * into the UART buffer.
+ */
+
+static char g_uartstage[SIMUART_BUFSIZE];
+static int  g_uartstagelen;
+static pthread_mutex_t g_uartstagelock = PTHREAD_MUTEX_INITIALIZER;
+#endif
+
 /****************************************************************************
  * Public Data
  ****************************************************************************/
@@ -72,6 +137,22 @@ static volatile int  g_uarttail;
 volatile int g_uart_data_available;
 #endif
 
+/****************************************************************************
+ * Host Domain Public Function Prototypes
+ ****************************************************************************/
+
+#if defined(CONFIG_SIM_HOSTTIMER) && !defined(CONFIG_SIM_UART_DATAPOST)
+void host_idle_wakeup(void);
+#endif
+
+#ifdef CONFIG_SIM_REPLAY_RECORD
+void sim_replay_record(int source, const void *data, unsigned int len);
+#endif
+
+#ifdef CONFIG_SIM_REPLAY_PLAY
+unsigned int sim_replay_fetch(int source, void *data, unsigned int len);
+#endif
+
 /****************************************************************************
  * NuttX Domain Public Function Prototypes
  ****************************************************************************/
@@ -118,67 +199,161 @@ static void setrawmode(void)
   (void)tcsetattr(0, TCSANOW, &raw);
 }
 
+/****************************************************************************
+ * Name: simuart_txlock and simuart_txunlock
+ *
+ * Description:
+ *   Take and release g_uarttxlock.
+ *
+ ****************************************************************************/
+
+static void simuart_txlock(sigset_t *oldset)
+{
+#ifdef CONFIG_SMP
+  sigset_t set;
+
+  (void)sigemptyset(&set);
+  (void)sigaddset(&set, SIGUSR1);
+  (void)pthread_sigmask(SIG_BLOCK, &set, oldset);
+#else
+  (void)oldset;
+#endif
+
+  (void)pthread_mutex_lock(&g_uarttxlock);
+}
+
+static void simuart_txunlock(sigset_t *oldset)
+{
+  (void)pthread_mutex_unlock(&g_uarttxlock);
+
+#ifdef CONFIG_SMP
+  (void)pthread_sigmask(SIG_SETMASK, oldset, NULL);
+#else
+  (void)oldset;
+#endif
+}
+
+/****************************************************************************
+ * Name: simuart_spacewait and simuart_spacepost
+ *
+ * Description:
+ *   Wait until the consumer has freed space in a full input buffer, and
+ *   tell the waiting host thread that it has done so.
+ *
+ ****************************************************************************/
+
+#ifndef CONFIG_SIM_REPLAY_PLAY
+static void simuart_spacewait(void)
+{
+  uint64_t count;
+
+  (void)read(g_uartspacefd, &count, sizeof(count));
+}
+
+static void simuart_spacepost(void)
+{
+  uint64_t count = 1;
+
+  (void)write(g_uartspacefd, &count, sizeof(count));
+}
+#endif
+
 /****************************************************************************
  * Name: simuart_thread
  ****************************************************************************/
 
+#ifndef SIMUART_REPLAY
 static void *simuart_thread(void *arg)
 {
-  unsigned char ch;
   ssize_t nread;
+  int space;
+  int head;
+  int tail;
   int next;
-  int prev;
 
   /* Now loop, collecting a buffering data from stdin forever */
 
   for (; ; )
     {
-      /* Read one character from stdin */
+      /* How much contiguous space is there at the head of the UART buffer?
+       * One slot is always left empty to distinguish full from empty.
+       */
+
+      head = g_uarthead;
+      tail = g_uarttail;
+
+      if (head >= tail)
+        {
+          space = SIMUART_BUFSIZE - head;
+          if (tail == 0)
+            {
+              space--;
+            }
+        }
+      else
+        {
+          space = tail - head - 1;
+        }
 
-      nread = read(0, &ch, 1);
+      if (space <= 0)
+        {
+          /* The buffer is full.  Leave the data in stdin until the NuttX
+           * domain catches up.  Check the tail again after announcing the
+           * wait in case a byte was consumed in the meantime.
+           */
+
+          g_uartspacewait = 1;
+          __sync_synchronize();
+
+          if (g_uarttail == tail)
+            {
+              simuart_spacewait();
+            }
+
+          g_uartspacewait = 0;
+          continue;
+        }
+
+      /* Read as much as is available (at least one byte) from stdin */
+
+      nread = read(0, &g_uartbuffer[head], space);
 
       /* Check for failures (but don't do anything) */
 
-      if (nread == 1)
+      if (nread > 0)
         {
 #ifdef CONFIG_SIM_UART_DATAPOST
           sched_lock();
 #endif
-          /* Get the index to the next slot in the UART buffer */
-
-          prev = g_uarthead;
-          next = prev + 1;
+          next = head + nread;
           if (next >= SIMUART_BUFSIZE)
             {
               next = 0;
             }
 
-          /* Would adding this character cause an overflow? */
-
-          if (next != g_uarttail)
-            {
-              /* No.. Add the character to the UART buffer */
-
-              g_uartbuffer[prev] = ch;
-
-              /* Update the head index (BEFORE posting) */
+          /* Update the head index (BEFORE posting).  Make sure that the
+           * data is visible first.
+           */
 
-              g_uarthead = next;
+          __sync_synchronize();
+          g_uarthead = next;
 
-              /* Was the buffer previously empty? */
+          /* Was the buffer previously empty? */
 
-              if (prev == g_uarttail)
-                {
-                  /* Yes.. signal any (NuttX) threads waiting for serial
-                   * input.
-                   */
+          if (head == g_uarttail)
+            {
+              /* Yes.. signal any (NuttX) threads waiting for serial
+               * input.
+               */
 
 #ifdef CONFIG_SIM_UART_DATAPOST
-                  simuart_post();
+              simuart_post();
 #else
-                  g_uart_data_available = 1;
+              g_uart_data_available = 1;
+#ifdef CONFIG_SIM_HOSTTIMER
+              host_idle_wakeup();
+#endif
 #endif
-                }
             }
 
 #ifdef CONFIG_SIM_UART_DATAPOST
@@ -197,6 +372,84 @@ static void *simuart_thread(void *arg)
 
   return NULL;
 }
+#endif
+
+/****************************************************************************
+ * Name: simuart_stagethread
+ *
+ * Description:
+ *   Used instead of simuart_thread() when recording events.  stdin is
+ *   collected in g_uartstage and only delivered by simuart_replay().
+ *
+ ****************************************************************************/
+
+#ifdef CONFIG_SIM_REPLAY_RECORD
+static void *simuart_stagethread(void *arg)
+{
+  char buffer[SIMUART_BUFSIZE];
+  ssize_t nread;
+  int space;
+
+  for (; ; )
+    {
+      (void)pthread_mutex_lock(&g_uartstagelock);
+      space = SIMUART_BUFSIZE - g_uartstagelen;
+      (void)pthread_mutex_unlock(&g_uartstagelock);
+
+      if (space <= 0)
+        {
+          simuart_spacewait();
+          continue;
+        }
+
+      nread = read(0, buffer, space);
+      if (nread > 0)
+        {
+          (void)pthread_mutex_lock(&g_uartstagelock);
+          memcpy(&g_uartstage[g_uartstagelen], buffer, nread);
+          g_uartstagelen += nread;
+          (void)pthread_mutex_unlock(&g_uartstagelock);
+
+#ifdef CONFIG_SIM_HOSTTIMER
+          host_idle_wakeup();
+#endif
+        }
+    }
+
+  return NULL;
+}
+#endif
+
+/****************************************************************************
+ * Name: simuart_txflush
+ *
+ * Description:
+ *   Write all buffered output to stdout.  The caller holds g_uarttxlock.
+ *
+ ****************************************************************************/
+
+static void simuart_txflush(void)
+{
+  ssize_t nwritten;
+  int offset = 0;
+
+  while (offset < g_uarttxlen)
+    {
+      nwritten = write(1, &g_uarttxbuffer[offset], g_uarttxlen - offset);
+      if (nwritten < 0 && errno == EINTR)
+        {
+          continue;
+        }
+      else if (nwritten <= 0)
+        {
+          break;
+        }
+
+      offset += nwritten;
+    }
+
+  g_uarttxlen = 0;
+}
 
 /****************************************************************************
  * Name: simuart_putraw
@@ -204,14 +457,17 @@ static void *simuart_thread(void *arg)
 
 int simuart_putraw(int ch)
 {
-  ssize_t nwritten;
+  sigset_t oldset;
+
+  simuart_txlock(&oldset);
 
-  nwritten = write(1, &ch, 1);
-  if (nwritten != 1)
+  if (g_uarttxlen >= CONFIG_SIM_UART_TXBUFSIZE)
     {
-      return -1;
+      simuart_txflush();
     }
 
+  g_uarttxbuffer[g_uarttxlen++] = (char)ch;
+  simuart_txunlock(&oldset);
   return ch;
 }
 
@@ -236,12 +492,124 @@ void simuart_start(void)
 
   setrawmode();
 
+#ifndef CONFIG_SIM_REPLAY_PLAY
+  /* Create the event counter that the input thread waits on when the
+   * buffer is full.
+   */
+
+  g_uartspacefd = eventfd(0, EFD_CLOEXEC);
+#endif
+
   /* Start the simulated UART thread -- all default settings; no error
-   * checking.
+   * checking.  Nothing is read from stdin while replaying.
    */
 
+#if defined(CONFIG_SIM_REPLAY_RECORD)
+  (void)pthread_create(&tid, NULL, simuart_stagethread, NULL);
+#elif !defined(CONFIG_SIM_REPLAY_PLAY)
   (void)pthread_create(&tid, NULL, simuart_thread, NULL);
+#else
+  (void)tid;
+#endif
+}
+
+/****************************************************************************
+ * Name: simuart_replay
+ *
+ * Description:
+ *   Called from the IDLE loop when recording or replaying events.  Deliver
+ *   as much recorded (or staged) input as fits into the UART buffer.
+ *
+ ****************************************************************************/
+
+#ifdef SIMUART_REPLAY
+void simuart_replay(void)
+{
+  char buffer[SIMUART_BUFSIZE];
+  int head = g_uarthead;
+  int tail = g_uarttail;
+  int space;
+  int nbytes;
+  int chunk;
+  bool wasempty = (head == tail);
+#ifdef CONFIG_SIM_REPLAY_RECORD
+  bool wasfull;
+#endif
+
+  /* One slot is always left empty to distinguish full from empty */
+
+  space = tail - head - 1;
+  if (space < 0)
+    {
+      space += SIMUART_BUFSIZE;
+    }
+
+  if (space == 0)
+    {
+      return;
+    }
+
+#ifdef CONFIG_SIM_REPLAY_RECORD
+  (void)pthread_mutex_lock(&g_uartstagelock);
+  wasfull = (g_uartstagelen >= SIMUART_BUFSIZE);
+  nbytes  = g_uartstagelen < space ? g_uartstagelen : space;
+  if (nbytes > 0)
+    {
+      memcpy(buffer, g_uartstage, nbytes);
+      g_uartstagelen -= nbytes;
+      memmove(g_uartstage, &g_uartstage[nbytes], g_uartstagelen);
+    }
+
+  (void)pthread_mutex_unlock(&g_uartstagelock);
+
+  if (nbytes > 0)
+    {
+      /* Wake up simuart_stagethread() if it waits for space */
+
+      if (wasfull)
+        {
+          simuart_spacepost();
+        }
+
+      sim_replay_record(SIMUART_REPLAY_SOURCE, buffer, nbytes);
+    }
+#else
+  nbytes = sim_replay_fetch(SIMUART_REPLAY_SOURCE, buffer, space);
+#endif
+
+  if (nbytes <= 0)
+    {
+      return;
+    }
+
+  /* Copy into the UART buffer, wrapping at the end */
+
+  chunk = SIMUART_BUFSIZE - head;
+  if (chunk > nbytes)
+    {
+      chunk = nbytes;
+    }
+
+  memcpy(&g_uartbuffer[head], buffer, chunk);
+  memcpy(g_uartbuffer, &buffer[chunk], nbytes - chunk);
+
+  head += nbytes;
+  if (head >= SIMUART_BUFSIZE)
+    {
+      head -= SIMUART_BUFSIZE;
+    }
+
+  __sync_synchronize();
+  g_uarthead = head;
+
+  /* Was the buffer previously empty?  Then up_idle() must post */
+
+  if (wasempty)
+    {
+      g_uart_data_available = 1;
+    }
 }
+#endif
 
 /****************************************************************************
  * Name: simuart_putc
@@ -249,19 +617,53 @@ void simuart_start(void)
 
 int simuart_putc(int ch)
 {
-  int ret = ch;
+  sigset_t oldset;
+
+  simuart_txlock(&oldset);
+
+  if (g_uarttxlen + 2 > CONFIG_SIM_UART_TXBUFSIZE)
+    {
+      simuart_txflush();
+    }
 
   if (ch == '\n')
     {
-      ret = simuart_putraw('\r');
+      /* Output CR-LF and write out the complete line */
+
+      g_uarttxbuffer[g_uarttxlen++] = '\r';
+      g_uarttxbuffer[g_uarttxlen++] = '\n';
+      simuart_txflush();
+    }
+  else
+    {
+      g_uarttxbuffer[g_uarttxlen++] = (char)ch;
     }
 
-  if (ret >= 0)
+  simuart_txunlock(&oldset);
+  return ch;
+}
+
+/****************************************************************************
+ * Name: simuart_flush
+ *
+ * Description:
+ *   Write out any buffered console output.  Called from the IDLE loop and
+ *   before waiting for console input so that partial lines (like prompts)
+ *   are not held back.
+ *
+ ****************************************************************************/
+
+void simuart_flush(void)
+{
+  sigset_t oldset;
+
+  simuart_txlock(&oldset);
+  if (g_uarttxlen > 0)
     {
-      ret = simuart_putraw(ch);
+      simuart_txflush();
     }
 
-  return ret;
+  simuart_txunlock(&oldset);
 }
 
 /****************************************************************************
@@ -284,6 +686,7 @@ int simuart_getc(void)
 
       while (g_uarthead == g_uarttail)
         {
+          simuart_flush();
           simuart_wait();
         }
 
@@ -302,6 +705,19 @@ int simuart_getc(void)
         }
 
       g_uarttail = index;
+
+#ifndef SIMUART_REPLAY
+      /* Wake up simuart_thread() if it waits for space.  The barrier
+       * orders the store of the tail before the load of the flag.
+       */
+
+      __sync_synchronize();
+      if (g_uartspacewait)
+        {
+          simuart_spacepost();
+        }
+#endif
+
       sched_unlock();
       return ch;
     }
@@ -322,6 +738,10 @@ bool simuart_checkc(void)
 
 void simuart_terminate(void)
 {
+  /* Write out any remaining output */
+
+  simuart_flush();
+
   /* Restore the original terminal mode */
 
   (void)tcsetattr(0, TCSANOW, &g_cooked);
@@ -196,7 +196,12 @@ struct sim_spiflashdev_s
   uint16_t         read_data;
   uint8_t          last_cmd;
   unsigned long    address;
-  unsigned char    data[CONFIG_SPIFLASH_SIZE];
+  FAR uint8_t     *data;       /* FLASH contents */
+#ifdef CONFIG_SIM_SPIFLASH_STATS
+  bool             cmdactive;  /* A command was received since select */
+  uint64_t         cmdstart;   /* Host time when the command was received */
+  unsigned long    nbytes;     /* Data bytes read or programmed */
+#endif
 };
 
 /************************************************************************************
@@ -256,6 +261,10 @@ static const struct spi_ops_s g_spiops =
   .registercallback  = 0,
 };
 
+#ifndef CONFIG_SIM_SPIFLASH_PERSIST
+static uint8_t g_spiflashdata[CONFIG_SPIFLASH_SIZE];
+#endif
+
 struct sim_spiflashdev_s g_spidev =
 {
   .spidev   = { &g_spiops },
@@ -319,6 +328,15 @@ static void spiflash_select(FAR struct spi_dev_s *dev, enum spi_dev_e devid,
 
       if (!selected)
         {
+#ifdef CONFIG_SIM_SPIFLASH_STATS
+          if (priv->cmdactive)
+            {
+              spiflash_host_account(priv->last_cmd, priv->cmdstart,
+                                    priv->nbytes);
+              priv->cmdactive = false;
+            }
+#endif
+
           if (priv->last_cmd != SPIFLASH_WREN)
             {
               priv->wren = 0;
@@ -455,6 +473,89 @@ static uint16_t spiflash_send(FAR struct spi_dev_s *dev, uint16_t wd)
   return ret;
 }
 
+/************************************************************************************
+ * Name: spiflash_readblock
+ *
+ * Description:
+ *   Fast path for the data phase of a READ or FAST_READ command:  Copy up to
+ *   nwords bytes from the FLASH at once, stopping at the end of the FLASH
+ *   where the address wraps.
+ *
+ * Returned Value:
+ *   The number of bytes transferred
+ *
+ ************************************************************************************/
+
+static size_t spiflash_readblock(FAR struct sim_spiflashdev_s *priv,
+                                 FAR uint8_t *dest, size_t nwords)
+{
+  size_t nbytes = CONFIG_SPIFLASH_SIZE - priv->address;
+
+  if (nbytes > nwords)
+    {
+      nbytes = nwords;
+    }
+
+  if (dest)
+    {
+      memcpy(dest, &priv->data[priv->address], nbytes);
+    }
+
+  priv->read_data = priv->data[priv->address + nbytes - 1];
+  priv->address  += nbytes;
+  if (priv->address == CONFIG_SPIFLASH_SIZE)
+    {
+      priv->address = 0;
+    }
+
+#ifdef CONFIG_SIM_SPIFLASH_STATS
+  priv->nbytes += nbytes;
+#endif
+  return nbytes;
+}
+
+/************************************************************************************
+ * Name: spiflash_programblock
+ *
+ * Description:
+ *   Fast path for the data phase of a PAGE PROGRAM command:  Copy up to
+ *   nwords bytes to the FLASH at once, stopping at the end of the page where
+ *   the address wraps to the beginning of the page.
+ *
+ * Returned Value:
+ *   The number of bytes transferred
+ *
+ ************************************************************************************/
+
+static size_t spiflash_programblock(FAR struct sim_spiflashdev_s *priv,
+                                    FAR const uint8_t *src, size_t nwords)
+{
+  size_t nbytes;
+
+  nbytes = CONFIG_SIM_SPIFLASH_PAGESIZE -
+           (priv->address & CONFIG_SIM_SPIFLASH_PAGESIZE_MASK);
+  if (nbytes > nwords)
+    {
+      nbytes = nwords;
+    }
+
+  if (priv->wren)
+    {
+      memcpy(&priv->data[priv->address], src, nbytes);
+    }
+
+  priv->address += nbytes;
+  if ((priv->address & CONFIG_SIM_SPIFLASH_PAGESIZE_MASK) == 0)
+    {
+      priv->address -= CONFIG_SIM_SPIFLASH_PAGESIZE;
+    }
+
+#ifdef CONFIG_SIM_SPIFLASH_STATS
+  priv->nbytes += nbytes;
+#endif
+  return nbytes;
+}
+
 /************************************************************************************
  * Name: spiflash_exchange (no DMA).  aka spi_exchange_nodma
  *
@@ -479,16 +580,55 @@ static uint16_t spiflash_send(FAR struct spi_dev_s *dev, uint16_t wd)
 static void spiflash_exchange(FAR struct spi_dev_s *dev, FAR const void *txbuffer,
                               FAR void *rxbuffer, size_t nwords)
 {
-  spivdbg("txbuffer=%p rxbuffer=%p nwords=%d\n", txbuffer, rxbuffer, nwords);
-
-  /* 8-bit mode */
-
+  FAR struct sim_spiflashdev_s *priv = (FAR struct sim_spiflashdev_s *)dev;
   FAR const uint8_t *src  = (FAR const uint8_t *)txbuffer;
   FAR uint8_t *dest = (FAR uint8_t *)rxbuffer;
+  size_t nbytes;
   uint8_t word;
 
-  while (nwords-- > 0)
+  spivdbg("txbuffer=%p rxbuffer=%p nwords=%d\n", txbuffer, rxbuffer, nwords);
+
+  /* 8-bit mode */
+
+  while (nwords > 0)
     {
+      /* In the data phase of a READ or PAGE PROGRAM command, transfer as
+       * much as possible with a single copy instead of byte by byte.
+       */
+
+      if (priv->selected && priv->state == SPIFLASH_STATE_READ4)
+        {
+          nbytes = spiflash_readblock(priv, dest, nwords);
+          nwords -= nbytes;
+          if (src)
+            {
+              src += nbytes;
+            }
+
+          if (dest)
+            {
+              dest += nbytes;
+            }
+
+          continue;
+        }
+
+      if (priv->selected && priv->state == SPIFLASH_STATE_PP4 && src)
+        {
+          nbytes = spiflash_programblock(priv, src, nwords);
+          nwords -= nbytes;
+          src    += nbytes;
+          if (dest)
+            {
+              memset(dest, (uint8_t)priv->read_data, nbytes);
+              dest += nbytes;
+            }
+
+          continue;
+        }
+
+      nwords--;
+
       /* Get the next word to write.  Is there a source buffer? */
 
       if (src)
@@ -633,6 +773,11 @@ static void spiflash_writeword(FAR struct sim_spiflashdev_s *priv, uint16_t data
       case SPIFLASH_STATE_IDLE:
         priv->last_cmd = data;
         priv->read_data = 0xff;
+#ifdef CONFIG_SIM_SPIFLASH_STATS
+        priv->cmdactive = true;
+        priv->cmdstart  = spiflash_host_gettime();
+        priv->nbytes    = 0;
+#endif
         switch (data)
           {
             case SPIFLASH_RDID:
@@ -756,6 +901,10 @@ static void spiflash_writeword(FAR struct sim_spiflashdev_s *priv, uint16_t data
             priv->data[priv->address] = data;
           }
 
+#ifdef CONFIG_SIM_SPIFLASH_STATS
+        priv->nbytes++;
+#endif
+
         /* Now increment the address.  We do a page wrap here to simulate
          * the actual FLASH.
          */
@@ -763,7 +912,7 @@ static void spiflash_writeword(FAR struct sim_spiflashdev_s *priv, uint16_t data
         if ((priv->address & CONFIG_SIM_SPIFLASH_PAGESIZE_MASK) ==
               CONFIG_SIM_SPIFLASH_PAGESIZE_MASK)
           {
-            priv->address &= !CONFIG_SIM_SPIFLASH_PAGESIZE_MASK;
+            priv->address &= ~CONFIG_SIM_SPIFLASH_PAGESIZE_MASK;
           }
         else
           {
@@ -808,6 +957,10 @@ static void spiflash_writeword(FAR struct sim_spiflashdev_s *priv, uint16_t data
           {
             priv->address = 0;
           }
+
+#ifdef CONFIG_SIM_SPIFLASH_STATS
+        priv->nbytes++;
+#endif
         break;
 
       default:
@@ -867,7 +1020,23 @@ FAR struct spi_dev_s *up_spiflashinitialize()
   priv->state = SPIFLASH_STATE_IDLE;
   priv->read_data = 0xFF;
   priv->last_cmd = 0xFF;
-  memset(&priv->data[0], 0xFF, sizeof(priv->data));
+
+#ifdef CONFIG_SIM_SPIFLASH_PERSIST
+  /* The FLASH contents are kept in a host file and survive restarts */
+
+  if (priv->data == NULL)
+    {
+      priv->data = (FAR uint8_t *)spiflash_host_map(CONFIG_SPIFLASH_SIZE);
+      if (priv->data == NULL)
+        {
+          leave_critical_section(flags);
+          return NULL;
+        }
+    }
+#else
+  priv->data = g_spiflashdata;
+  memset(priv->data, 0xFF, CONFIG_SPIFLASH_SIZE);
+#endif
 
   leave_critical_section(flags);
   return (FAR struct spi_dev_s *)priv;
@@ -0,0 +1,311 @@
+/****************************************************************************
+ * arch/sim/src/up_spiflashhost.c
+ *
+ *   Copyright (C) 2016 Gregory Nutt. All rights reserved.
+ *   Author: Gregory Nutt <gnutt@nuttx.org>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name NuttX nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************/
+
+/****************************************************************************
+ * Included Files
+ ****************************************************************************/
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <time.h>
+
+/****************************************************************************
+ * Pre-processor Definitions
+ ****************************************************************************/
+
+#ifndef CONFIG_SIM_SPIFLASH_FILE
+#  define CONFIG_SIM_SPIFLASH_FILE "spiflash.bin"
+#endif
+
+/* SPI FLASH commands that are accounted separately.  Must match the
+ * definitions in up_spiflash.c.
+ */
+
+#define SPIFLASH_RDSR      0x05
+#define SPIFLASH_READ      0x03
+#define SPIFLASH_FAST_READ 0x0b
+#define SPIFLASH_PP        0x02
+#define SPIFLASH_SE        0xd8
+#define SPIFLASH_BE        0xc7
+#define SPIFLASH_SSE       0x20
+
+/****************************************************************************
+ * Private Types
+ ****************************************************************************/
+
+#ifdef CONFIG_SIM_SPIFLASH_STATS
+struct spiflash_stats_s
+{
+  const char   *name;
+  unsigned long count;          /* Number of commands */
+  uint64_t      nbytes;         /* Data bytes transferred */
+  uint64_t      nsec;           /* Time from command to de-select */
+};
+#endif
+
+/****************************************************************************
+ * Private Data
+ ****************************************************************************/
+
+#ifdef CONFIG_SIM_SPIFLASH_STATS
+static struct spiflash_stats_s g_spiflash_stats[] =
+{
+  { "READ",      0, 0, 0 },
+  { "FAST_READ", 0, 0, 0 },
+  { "PP",        0, 0, 0 },
+  { "SE",        0, 0, 0 },
+  { "SSE",       0, 0, 0 },
+  { "BE",        0, 0, 0 },
+  { "RDSR",      0, 0, 0 },
+  { "other",     0, 0, 0 }
+};
+
+static pthread_once_t g_spiflash_statsonce = PTHREAD_ONCE_INIT;
+#endif
+
+/****************************************************************************
+ * Private Functions
+ ****************************************************************************/
+
+#ifdef CONFIG_SIM_SPIFLASH_STATS
+/****************************************************************************
+ * Name: spiflash_host_report
+ ****************************************************************************/
+
+static void spiflash_host_report(void)
+{
+  struct spiflash_stats_s *stats;
+  size_t i;
+
+  fprintf(stderr, "spiflash: %-10s %10s %12s %12s %10s %10s\n",
+          "command", "count", "bytes", "usec", "nsec/cmd", "MB/s");
+
+  for (i = 0;
+       i < sizeof(g_spiflash_stats) / sizeof(g_spiflash_stats[0]);
+       i++)
+    {
+      stats = &g_spiflash_stats[i];
+      if (stats->count > 0)
+        {
+          fprintf(stderr,
+                  "spiflash: %-10s %10lu %12llu %12llu %10llu %10.1f\n",
+                  stats->name, stats->count,
+                  (unsigned long long)stats->nbytes,
+                  (unsigned long long)(stats->nsec / 1000),
+                  (unsigned long long)(stats->nsec / stats->count),
+                  stats->nsec > 0 ?
+                  (double)stats->nbytes * 1000.0 / (double)stats->nsec : 0.0);
+        }
+    }
+}
+
+/****************************************************************************
+ * Name: spiflash_host_setup
+ ****************************************************************************/
+
+static void spiflash_host_setup(void)
+{
+  (void)atexit(spiflash_host_report);
+}
+#endif
+
+/****************************************************************************
+ * Public Functions
+ ****************************************************************************/
+
+#ifdef CONFIG_SIM_SPIFLASH_PERSIST
+/****************************************************************************
+ * Name: spiflash_host_map
+ *
+ * Description:
+ *   Map the FLASH image file (CONFIG_SIM_SPIFLASH_FILE or the file named
+ *   by the SIM_SPIFLASH environment variable) into memory.  A new image,
+ *   or one of the wrong size, is created in the erased state.  Changes
+ *   to the mapping are written back to the file by the host OS.
+ *
+ * Returned Value:
+ *   The address of the mapping or NULL on failure.
+ *
+ ****************************************************************************/
+
+void *spiflash_host_map(size_t size)
+{
+  const char *path;
+  struct stat buf;
+  off_t length;
+  void *mem;
+  int fd;
+
+  /* The size must be representable as a file length */
+
+  length = (off_t)size;
+  if (length < 0 || (size_t)length != size)
+    {
+      fprintf(stderr, "spiflash: bad size %zu\n", size);
+      return NULL;
+    }
+
+  path = getenv("SIM_SPIFLASH");
+  if (path == NULL)
+    {
+      path = CONFIG_SIM_SPIFLASH_FILE;
+    }
+
+  fd = open(path, O_RDWR | O_CREAT, 0644);
+  if (fd < 0 || fstat(fd, &buf) < 0)
+    {
+      fprintf(stderr, "spiflash: cannot open %s\n", path);
+      if (fd >= 0)
+        {
+          close(fd);
+        }
+
+      return NULL;
+    }
+
+  if (buf.st_size != length && ftruncate(fd, length) < 0)
+    {
+      fprintf(stderr, "spiflash: cannot resize %s\n", path);
+      close(fd);
+      return NULL;
+    }
+
+  mem = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+
+  if (mem == MAP_FAILED)
+    {
+      fprintf(stderr, "spiflash: cannot map %s\n", path);
+      return NULL;
+    }
+
+  if (buf.st_size != length)
+    {
+      /* New or incompatible image:  Start with an erased FLASH */
+
+      if (buf.st_size != 0)
+        {
+          fprintf(stderr, "spiflash: %s has the wrong size; erasing\n",
+                  path);
+        }
+
+      memset(mem, 0xff, size);
+    }
+
+  return mem;
+}
+#endif
+
+#ifdef CONFIG_SIM_SPIFLASH_STATS
+/****************************************************************************
+ * Name: spiflash_host_gettime
+ *
+ * Description:
+ *   Return the host monotonic time in nanoseconds
+ *
+ ****************************************************************************/
+
+uint64_t spiflash_host_gettime(void)
+{
+  struct timespec ts;
+
+  (void)clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+/****************************************************************************
+ * Name: spiflash_host_account
+ *
+ * Description:
+ *   Account one completed FLASH command.  Called when the FLASH is
+ *   de-selected.
+ *
+ ****************************************************************************/
+
+void spiflash_host_account(int cmd, uint64_t start, unsigned long nbytes)
+{
+  struct spiflash_stats_s *stats;
+
+  (void)pthread_once(&g_spiflash_statsonce, spiflash_host_setup);
+
+  switch (cmd)
+    {
+      case SPIFLASH_READ:
+        stats = &g_spiflash_stats[0];
+        break;
+
+      case SPIFLASH_FAST_READ:
+        stats = &g_spiflash_stats[1];
+        break;
+
+      case SPIFLASH_PP:
+        stats = &g_spiflash_stats[2];
+        break;
+
+      case SPIFLASH_SE:
+        stats = &g_spiflash_stats[3];
+        break;
+
+      case SPIFLASH_SSE:
+        stats = &g_spiflash_stats[4];
+        break;
+
+      case SPIFLASH_BE:
+        stats = &g_spiflash_stats[5];
+        break;
+
+      case SPIFLASH_RDSR:
+        stats = &g_spiflash_stats[6];
+        break;
+
+      default:
+        stats = &g_spiflash_stats[7];
+        break;
+    }
+
+  stats->count++;
+  stats->nbytes += nbytes;
+  stats->nsec   += spiflash_host_gettime() - start;
+}
+#endif
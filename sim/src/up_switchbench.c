@@ -0,0 +1,204 @@
+/****************************************************************************
+ * arch/sim/src/up_switchbench.c
+ *
+ *   Copyright (C) 2016 Gregory Nutt. All rights reserved.
+ *   Author: Gregory Nutt <gnutt@nuttx.org>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name NuttX nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************/
+
+/****************************************************************************
+ * Included Files
+ ****************************************************************************/
+
+#include <nuttx/config.h>
+
+#include <sys/types.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <sched.h>
+#include <semaphore.h>
+
+#include <nuttx/wqueue.h>
+
+#include "up_internal.h"
+
+/****************************************************************************
+ * Pre-processor Definitions
+ ****************************************************************************/
+
+#ifndef CONFIG_SIM_SWITCHBENCH_NLOOPS
+#  define CONFIG_SIM_SWITCHBENCH_NLOOPS 100000
+#endif
+
+#define SWITCHBENCH_PRIORITY  SCHED_PRIORITY_DEFAULT
+#define SWITCHBENCH_STACKSIZE 8192
+
+/****************************************************************************
+ * Private Data
+ ****************************************************************************/
+
+static sem_t g_ping;
+static sem_t g_pong;
+static struct work_s g_switchbench_work;
+
+/****************************************************************************
+ * Private Functions
+ ****************************************************************************/
+
+/****************************************************************************
+ * Name: switchbench_partner
+ *
+ * Description:
+ *   Answer each ping with a pong.
+ *
+ ****************************************************************************/
+
+static int switchbench_partner(int argc, char *argv[])
+{
+  int i;
+
+  for (i = 0; i < 2 * CONFIG_SIM_SWITCHBENCH_NLOOPS; i++)
+    {
+      while (sem_wait(&g_ping) < 0);
+      sem_post(&g_pong);
+    }
+
+  return 0;
+}
+
+/****************************************************************************
+ * Name: switchbench_run
+ *
+ * Description:
+ *   Ping-pong with the partner task through two semaphores.  Both tasks
+ *   have the same priority, so each round trip is two context switches:
+ *   this task blocks on g_pong and the partner blocks on g_ping.
+ *
+ ****************************************************************************/
+
+static uint64_t switchbench_run(void)
+{
+  uint64_t start;
+  int i;
+
+  start = up_hosttime();
+  for (i = 0; i < CONFIG_SIM_SWITCHBENCH_NLOOPS; i++)
+    {
+      sem_post(&g_ping);
+      while (sem_wait(&g_pong) < 0);
+    }
+
+  return up_hosttime() - start;
+}
+
+/****************************************************************************
+ * Name: switchbench_main
+ ****************************************************************************/
+
+static int switchbench_main(int argc, char *argv[])
+{
+  uint64_t elapsed;
+
+  sem_init(&g_ping, 0, 0);
+  sem_init(&g_pong, 0, 0);
+
+  if (task_create("switchpartner", SWITCHBENCH_PRIORITY,
+                  SWITCHBENCH_STACKSIZE, switchbench_partner, NULL) < 0)
+    {
+      printf("switchbench: Failed to start the partner task\n");
+      return 1;
+    }
+
+  /* The first run warms up the host caches */
+
+  (void)switchbench_run();
+  elapsed = switchbench_run();
+
+  printf("switchbench: %d round trips in %lu us, %lu ns per context "
+         "switch (%s)\n",
+         CONFIG_SIM_SWITCHBENCH_NLOOPS,
+         (unsigned long)(elapsed / 1000),
+         (unsigned long)(elapsed / (2 * CONFIG_SIM_SWITCHBENCH_NLOOPS)),
+#ifdef CONFIG_SIM_FASTSWITCH
+         "up_swapcontext"
+#else
+         "up_setjmp/up_longjmp"
+#endif
+         );
+
+  sem_destroy(&g_ping);
+  sem_destroy(&g_pong);
+  return 0;
+}
+
+/****************************************************************************
+ * Name: switchbench_worker
+ *
+ * Description:
+ *   Runs on the low priority work queue.  Create the benchmark task.  This
+ *   may block, which the IDLE loop must never do.
+ *
+ ****************************************************************************/
+
+static void switchbench_worker(FAR void *arg)
+{
+  if (task_create("switchbench", SWITCHBENCH_PRIORITY,
+                  SWITCHBENCH_STACKSIZE, switchbench_main, NULL) < 0)
+    {
+      printf("switchbench: Failed to start the benchmark task\n");
+    }
+}
+
+/****************************************************************************
+ * Public Functions
+ ****************************************************************************/
+
+/****************************************************************************
+ * Name: sim_switchbench_start
+ *
+ * Description:
+ *   Called from the IDLE loop.  Start the context switch benchmark once,
+ *   after the system has been brought up.  The task is created from the
+ *   work queue; work_queue() itself never blocks.
+ *
+ ****************************************************************************/
+
+void sim_switchbench_start(void)
+{
+  static bool started;
+
+  if (!started)
+    {
+      started = true;
+      (void)work_queue(LPWORK, &g_switchbench_work, switchbench_worker,
+                       NULL, 0);
+    }
+}
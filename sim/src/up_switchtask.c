@@ -0,0 +1,115 @@
+/****************************************************************************
+ * arch/sim/src/up_switchtask.c
+ *
+ *   Copyright (C) 2016 Gregory Nutt. All rights reserved.
+ *   Author: Gregory Nutt <gnutt@nuttx.org>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name NuttX nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************/
+
+/****************************************************************************
+ * Included Files
+ ****************************************************************************/
+
+#include <nuttx/config.h>
+
+#include <sched.h>
+#include <debug.h>
+
+#include <nuttx/arch.h>
+#include <nuttx/sched.h>
+
+#include "sched/sched.h"
+#include "up_internal.h"
+
+/****************************************************************************
+ * Public Functions
+ ****************************************************************************/
+
+/****************************************************************************
+ * Name: up_switchtask
+ *
+ * Description:
+ *   Save the context of rtcb, the task that was running, and switch to the
+ *   task now at the head of the ready-to-run list.  This returns when
+ *   rtcb runs again.
+ *
+ ****************************************************************************/
+
+void up_switchtask(FAR struct tcb_s *rtcb)
+{
+  FAR struct tcb_s *ntcb;
+
+  /* Update scheduler parameters */
+
+  sched_suspend_scheduler(rtcb);
+
+#ifndef CONFIG_SIM_FASTSWITCH
+  /* Copy the exception context into the TCB of the task that was running.
+   * If up_setjmp returns a non-zero value, then this is really the
+   * previously running task restarting!
+   */
+
+  if (up_setjmp(rtcb->xcp.regs))
+    {
+      return;
+    }
+#endif
+
+  /* The new task at the head of the ready-to-run list */
+
+  ntcb = this_task();
+  sdbg("New Active Task TCB=%p\n", ntcb);
+
+  /* The way that we handle signals in the simulation is kind of a kludge.
+   * This would be unsafe in a truly multi-threaded, interrupt driven
+   * environment.
+   */
+
+  if (ntcb->xcp.sigdeliver)
+    {
+      sdbg("Delivering signals TCB=%p\n", ntcb);
+      ((sig_deliver_t)ntcb->xcp.sigdeliver)(ntcb);
+      ntcb->xcp.sigdeliver = NULL;
+    }
+
+  /* Update scheduler parameters */
+
+  sched_resume_scheduler(ntcb);
+
+  /* Then switch contexts */
+
+#ifdef CONFIG_SIM_FASTSWITCH
+  /* Save the context and resume the new task in one step */
+
+  up_swapcontext(rtcb->xcp.regs, ntcb->xcp.regs);
+#else
+  up_longjmp(ntcb->xcp.regs, 1);
+#endif
+}
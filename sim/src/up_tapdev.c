@@ -56,6 +56,10 @@
 #include <stdio.h>
 #include <unistd.h>
 #include <string.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <poll.h>
+#include <pthread.h>
 
 #include <linux/if.h>
 #include <linux/if_tun.h>
@@ -65,10 +69,40 @@
  * Pre-processor Definitions
  ****************************************************************************/
 
-#define TAPDEV_DEBUG    1
+/* Define TAPDEV_DEBUG to log the Ethernet header of every frame */
+
+#undef TAPDEV_DEBUG
 
 #define DEVTAP          "/dev/net/tun"
 
+/* Size of the receive and transmit frame rings.  These must be provided on
+ * the command line from the Kconfig settings.
+ */
+
+#ifndef CONFIG_SIM_NETDEV_RXRING
+#  define CONFIG_SIM_NETDEV_RXRING 16
+#endif
+
+#ifndef CONFIG_SIM_NETDEV_TXRING
+#  define CONFIG_SIM_NETDEV_TXRING 16
+#endif
+
+/* Number of simulated Ethernet devices.  Each is bound to its own TAP
+ * device, tap0 through tapN-1.
+ */
+
+#ifndef CONFIG_SIM_NETDEV_NUMBER
+#  define CONFIG_SIM_NETDEV_NUMBER 1
+#endif
+
+/* Size of one frame buffer.  Normally provided on the command line */
+
+#ifndef NETDEV_BUFSIZE
+#  define NETDEV_BUFSIZE 1518
+#endif
+
+/* The host side of device N is assigned the address 192.168.N.128 */
+
 #ifndef CONFIG_EXAMPLES_WEBSERVER_DHCPC
 #  define TAP_IPADDR0   192
 #  define TAP_IPADDR1   168
@@ -101,6 +135,47 @@ struct sel_arg_struct
   struct timeval *tvp;
 };
 
+/* One frame in the receive or transmit ring */
+
+struct tapdev_frame_s
+{
+  unsigned int  len;
+  unsigned char buf[NETDEV_BUFSIZE];
+};
+
+/* A single-producer, single-consumer ring of frames.  The head index is
+ * only modified by the producer and the tail index only by the consumer.
+ */
+
+struct tapdev_ring_s
+{
+  volatile unsigned int head;
+  volatile unsigned int tail;
+};
+
+/* The state of one TAP device.  Each device has its own rings and is
+ * serviced by its own host I/O thread so that a busy link cannot starve
+ * the others.
+ */
+
+struct tapdev_s
+{
+  int devidx;                       /* Index of the device */
+  int fd;                           /* TAP device file descriptor */
+  int kick[2];                      /* Pipe used to wake up the I/O thread */
+  volatile int waiting;             /* The I/O thread is waiting */
+  unsigned long txdropped;          /* Frames dropped: transmit ring full */
+  struct tapdev_ring_s  rxring;
+  struct tapdev_ring_s  txring;
+  struct tapdev_frame_s rxframes[CONFIG_SIM_NETDEV_RXRING];
+  struct tapdev_frame_s txframes[CONFIG_SIM_NETDEV_TXRING];
+#ifdef CONFIG_SIM_NETIMPAIR
+  struct netimpair_s   *rximpair;   /* Receive impairment stage */
+  struct netimpair_s   *tximpair;   /* Transmit impairment stage */
+  unsigned char         impairbuf[NETDEV_BUFSIZE];
+#endif
+};
+
 /****************************************************************************
  * Private Function Prototypes
  ****************************************************************************/
@@ -110,16 +185,30 @@ struct sel_arg_struct
  ****************************************************************************/
 
 int syslog(int priority, const char *format, ...);
-int netdriver_setmacaddr(unsigned char *macaddr);
+int netdriver_setmacaddr(int devidx, unsigned char *macaddr);
 
 /****************************************************************************
- * Private Data
+ * Host Domain Public Function Prototypes
  ****************************************************************************/
 
-#ifdef TAPDEV_DEBUG
-static int gdrop = 0;
+#ifdef CONFIG_SIM_NETIMPAIR
+struct netimpair_s *netimpair_create(unsigned int stream);
+int netimpair_enqueue(struct netimpair_s *imp, const unsigned char *buf,
+                      unsigned int len);
+unsigned int netimpair_dequeue(struct netimpair_s *imp, unsigned char *buf,
+                               unsigned int buflen);
+int netimpair_timeout(struct netimpair_s *imp);
+#endif
+
+#ifdef CONFIG_SIM_HOSTTIMER
+void host_idle_wakeup(void);
 #endif
-static int gtapdevfd;
+
+/****************************************************************************
+ * Private Data
+ ****************************************************************************/
+
+static struct tapdev_s g_tapdev[CONFIG_SIM_NETDEV_NUMBER];
 
 /****************************************************************************
  * Private Functions
@@ -143,7 +232,354 @@ static inline void dump_ethhdr(const char *msg, unsigned char *buf, int buflen)
 #  define dump_ethhdr(m,b,l)
 #endif
 
-static int up_setmacaddr(void)
+/****************************************************************************
+ * Name: tapdev_ringnext
+ *
+ * Description:
+ *   Return the ring index following 'ndx' in a ring of 'nframes' entries
+ *
+ ****************************************************************************/
+
+static inline unsigned int tapdev_ringnext(unsigned int ndx,
+                                           unsigned int nframes)
+{
+  return (ndx + 1 >= nframes) ? 0 : ndx + 1;
+}
+
+/****************************************************************************
+ * Name: tapdev_kick
+ *
+ * Description:
+ *   Wake up the host I/O thread if it is waiting.  This is called from the
+ *   NuttX domain after new frames are queued for transmission or after a
+ *   slot is freed in the receive ring.
+ *
+ ****************************************************************************/
+
+static void tapdev_kick(struct tapdev_s *priv)
+{
+  char ch = 0;
+
+  __sync_synchronize();
+  if (priv->waiting)
+    {
+      priv->waiting = 0;
+      (void)write(priv->kick[1], &ch, 1);
+    }
+}
+
+/****************************************************************************
+ * Name: tapdev_report
+ *
+ * Description:
+ *   Called at exit.  Report the frames that were dropped because the
+ *   transmit ring was full.
+ *
+ ****************************************************************************/
+
+static void tapdev_report(void)
+{
+  int i;
+
+  for (i = 0; i < CONFIG_SIM_NETDEV_NUMBER; i++)
+    {
+      if (g_tapdev[i].txdropped > 0)
+        {
+          fprintf(stderr, "tap%d: %lu frames dropped, transmit ring full\n",
+                  i, g_tapdev[i].txdropped);
+        }
+    }
+}
+
+/****************************************************************************
+ * Name: tapdev_mintimeout
+ *
+ * Description:
+ *   Return the shorter of two poll() timeouts where -1 means forever
+ *
+ ****************************************************************************/
+
+#ifdef CONFIG_SIM_NETIMPAIR
+static inline int tapdev_mintimeout(int t1, int t2)
+{
+  if (t1 < 0)
+    {
+      return t2;
+    }
+
+  return (t2 >= 0 && t2 < t1) ? t2 : t1;
+}
+#endif
+
+/****************************************************************************
+ * Name: tapdev_rxrelease
+ *
+ * Description:
+ *   Move received frames whose impairment delay has expired into the
+ *   receive ring.  Runs on the host I/O thread.
+ *
+ ****************************************************************************/
+
+#ifdef CONFIG_SIM_NETIMPAIR
+static void tapdev_rxrelease(struct tapdev_s *priv)
+{
+  struct tapdev_frame_s *frame;
+  unsigned int head;
+  unsigned int next;
+  unsigned int len;
+
+  head = priv->rxring.head;
+  for (; ; )
+    {
+      next = tapdev_ringnext(head, CONFIG_SIM_NETDEV_RXRING);
+      if (next == priv->rxring.tail)
+        {
+          break;
+        }
+
+      frame = &priv->rxframes[head];
+      len   = netimpair_dequeue(priv->rximpair, frame->buf, NETDEV_BUFSIZE);
+      if (len == 0)
+        {
+          break;
+        }
+
+      frame->len = len;
+
+      __sync_synchronize();
+      priv->rxring.head = next;
+      head              = next;
+    }
+}
+#endif
+
+/****************************************************************************
+ * Name: tapdev_txrelease
+ *
+ * Description:
+ *   Write transmitted frames whose impairment delay has expired to the TAP
+ *   device.  Runs on the host I/O thread.
+ *
+ ****************************************************************************/
+
+#ifdef CONFIG_SIM_NETIMPAIR
+static void tapdev_txrelease(struct tapdev_s *priv)
+{
+  unsigned int len;
+
+  while ((len = netimpair_dequeue(priv->tximpair, priv->impairbuf,
+                                  NETDEV_BUFSIZE)) > 0)
+    {
+      (void)write(priv->fd, priv->impairbuf, len);
+    }
+}
+#endif
+
+/****************************************************************************
+ * Name: tapdev_rxburst
+ *
+ * Description:
+ *   Read all frames that are currently available from the TAP device into
+ *   the receive ring, stopping early if the ring becomes full.  Runs on the
+ *   host I/O thread.
+ *
+ ****************************************************************************/
+
+static void tapdev_rxburst(struct tapdev_s *priv)
+{
+#ifdef CONFIG_SIM_NETIMPAIR
+  ssize_t nread;
+
+  /* Pass everything through the impairment stage.  It will be moved into
+   * the receive ring by tapdev_rxrelease() when it is due.
+   */
+
+  while ((nread = read(priv->fd, priv->impairbuf, NETDEV_BUFSIZE)) > 0)
+    {
+      (void)netimpair_enqueue(priv->rximpair, priv->impairbuf,
+                              (unsigned int)nread);
+    }
+#else
+  struct tapdev_frame_s *frame;
+  unsigned int head;
+  unsigned int next;
+  ssize_t nread;
+
+  head = priv->rxring.head;
+  for (; ; )
+    {
+      next = tapdev_ringnext(head, CONFIG_SIM_NETDEV_RXRING);
+      if (next == priv->rxring.tail)
+        {
+          /* The ring is full.  Leave the remaining frames in the kernel
+           * until the NuttX domain catches up.
+           */
+
+          break;
+        }
+
+      frame = &priv->rxframes[head];
+      nread = read(priv->fd, frame->buf, NETDEV_BUFSIZE);
+      if (nread <= 0)
+        {
+          /* EAGAIN:  The burst is complete */
+
+          break;
+        }
+
+      frame->len = (unsigned int)nread;
+
+      /* Make sure that the frame content is visible before the new head */
+
+      __sync_synchronize();
+      priv->rxring.head = next;
+      head              = next;
+    }
+#endif
+}
+
+/****************************************************************************
+ * Name: tapdev_txburst
+ *
+ * Description:
+ *   Write all frames queued in the transmit ring to the TAP device.  Runs
+ *   on the host I/O thread.
+ *
+ ****************************************************************************/
+
+static void tapdev_txburst(struct tapdev_s *priv)
+{
+  struct tapdev_frame_s *frame;
+  unsigned int tail;
+
+  tail = priv->txring.tail;
+  while (tail != priv->txring.head)
+    {
+      __sync_synchronize();
+
+      frame = &priv->txframes[tail];
+#ifdef CONFIG_SIM_NETIMPAIR
+      (void)netimpair_enqueue(priv->tximpair, frame->buf, frame->len);
+#else
+      (void)write(priv->fd, frame->buf, frame->len);
+#endif
+
+      tail              = tapdev_ringnext(tail, CONFIG_SIM_NETDEV_TXRING);
+      priv->txring.tail = tail;
+    }
+}
+
+/****************************************************************************
+ * Name: tapdev_thread
+ *
+ * Description:
+ *   The host I/O thread of one TAP device.  Waits for the TAP device to
+ *   become readable or for a kick from the NuttX domain, then services both
+ *   rings.  The NuttX domain never blocks on the TAP device.
+ *
+ ****************************************************************************/
+
+static void *tapdev_thread(void *arg)
+{
+  struct tapdev_s *priv = (struct tapdev_s *)arg;
+  struct pollfd fds[2];
+  char drain[16];
+#ifdef CONFIG_SIM_HOSTTIMER
+  unsigned int rxhead;
+#endif
+  unsigned int next;
+  bool rxspace;
+  int timeout;
+
+  fds[0].fd     = priv->fd;
+  fds[1].fd     = priv->kick[0];
+  fds[1].events = POLLIN;
+
+  for (; ; )
+    {
+      /* Announce that we are about to wait before examining the rings so
+       * that any later change by the NuttX domain results in a kick.
+       */
+
+      priv->waiting = 1;
+      __sync_synchronize();
+
+      /* Only wait for receive data if there is space to hold it and don't
+       * wait at all if there are frames to be transmitted.
+       */
+
+      next    = tapdev_ringnext(priv->rxring.head, CONFIG_SIM_NETDEV_RXRING);
+      rxspace = (next != priv->rxring.tail);
+      timeout = (priv->txring.tail != priv->txring.head) ? 0 : -1;
+
+#ifdef CONFIG_SIM_NETIMPAIR
+      /* The impairment stage buffers received frames itself, so keep
+       * reading.  But also wake up when the next delayed frame is due.
+       */
+
+      fds[0].events = POLLIN;
+      timeout = tapdev_mintimeout(timeout,
+                                  netimpair_timeout(priv->tximpair));
+      if (rxspace)
+        {
+          timeout = tapdev_mintimeout(timeout,
+                                      netimpair_timeout(priv->rximpair));
+        }
+#else
+      fds[0].events = rxspace ? POLLIN : 0;
+#endif
+
+      if (poll(fds, 2, timeout) < 0)
+        {
+          priv->waiting = 0;
+          if (errno == EINTR)
+            {
+              continue;
+            }
+
+          /* This is a host thread, so don't use the NuttX syslog */
+
+          fprintf(stderr, "tap%d: poll failed: %d, I/O stopped\n",
+                  priv->devidx, errno);
+          break;
+        }
+
+      priv->waiting = 0;
+
+      if ((fds[1].revents & POLLIN) != 0)
+        {
+          while (read(priv->kick[0], drain, sizeof(drain)) == sizeof(drain));
+        }
+
+      tapdev_txburst(priv);
+
+#ifdef CONFIG_SIM_HOSTTIMER
+      rxhead = priv->rxring.head;
+#endif
+      if ((fds[0].revents & POLLIN) != 0)
+        {
+          tapdev_rxburst(priv);
+        }
+
+#ifdef CONFIG_SIM_NETIMPAIR
+      tapdev_txrelease(priv);
+      tapdev_rxrelease(priv);
+#endif
+
+#ifdef CONFIG_SIM_HOSTTIMER
+      /* Don't let newly received frames wait for the IDLE loop timeout */
+
+      if (priv->rxring.head != rxhead)
+        {
+          host_idle_wakeup();
+        }
+#endif
+    }
+
+  return NULL;
+}
+
+static int up_setmacaddr(struct tapdev_s *priv, const char *ifname)
 {
   int sockfd;
   int ret = -1;
@@ -158,7 +594,7 @@ static int up_setmacaddr(void)
 
       /* Put the driver name into the request */
 
-      strncpy(req.ifr_name, "tap0", IFNAMSIZ);
+      strncpy(req.ifr_name, ifname, IFNAMSIZ);
 
       /* Perform the ioctl to get the MAC address */
 
@@ -167,8 +603,11 @@ static int up_setmacaddr(void)
         {
           /* Set the MAC address */
 
-          ret = netdriver_setmacaddr((unsigned char *)&req.ifr_hwaddr.sa_data);
+          ret = netdriver_setmacaddr(priv->devidx,
+                                     (unsigned char *)&req.ifr_hwaddr.sa_data);
         }
+
+      close(sockfd);
     }
 
   return ret;
@@ -178,18 +617,29 @@ static int up_setmacaddr(void)
  * Public Functions
  ****************************************************************************/
 
-void tapdev_init(void)
+void tapdev_init(int devidx)
 {
+  struct tapdev_s *priv = &g_tapdev[devidx];
   struct ifreq ifr;
+  pthread_t tid;
   char buf[1024];
   int ret;
 
+  priv->devidx  = devidx;
+  priv->kick[0] = -1;
+  priv->kick[1] = -1;
+
+  if (devidx == 0)
+    {
+      (void)atexit(tapdev_report);
+    }
+
   /* Open the tap device */
 
-  gtapdevfd = open(DEVTAP, O_RDWR, 0644);
-  if (gtapdevfd < 0)
+  priv->fd = open(DEVTAP, O_RDWR, 0644);
+  if (priv->fd < 0)
     {
-      syslog(LOG_ERR, "TAPDEV: open failed: %d\n", -gtapdevfd);
+      syslog(LOG_ERR, "TAPDEV: open failed: %d\n", -priv->fd);
       return;
     }
 
@@ -197,85 +647,175 @@ void tapdev_init(void)
 
   memset(&ifr, 0, sizeof(ifr));
   ifr.ifr_flags = IFF_TAP | IFF_NO_PI;
-  ret = ioctl(gtapdevfd, TUNSETIFF, (unsigned long) &ifr);
+  snprintf(ifr.ifr_name, IFNAMSIZ, "tap%d", devidx);
+
+  ret = ioctl(priv->fd, TUNSETIFF, (unsigned long) &ifr);
   if (ret < 0)
     {
       syslog(LOG_ERR, "TAPDEV: ioctl failed: %d\n", -ret);
-      return;
+      goto errout_with_fd;
    }
 
   /* Assign an IPv4 address to the tap device */
 
-  snprintf(buf, sizeof(buf), "/sbin/ifconfig tap0 inet %d.%d.%d.%d\n",
-           TAP_IPADDR0, TAP_IPADDR1, TAP_IPADDR2, TAP_IPADDR3);
+  snprintf(buf, sizeof(buf), "/sbin/ifconfig %s inet %d.%d.%d.%d\n",
+           ifr.ifr_name, TAP_IPADDR0, TAP_IPADDR1, TAP_IPADDR2 + devidx,
+           TAP_IPADDR3);
   system(buf);
 
   /* Set the MAC address */
 
-  up_setmacaddr();
+  up_setmacaddr(priv, ifr.ifr_name);
+
+  /* The TAP device is only accessed non-blocking from the host I/O thread.
+   * The pipe is used by the NuttX domain to wake up that thread.
+   */
+
+  (void)fcntl(priv->fd, F_SETFL, fcntl(priv->fd, F_GETFL) | O_NONBLOCK);
+
+  ret = pipe(priv->kick);
+  if (ret < 0)
+    {
+      syslog(LOG_ERR, "TAPDEV: pipe failed: %d\n", errno);
+      goto errout_with_fd;
+    }
+
+  (void)fcntl(priv->kick[0], F_SETFL, O_NONBLOCK);
+  (void)fcntl(priv->kick[1], F_SETFL, O_NONBLOCK);
+
+#ifdef CONFIG_SIM_NETIMPAIR
+  /* Create the impairment stage for each direction of the link */
+
+  priv->rximpair = netimpair_create(2 * devidx);
+  priv->tximpair = netimpair_create(2 * devidx + 1);
+  if (priv->rximpair == NULL || priv->tximpair == NULL)
+    {
+      syslog(LOG_ERR, "TAPDEV: netimpair_create failed\n");
+      goto errout_with_pipe;
+    }
+#endif
+
+  /* Start the host I/O thread -- all default settings */
+
+  ret = pthread_create(&tid, NULL, tapdev_thread, priv);
+  if (ret != 0)
+    {
+      syslog(LOG_ERR, "TAPDEV: pthread_create failed: %d\n", ret);
+      goto errout_with_pipe;
+    }
+
+  return;
+
+errout_with_pipe:
+#ifdef CONFIG_SIM_NETIMPAIR
+  free(priv->rximpair);
+  free(priv->tximpair);
+  priv->rximpair = NULL;
+  priv->tximpair = NULL;
+#endif
+  close(priv->kick[0]);
+  close(priv->kick[1]);
+  priv->kick[0] = -1;
+  priv->kick[1] = -1;
+
+errout_with_fd:
+  close(priv->fd);
+  priv->fd = -1;
 }
 
-unsigned int tapdev_read(unsigned char *buf, unsigned int buflen)
+unsigned int tapdev_read(int devidx, unsigned char *buf, unsigned int buflen)
 {
-  fd_set                fdset;
-  struct timeval        tv;
-  int                   ret;
+  struct tapdev_s *priv = &g_tapdev[devidx];
+  struct tapdev_frame_s *frame;
+  unsigned int tail;
+  unsigned int len;
+  bool wasfull;
 
   /* We can't do anything if we failed to open the tap device */
 
-  if (gtapdevfd < 0)
+  if (priv->fd < 0)
     {
       return 0;
     }
 
-  /* Wait for data on the tap device (or a timeout) */
-
-  tv.tv_sec  = 0;
-  tv.tv_usec = 1000;
-
-  FD_ZERO(&fdset);
-  FD_SET(gtapdevfd, &fdset);
+  /* Return zero immediately if there is no buffered frame.  This function
+   * never waits; received frames are buffered by the host I/O thread.
+   */
 
-  ret = select(gtapdevfd + 1, &fdset, NULL, NULL, &tv);
-  if (ret == 0)
+  tail = priv->rxring.tail;
+  if (tail == priv->rxring.head)
     {
       return 0;
     }
 
-  ret = read(gtapdevfd, buf, buflen);
-  if (ret < 0)
+  __sync_synchronize();
+
+  frame = &priv->rxframes[tail];
+  len   = frame->len < buflen ? frame->len : buflen;
+  memcpy(buf, frame->buf, len);
+
+  /* Release the slot.  If the ring was full, the I/O thread stopped
+   * watching the TAP device and must be told that there is space again.
+   */
+
+  wasfull = (tapdev_ringnext(priv->rxring.head, CONFIG_SIM_NETDEV_RXRING) ==
+             tail);
+  priv->rxring.tail = tapdev_ringnext(tail, CONFIG_SIM_NETDEV_RXRING);
+
+  if (wasfull)
     {
-      syslog(LOG_ERR, "TAPDEV: read failed: %d\n", -ret);
-      return 0;
+      tapdev_kick(priv);
     }
 
-  dump_ethhdr("read", buf, ret);
-  return ret;
+  dump_ethhdr("read", buf, len);
+  return len;
 }
 
-void tapdev_send(unsigned char *buf, unsigned int buflen)
+void tapdev_send(int devidx, unsigned char *buf, unsigned int buflen)
 {
-  int ret;
-#ifdef TAPDEV_DEBUG
-  syslog(LOG_INFO, "tapdev_send: sending %d bytes\n", buflen);
+  struct tapdev_s *priv = &g_tapdev[devidx];
+  struct tapdev_frame_s *frame;
+  unsigned int head;
+  unsigned int next;
 
-  gdrop++;
-  if (gdrop % 8 == 7)
+  if (priv->fd < 0 || buflen > NETDEV_BUFSIZE)
     {
-      syslog(LOG_ERR, "TAPDEV: Dropped a packet!\n");
       return;
     }
-#endif
 
-  ret = write(gtapdevfd, buf, buflen);
-  if (ret < 0)
+  /* If the transmit ring is full, drop the frame as a real NIC would.
+   * The I/O thread is already draining the ring, so this only happens
+   * under sustained transmit load, or if the I/O thread has failed.
+   */
+
+  head = priv->txring.head;
+  next = tapdev_ringnext(head, CONFIG_SIM_NETDEV_TXRING);
+
+  if (next == priv->txring.tail)
     {
-      syslog(LOG_ERR, "TAPDEV: write failed: %d", -ret);
-      exit(1);
+      priv->txdropped++;
+      tapdev_kick(priv);
+      return;
     }
+
+  /* Queue the frame.  Frames queued in the same pass through the network
+   * driver are written out as one burst by the I/O thread.
+   */
+
+  frame      = &priv->txframes[head];
+  frame->len = buflen;
+  memcpy(frame->buf, buf, buflen);
+
+  __sync_synchronize();
+  priv->txring.head = next;
+
+  /* Wake up the I/O thread.  No system call is made if it is already busy
+   * draining the ring.
+   */
+
+  tapdev_kick(priv);
+
   dump_ethhdr("write", buf, buflen);
 }
 
 #endif /* !__CYGWIN__ */
-
-
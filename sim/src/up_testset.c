@@ -38,6 +38,8 @@
  ****************************************************************************/
 
 #include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
 #include <pthread.h>
 
 /****************************************************************************
@@ -48,6 +50,13 @@
 #define SP_UNLOCKED 0   /* The Un-locked state */
 #define SP_LOCKED   1   /* The Locked state */
 
+/* Spinlock statistics.  Locks are identified by address and hashed into a
+ * fixed size table.  Locks that do not fit into the table are not counted.
+ */
+
+#define SIM_LOCKSTAT_NSLOTS   256   /* Must be a power of two */
+#define SIM_LOCKSTAT_NREPORT  16    /* Number of locks reported at exit */
+
 /****************************************************************************
  * Public Types
  ****************************************************************************/
@@ -55,14 +64,129 @@
 
 typedef uint8_t spinlock_t;
 
+/****************************************************************************
+ * Private Types
+ ****************************************************************************/
+
+#ifdef CONFIG_SIM_SPINLOCK_STATS
+struct sim_lockstat_s
+{
+  uintptr_t lock;                 /* Address of the lock (0 = unused) */
+  unsigned long nacquired;        /* Number of successful test-and-sets */
+  unsigned long ncontended;       /* Number of failed test-and-sets */
+};
+#endif
+
 /****************************************************************************
  * Private Data
  ****************************************************************************/
 
-#ifdef CONFIG_SMP
-static pthread_mutex_t g_tsmutex = PTHREAD_MUTEX_INITIALIZER;
+#ifdef CONFIG_SIM_SPINLOCK_STATS
+static struct sim_lockstat_s g_lockstat[SIM_LOCKSTAT_NSLOTS];
+static pthread_once_t g_lockstat_once = PTHREAD_ONCE_INIT;
 #endif
 
+/****************************************************************************
+ * Private Functions
+ ****************************************************************************/
+
+#ifdef CONFIG_SIM_SPINLOCK_STATS
+/****************************************************************************
+ * Name: sim_lockstat_report
+ *
+ * Description:
+ *   Report the most contended spinlocks on stderr.  Runs at exit of the
+ *   simulation.  Lock addresses may be looked up in System.map.
+ *
+ ****************************************************************************/
+
+static void sim_lockstat_report(void)
+{
+  struct sim_lockstat_s *worst;
+  unsigned char reported[SIM_LOCKSTAT_NSLOTS] = { 0 };
+  int nreport;
+  int worstndx;
+  int i;
+
+  fprintf(stderr, "Spinlock statistics (most contended first):\n");
+  fprintf(stderr, "  %-18s %12s %12s\n", "Lock", "Acquired", "Contended");
+
+  for (nreport = 0; nreport < SIM_LOCKSTAT_NREPORT; nreport++)
+    {
+      worst    = NULL;
+      worstndx = -1;
+
+      for (i = 0; i < SIM_LOCKSTAT_NSLOTS; i++)
+        {
+          if (g_lockstat[i].lock != 0 && !reported[i] &&
+              (worst == NULL ||
+               g_lockstat[i].ncontended > worst->ncontended))
+            {
+              worst    = &g_lockstat[i];
+              worstndx = i;
+            }
+        }
+
+      if (worst == NULL)
+        {
+          break;
+        }
+
+      reported[worstndx] = 1;
+      fprintf(stderr, "  %#018lx %12lu %12lu\n", (unsigned long)worst->lock,
+              worst->nacquired, worst->ncontended);
+    }
+}
+
+/****************************************************************************
+ * Name: sim_lockstat_init
+ ****************************************************************************/
+
+static void sim_lockstat_init(void)
+{
+  (void)atexit(sim_lockstat_report);
+}
+
+/****************************************************************************
+ * Name: sim_lockstat
+ *
+ * Description:
+ *   Return the statistics entry for a lock, allocating one if this is the
+ *   first time that the lock is seen.  Lock-free:  Entries are claimed
+ *   with a compare-and-swap of the lock address.
+ *
+ ****************************************************************************/
+
+static struct sim_lockstat_s *sim_lockstat(volatile spinlock_t *lock)
+{
+  uintptr_t addr = (uintptr_t)lock;
+  uintptr_t prev;
+  unsigned int ndx;
+  int i;
+
+  (void)pthread_once(&g_lockstat_once, sim_lockstat_init);
+
+  ndx = (unsigned int)(addr ^ (addr >> 9)) & (SIM_LOCKSTAT_NSLOTS - 1);
+  for (i = 0; i < SIM_LOCKSTAT_NSLOTS; i++)
+    {
+      prev = __atomic_load_n(&g_lockstat[ndx].lock, __ATOMIC_RELAXED);
+      if (prev == 0)
+        {
+          prev = __sync_val_compare_and_swap(&g_lockstat[ndx].lock, 0, addr);
+        }
+
+      if (prev == 0 || prev == addr)
+        {
+          return &g_lockstat[ndx];
+        }
+
+      ndx = (ndx + 1) & (SIM_LOCKSTAT_NSLOTS - 1);
+    }
+
+  return NULL;
+}
+#endif /* CONFIG_SIM_SPINLOCK_STATS */
+
 /****************************************************************************
  * Public Functions
  ****************************************************************************/
@@ -89,23 +213,47 @@ static pthread_mutex_t g_tsmutex = PTHREAD_MUTEX_INITIALIZER;
 
 spinlock_t up_testset(volatile spinlock_t *lock)
 {
+#ifdef CONFIG_SIM_SPINLOCK_STATS
+  struct sim_lockstat_s *stat;
+#endif
+  spinlock_t ret;
+
 #ifdef CONFIG_SMP
-  /* In the multi-CPU SMP case, we use a mutex to assure that the following
-   * test and set is atomic.
+  /* In the multi-CPU SMP case, the CPUs are host pthreads that really run
+   * in parallel.  Use an atomic exchange so that CPUs contending for
+   * different spinlocks do not serialize on any common host lock.  If the
+   * lock is already held, don't even attempt the exchange:  Spinning on a
+   * plain load keeps the cache line shared between the waiting CPUs.
    */
 
-  (void)pthread_mutex_lock(&g_tsmutex);
-#endif
-
+  ret = __atomic_load_n(lock, __ATOMIC_RELAXED);
+  if (ret == SP_UNLOCKED)
+    {
+      ret = __atomic_exchange_n(lock, SP_LOCKED, __ATOMIC_ACQUIRE);
+    }
+#else
   /* In the non-SMP case, the simulation is implemented with a single thread
    * the test-and-set operation is inherently atomic.
    */
 
-  spinlock_t ret = *lock;
+  ret = *lock;
   *lock = SP_LOCKED;
+#endif
 
-#ifdef CONFIG_SMP
-  (void)pthread_mutex_unlock(&g_tsmutex);
+#ifdef CONFIG_SIM_SPINLOCK_STATS
+  stat = sim_lockstat(lock);
+  if (stat != NULL)
+    {
+      if (ret == SP_UNLOCKED)
+        {
+          __atomic_fetch_add(&stat->nacquired, 1, __ATOMIC_RELAXED);
+        }
+      else
+        {
+          __atomic_fetch_add(&stat->ncontended, 1, __ATOMIC_RELAXED);
+        }
+    }
 #endif
+
   return ret;
 }
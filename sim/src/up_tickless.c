@@ -64,10 +64,17 @@
 #include <stdint.h>
 #include <stdbool.h>
 #include <time.h>
+#include <assert.h>
 
 #include <nuttx/arch.h>
 #include <nuttx/clock.h>
 
+#ifdef CONFIG_SMP
+#  include "sched/sched.h"
+#endif
+
+#include "up_internal.h"
+
 #ifdef CONFIG_SCHED_TICKLESS
 
 /****************************************************************************
@@ -77,7 +84,7 @@
 #if defined(CONFIG_SIM_WALLTIME) || defined(CONFIG_SIM_X11FB)
 #  define TICK_USEC (USEC_PER_SEC / CLK_TCK)
 #  define TICK_SEC  (TICK_USEC / USEC_PER_SEC)
-#  define TICK_NSEC ((TICK_USEC % NSEC_PER_USEC) * NSEC_PER_USEC)
+#  define TICK_NSEC ((TICK_USEC % USEC_PER_SEC) * NSEC_PER_USEC)
 #else
 #  define TICK_SEC  0
 #  define TICK_NSEC NSEC_PER_TICK
@@ -87,9 +94,45 @@
  * Private Data
  ****************************************************************************/
 
+#ifndef CONFIG_SIM_HOSTTIMER
 static struct timespec g_elapsed_time;
 static struct timespec g_interval_delay;
 static bool g_timer_active;
+#endif
+
+/****************************************************************************
+ * Private Functions
+ ****************************************************************************/
+
+/****************************************************************************
+ * Name: up_timer_allidle
+ *
+ * Description:
+ *   Return true if no CPU is running anything but its IDLE task.  The
+ *   caller is in the IDLE loop, so this is always true without SMP.
+ *
+ ****************************************************************************/
+
+#ifdef CONFIG_SIM_VIRTUALTIME
+static bool up_timer_allidle(void)
+{
+#ifdef CONFIG_SMP
+  int cpu;
+
+  /* The IDLE task of CPU n has PID n */
+
+  for (cpu = 0; cpu < CONFIG_SMP_NCPUS; cpu++)
+    {
+      if (current_task(cpu)->pid >= CONFIG_SMP_NCPUS)
+        {
+          return false;
+        }
+    }
+#endif
+
+  return true;
+}
+#endif
 
 /****************************************************************************
  * Public Functions
@@ -122,6 +165,14 @@ static bool g_timer_active;
 
 void up_timer_initialize(void)
 {
+#ifdef CONFIG_SIM_HOSTTIMER
+  /* The host timer base, and hence the up-time, starts now */
+
+  if (host_timer_initialize() < 0)
+    {
+      PANIC();
+    }
+#endif
 }
 
 /****************************************************************************
@@ -159,8 +210,15 @@ void up_timer_initialize(void)
 
 int up_timer_gettime(FAR struct timespec *ts)
 {
+#ifdef CONFIG_SIM_HOSTTIMER
+  uint64_t nsec = host_timer_gettime();
+
+  ts->tv_sec  = nsec / NSEC_PER_SEC;
+  ts->tv_nsec = nsec % NSEC_PER_SEC;
+#else
   ts->tv_sec  = g_elapsed_time.tv_sec;
   ts->tv_nsec = g_elapsed_time.tv_nsec;
+#endif
   return OK;
 }
 
@@ -198,6 +256,16 @@ int up_timer_gettime(FAR struct timespec *ts)
 #ifdef CONFIG_SCHED_TICKLESS
 int up_timer_cancel(FAR struct timespec *ts)
 {
+#ifdef CONFIG_SIM_HOSTTIMER
+  /* Disarm the host timer.  This also discards an expiration that has not
+   * yet been seen by up_timer_update().
+   */
+
+  uint64_t nsec = host_timer_cancel();
+
+  ts->tv_sec  = nsec / NSEC_PER_SEC;
+  ts->tv_nsec = nsec % NSEC_PER_SEC;
+#else
   /* Return the time remaining on the simulated timer */
 
   if (g_timer_active)
@@ -216,6 +284,9 @@ int up_timer_cancel(FAR struct timespec *ts)
   g_interval_delay.tv_sec  = 0;
   g_interval_delay.tv_nsec = 0;
   g_timer_active           = false;
+#endif
+
+  return OK;
 }
 #endif
 
@@ -247,9 +318,15 @@ int up_timer_cancel(FAR struct timespec *ts)
 #ifdef CONFIG_SCHED_TICKLESS
 int up_timer_start(FAR const struct timespec *ts)
 {
+#ifdef CONFIG_SIM_HOSTTIMER
+  host_timer_start((uint64_t)ts->tv_sec * NSEC_PER_SEC + ts->tv_nsec);
+#else
   g_interval_delay.tv_sec  = ts->tv_sec;
   g_interval_delay.tv_nsec = ts->tv_nsec;
   g_timer_active           = true;
+#endif
+
+  return OK;
 }
 #endif
 
@@ -257,7 +334,10 @@ int up_timer_start(FAR const struct timespec *ts)
  * Name: up_timer_update
  *
  * Description:
- *   Called from the IDLE loop to fake one timer tick.
+ *   Called from the IDLE loop to fake one timer tick.  With the host timer,
+ *   this instead delivers a pending host timer expiration.  With virtual
+ *   time, the time jumps directly to the interval timer deadline if all
+ *   CPUs are idle.
  *
  * Input Parameters:
  *   None
@@ -269,6 +349,38 @@ int up_timer_start(FAR const struct timespec *ts)
 
 void up_timer_update(void)
 {
+#ifdef CONFIG_SIM_HOSTTIMER
+  /* Has the host timer expired since we last looked? */
+
+  if (host_timer_expired())
+    {
+      sched_timer_expiration();
+    }
+#else
+#ifdef CONFIG_SIM_VIRTUALTIME
+  /* If there is nothing to do until the interval timer expires, then skip
+   * the idle time and expire it now.
+   */
+
+  if (g_timer_active && up_timer_allidle())
+    {
+      g_elapsed_time.tv_sec  += g_interval_delay.tv_sec;
+      g_elapsed_time.tv_nsec += g_interval_delay.tv_nsec;
+      if (g_elapsed_time.tv_nsec >= NSEC_PER_SEC)
+        {
+          g_elapsed_time.tv_sec++;
+          g_elapsed_time.tv_nsec -= NSEC_PER_SEC;
+        }
+
+      g_interval_delay.tv_sec  = 0;
+      g_interval_delay.tv_nsec = 0;
+      g_timer_active           = false;
+
+      sched_timer_expiration();
+      return;
+    }
+#endif
+
   /* Increment the elapsed time */
 
   g_elapsed_time.tv_nsec += TICK_NSEC;
@@ -325,6 +437,7 @@ void up_timer_update(void)
             }
         }
     }
+#endif
 }
 
 #endif /* CONFIG_SCHED_TICKLESS */
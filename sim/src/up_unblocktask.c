@@ -90,44 +90,10 @@ void up_unblock_task(FAR struct tcb_s *tcb)
   if (sched_addreadytorun(tcb))
     {
       /* The currently active task has changed! */
-      /* Update scheduler parameters */
-
-      sched_suspend_scheduler(rtcb);
-
-      /* Copy the exception context into the TCB of the task that was
-       * previously active.  if up_setjmp returns a non-zero value, then
-       * this is really the previously running task restarting!
+      /* Save the context of the task that was previously active and
+       * switch to the new task that is ready to run (probably tcb).
        */
 
-      if (!up_setjmp(rtcb->xcp.regs))
-        {
-          /* Restore the exception context of the new task that is ready to
-           * run (probably tcb).  This is the new rtcb at the head of the
-           * ready-to-run task list.
-           */
-
-          rtcb = this_task();
-          sdbg("New Active Task TCB=%p\n", rtcb);
-
-          /* The way that we handle signals in the simulation is kind of
-           * a kludge.  This would be unsafe in a truly multi-threaded, interrupt
-           * driven environment.
-           */
-
-          if (rtcb->xcp.sigdeliver)
-            {
-              sdbg("Delivering signals TCB=%p\n", rtcb);
-              ((sig_deliver_t)rtcb->xcp.sigdeliver)(rtcb);
-              rtcb->xcp.sigdeliver = NULL;
-            }
-
-          /* Update scheduler parameters */
-
-          sched_resume_scheduler(rtcb);
-
-          /* Then switch contexts */
-
-          up_longjmp(rtcb->xcp.regs, 1);
-       }
+      up_switchtask(rtcb);
     }
 }
@@ -41,11 +41,41 @@
 
 #include <X11/Xlib.h>
 
+/****************************************************************************
+ * Pre-processor Definitions
+ ****************************************************************************/
+
+/* This must match SIM_REPLAY_X11 in up_internal.h */
+
+#define X11_REPLAY_SOURCE 1
+
+/****************************************************************************
+ * Private Types
+ ****************************************************************************/
+
+/* A button event as it is recorded for replay */
+
+struct x11_replayevent_s
+{
+  int x;
+  int y;
+  int buttons;
+};
+
 /****************************************************************************
  * Public Function Prototypes
  ****************************************************************************/
 
 extern int up_buttonevent(int x, int y, int buttons);
+void up_x11expose(void);
+
+#ifdef CONFIG_SIM_REPLAY_RECORD
+void sim_replay_record(int source, const void *data, unsigned int len);
+#endif
+
+#ifdef CONFIG_SIM_REPLAY_PLAY
+unsigned int sim_replay_fetch(int source, void *data, unsigned int len);
+#endif
 
 /****************************************************************************
  * Public Data
@@ -89,6 +119,35 @@ static int up_buttonmap(int state)
   return buttons;
 }
 
+/****************************************************************************
+ * Name: up_x11buttonevent
+ *
+ * Description:
+ *   Deliver one button event, logging it when recording.  Live events are
+ *   dropped when replaying.
+ *
+ ****************************************************************************/
+
+static void up_x11buttonevent(int x, int y, int buttons)
+{
+#ifdef CONFIG_SIM_REPLAY_RECORD
+  struct x11_replayevent_s event;
+
+  event.x       = x;
+  event.y       = y;
+  event.buttons = buttons;
+  sim_replay_record(X11_REPLAY_SOURCE, &event, sizeof(event));
+#endif
+
+#ifdef CONFIG_SIM_REPLAY_PLAY
+  (void)x;
+  (void)y;
+  (void)buttons;
+#else
+  up_buttonevent(x, y, buttons);
+#endif
+}
+
 /****************************************************************************
  * Public Functions
  ****************************************************************************/
@@ -105,6 +164,18 @@ void up_x11events(void)
 {
   XEvent event;
 
+#ifdef CONFIG_SIM_REPLAY_PLAY
+  struct x11_replayevent_s replay;
+
+  /* Deliver the button events recorded in this IDLE pass */
+
+  while (sim_replay_fetch(X11_REPLAY_SOURCE, &replay, sizeof(replay)) ==
+         sizeof(replay))
+    {
+      up_buttonevent(replay.x, replay.y, replay.buttons);
+    }
+#endif
+
   /* Check if there are any pending, queue X11 events. */
 
   if (XPending(g_display) > 0)
@@ -121,16 +192,23 @@ void up_x11events(void)
         {
           case MotionNotify : /* Enabled by ButtonMotionMask */
             {
-              up_buttonevent(event.xmotion.x, event.xmotion.y,
-                             up_buttonmap(event.xmotion.state));
+              up_x11buttonevent(event.xmotion.x, event.xmotion.y,
+                                up_buttonmap(event.xmotion.state));
             }
             break;
 
           case ButtonPress  : /* Enabled by ButtonPressMask */
           case ButtonRelease : /* Enabled by ButtonReleaseMask */
             {
-              up_buttonevent(event.xbutton.x, event.xbutton.y,
-                             up_buttonmap(event.xbutton.state));
+              up_x11buttonevent(event.xbutton.x, event.xbutton.y,
+                                up_buttonmap(event.xbutton.state));
+            }
+            break;
+
+          case Expose :     /* Enabled by ExposureMask */
+          case MapNotify :  /* Enabled by StructureNotifyMask */
+            {
+              up_x11expose();
             }
             break;
 
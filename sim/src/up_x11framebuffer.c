@@ -39,9 +39,11 @@
 
 #define CONFIG_SIM_X11NOSHM 1
 
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 #include <X11/Xlib.h>
 #include <X11/Xutil.h>
 #include <sys/ipc.h>
@@ -51,6 +53,18 @@
 #  include <X11/extensions/XShm.h>
 #endif
 
+/****************************************************************************
+ * Pre-processor Definitions
+ ****************************************************************************/
+
+/* Maximum rate of display updates */
+
+#ifndef CONFIG_SIM_X11FB_FPS
+#  define CONFIG_SIM_X11FB_FPS 30
+#endif
+
+#define X11_UPDATE_INTERVAL (1000000000ull / CONFIG_SIM_X11FB_FPS)
+
 /****************************************************************************
  * Public Data
  ****************************************************************************/
@@ -78,6 +92,16 @@ static unsigned short g_fbpixelheight;
 static int g_shmcheckpoint = 0;
 static int b_useshm;
 
+/* Damage tracking.  g_shadow holds the frame as it was last sent to the X
+ * server.  Only the rectangle that differs from it is sent again, unless
+ * the window was (re-)mapped or exposed and lost its content.
+ */
+
+static unsigned char *g_shadow;
+static unsigned int g_fblen;
+static int g_fullupdate = 1;
+static uint64_t g_lastupdate;
+
 /****************************************************************************
  * Private Functions
  ****************************************************************************/
@@ -121,15 +145,18 @@ static inline int up_x11createframe(void)
 
   XMapWindow(g_display, g_window);
 
-  /* Select window input events */
+  /* Select window input events.  Expose and MapNotify events tell us when
+   * the window content must be sent again.
+   */
 
 #if defined(CONFIG_SIM_AJOYSTICK)
   XSelectInput(g_display, g_window,
-               ButtonPressMask | ButtonReleaseMask | PointerMotionMask);
+               ButtonPressMask | ButtonReleaseMask | PointerMotionMask |
+               ExposureMask | StructureNotifyMask);
 #else
   XSelectInput(g_display, g_window,
                ButtonPressMask | ButtonReleaseMask | PointerMotionMask |
-               KeyPressMask);
+               KeyPressMask | ExposureMask | StructureNotifyMask);
 #endif
 
   /* Release queued events on the display */
@@ -406,6 +433,11 @@ int up_x11initialize(unsigned short width, unsigned short height,
       /* Map the window to shared memory */
 
       up_x11mapsharedmem(windowAttributes.depth, *fblen);
+
+      /* Allocate the shadow copy used for damage tracking */
+
+      g_fblen  = *fblen;
+      g_shadow = (unsigned char *)malloc(g_fblen);
       g_x11initialized = 1;
     }
 
@@ -454,24 +486,158 @@ int up_x11cmap(unsigned short first, unsigned short len,
   return 0;
 }
 
+/****************************************************************************
+ * Name: up_x11expose
+ *
+ * Description:
+ *   Called when the window has been mapped or exposed.  The whole frame is
+ *   sent by the next up_x11update().
+ *
+ ****************************************************************************/
+
+void up_x11expose(void)
+{
+  g_fullupdate = 1;
+}
+
 /****************************************************************************
  * Name: up_x11update
+ *
+ * Description:
+ *   Called periodically from the IDLE loop.  At most CONFIG_SIM_X11FB_FPS
+ *   times per second, find the rectangle of the framebuffer that changed
+ *   since the last update and send only that rectangle to the X server.
+ *   The request is flushed, but we do not wait for the X server to
+ *   complete it.
+ *
  ****************************************************************************/
 
 void up_x11update(void)
 {
+  struct timespec ts;
+  XEvent event;
+  unsigned char *fbrow;
+  unsigned char *shrow;
+  unsigned int stride;
+  unsigned int bytespp;
+  uint64_t now;
+  int first;
+  int last;
+  int x0;
+  int x1;
+  int y0;
+  int y1;
+  int row;
+
+  (void)clock_gettime(CLOCK_MONOTONIC, &ts);
+  now = (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+  if (now - g_lastupdate < X11_UPDATE_INTERVAL)
+    {
+      return;
+    }
+
+  g_lastupdate = now;
+
+  /* Consume the Expose and MapNotify events, leaving any input events to
+   * up_x11events().
+   */
+
+  while (XCheckTypedWindowEvent(g_display, g_window, Expose, &event) ||
+         XCheckTypedWindowEvent(g_display, g_window, MapNotify, &event))
+    {
+      g_fullupdate = 1;
+    }
+
+  stride  = g_image->bytes_per_line;
+  bytespp = (g_image->bits_per_pixel + 7) / 8;
+
+  if (g_shadow == NULL || g_fullupdate)
+    {
+      /* Send the whole frame */
+
+      x0 = 0;
+      x1 = g_fbpixelwidth - 1;
+      y0 = 0;
+      y1 = g_fbpixelheight - 1;
+      g_fullupdate = 0;
+    }
+  else
+    {
+      /* Find the bounding box of the bytes that changed */
+
+      x0 = stride;
+      x1 = -1;
+      y0 = -1;
+      y1 = -1;
+
+      for (row = 0; row < g_fbpixelheight; row++)
+        {
+          fbrow = (unsigned char *)g_image->data + row * stride;
+          shrow = g_shadow + row * stride;
+
+          if (memcmp(fbrow, shrow, stride) == 0)
+            {
+              continue;
+            }
+
+          for (first = 0; fbrow[first] == shrow[first]; first++);
+          for (last = stride - 1; fbrow[last] == shrow[last]; last--);
+
+          if (y0 < 0)
+            {
+              y0 = row;
+            }
+
+          y1 = row;
+
+          if (first < x0)
+            {
+              x0 = first;
+            }
+
+          if (last > x1)
+            {
+              x1 = last;
+            }
+        }
+
+      if (y0 < 0)
+        {
+          /* Nothing changed */
+
+          return;
+        }
+
+      /* Convert byte offsets to pixel columns */
+
+      x0 = x0 / bytespp;
+      x1 = x1 / bytespp;
+      if (x1 >= g_fbpixelwidth)
+        {
+          x1 = g_fbpixelwidth - 1;
+        }
+    }
+
+  /* Remember what is being sent */
+
+  if (g_shadow != NULL)
+    {
+      memcpy(g_shadow + y0 * stride, g_image->data + y0 * stride,
+             (y1 - y0 + 1) * stride);
+    }
+
 #ifndef CONFIG_SIM_X11NOSHM
   if (b_useshm)
     {
-      XShmPutImage(g_display, g_window, g_gc, g_image, 0, 0, 0, 0,
-                   g_fbpixelwidth, g_fbpixelheight, 0);
+      XShmPutImage(g_display, g_window, g_gc, g_image, x0, y0, x0, y0,
+                   x1 - x0 + 1, y1 - y0 + 1, 0);
     }
   else
 #endif
     {
-      XPutImage(g_display, g_window, g_gc, g_image, 0, 0, 0, 0,
-                g_fbpixelwidth, g_fbpixelheight);
+      XPutImage(g_display, g_window, g_gc, g_image, x0, y0, x0, y0,
+                x1 - x0 + 1, y1 - y0 + 1);
     }
 
-  XSync(g_display, 0);
+  XFlush(g_display);
 }